@@ -41,6 +41,7 @@
 #include <syscall.h>
 #include <proc.h>
 #include <opt-A3.h>
+#include <opt-A2.h>
 #include <addrspace.h>
 #include <synch.h>
 
@@ -117,47 +118,11 @@ kill_curthread(vaddr_t epc, unsigned code, vaddr_t vaddr)
 
       (void)epc;
       (void)vaddr;
-	  struct addrspace *as;
-	  struct proc *p = curproc;
-
-	  lock_acquire(waitPidLock);
-	  struct procEntry *curEntry = getProcess(p->pId);
-	  curEntry->exitCode = sig;
-	  if(curEntry->parentId != P_NOID) {
-	    //struct procEntry *parent = getProcess(curEntry->parentId);
-	    //if(parent != NULL) {
-	      curEntry->status = P_ZOMBIE;
-	      cv_broadcast(ptCV, waitPidLock);
-	    //}
-	  }
-	  curEntry->status = P_EXIT;
-	  //removeProcess(curEntry->pid);
-
-	  lock_release(waitPidLock);
 
 	  DEBUG(DB_SYSCALL,"kill_curthread: _exit(%d)\n",sig);
 
-	  KASSERT(curproc->p_addrspace != NULL);
-	  as_deactivate();
-	  /*
-	   * clear p_addrspace before calling as_destroy. Otherwise if
-	   * as_destroy sleeps (which is quite possible) when we
-	   * come back we'll be calling as_activate on a
-	   * half-destroyed address space. This tends to be
-	   * messily fatal.
-	   */
-	  as = curproc_setas(NULL);
-	  as_destroy(as);
-
-	  /* detach this thread from its process */
-	  /* note: curproc cannot be used after this call */
-	  proc_remthread(curthread);
-
-	  /* if this is the last user process in the system, proc_destroy()
-	     will wake up the kernel menu thread */
-	  proc_destroy(p);
-	  
-	  thread_exit();
+	  /* takes the other threads of the process down too */
+	  sys__exit(sig);
 
 	  #endif
 
@@ -201,6 +166,7 @@ mips_trap(struct trapframe *tf)
 	/* Interrupt? Call the interrupt handler and return. */
 	if (code == EX_IRQ) {
 		int old_in;
+		struct trapframe *old_intrtf;
 		bool doadjust;
 
 		old_in = curthread->t_in_interrupt;
@@ -234,8 +200,14 @@ mips_trap(struct trapframe *tf)
 			doadjust = false;
 		}
 
+		/* for hardclock's profiling sample */
+		old_intrtf = curcpu->c_intrtf;
+		curcpu->c_intrtf = tf;
+
 		mainbus_interrupt(tf);
 
+		curcpu->c_intrtf = old_intrtf;
+
 		if (doadjust) {
 			KASSERT(curthread->t_curspl == IPL_HIGH);
 			KASSERT(curthread->t_iplhigh_count == 1);
@@ -244,6 +216,19 @@ mips_trap(struct trapframe *tf)
 		}
 
 		curthread->t_in_interrupt = old_in;
+
+#if OPT_A2
+		/*
+		 * Interrupted user thread of an exiting process: leave
+		 * now rather than going back to user mode. Turn
+		 * interrupts back on first, as for other traps below.
+		 */
+		if (!iskern && curproc != NULL && curproc->p_exiting) {
+			spl = splhigh();
+			splx(spl);
+			uthread_leave();
+		}
+#endif
 		goto done2;
 	}
 
@@ -270,6 +255,13 @@ mips_trap(struct trapframe *tf)
 		DEBUG(DB_SYSCALL, "syscall: #%d, args %x %x %x %x\n", 
 		      tf->tf_v0, tf->tf_a0, tf->tf_a1, tf->tf_a2, tf->tf_a3);
 
+#if OPT_A2
+		/* another thread called _exit: don't start anything new */
+		if (curproc->p_exiting) {
+			uthread_leave();
+		}
+#endif
+
 		syscall(tf);
 		goto done;
 	}
@@ -31,10 +31,16 @@
 #include <kern/errno.h>
 #include <kern/syscall.h>
 #include <lib.h>
+#include <endian.h>
+#include <copyinout.h>
 #include <mips/trapframe.h>
 #include <thread.h>
 #include <current.h>
 #include <syscall.h>
+#include <trace.h>
+#include <cpu.h>
+#include <clock.h>
+#include <platform/maxcpus.h>
 #include "opt-A2.h"
 
 /*
@@ -75,18 +81,566 @@
  * stack, starting at sp+16 to skip over the slots for the
  * registerized values, with copyin().
  */
+
+/*
+ * System call table.
+ *
+ * Each entry gives the call's name, an adapter that pulls the
+ * arguments out of the trapframe and calls the sys_ function, and
+ * the argument shape: one letter per argument register used, 'i'
+ * for an integer and 'p' for a user pointer. The shape is only used
+ * to print calls for DB_SYSCALL. To add a call, write its adapter
+ * and add a line to the table.
+ *
+ * Adapters for calls that return a value other than 0 store it in
+ * *retval; the dispatcher passes it back to userlevel on success.
+ */
+
+#define NSYSCALLS	160	/* table size; above the highest SYS_ */
+
+struct sysent {
+	const char *sy_name;
+	int (*sy_call)(struct trapframe *tf, int32_t *retval);
+	const char *sy_args;		/* argument shape */
+};
+
+static
+int
+sc_reboot(struct trapframe *tf, int32_t *retval)
+{
+	(void)retval;
+	return sys_reboot(tf->tf_a0);
+}
+
+static
+int
+sc___time(struct trapframe *tf, int32_t *retval)
+{
+	(void)retval;
+	return sys___time((userptr_t)tf->tf_a0, (userptr_t)tf->tf_a1);
+}
+
+static
+int
+sc_nanosleep(struct trapframe *tf, int32_t *retval)
+{
+	(void)retval;
+	return sys_nanosleep((userptr_t)tf->tf_a0, (userptr_t)tf->tf_a1);
+}
+
+static
+int
+sc_ltrace(struct trapframe *tf, int32_t *retval)
+{
+	(void)retval;
+	return sys_ltrace(tf->tf_a0, tf->tf_a1);
+}
+
+#ifdef UW
+static
+int
+sc_open(struct trapframe *tf, int32_t *retval)
+{
+	return sys_open((userptr_t)tf->tf_a0, (int)tf->tf_a1,
+			(mode_t)tf->tf_a2, (int *)retval);
+}
+
+static
+int
+sc_read(struct trapframe *tf, int32_t *retval)
+{
+	return sys_read((int)tf->tf_a0, (userptr_t)tf->tf_a1,
+			(int)tf->tf_a2, (int *)retval);
+}
+
+static
+int
+sc_write(struct trapframe *tf, int32_t *retval)
+{
+	return sys_write((int)tf->tf_a0, (userptr_t)tf->tf_a1,
+			 (int)tf->tf_a2, (int *)retval);
+}
+
+/*
+ * pread/pwrite(int fd, void *buf, size_t len, off_t pos): pos is
+ * 64-bit and doesn't fit in the registers, so it's on the user stack
+ * (at sp+16; a3 is skipped to keep it aligned).
+ */
+static
+int
+sc_getpos(struct trapframe *tf, off_t *pos)
+{
+	uint32_t words[2];
+	uint64_t val;
+	int err;
+
+	err = copyin((const_userptr_t)(tf->tf_sp + 16), words, sizeof(words));
+	if (err) {
+		return err;
+	}
+	join32to64(words[0], words[1], &val);
+	*pos = val;
+	return 0;
+}
+
+static
+int
+sc_pread(struct trapframe *tf, int32_t *retval)
+{
+	off_t pos;
+	int err;
+
+	err = sc_getpos(tf, &pos);
+	if (err) {
+		return err;
+	}
+	return sys_pread((int)tf->tf_a0, (userptr_t)tf->tf_a1,
+			 (size_t)tf->tf_a2, pos, (int *)retval);
+}
+
+static
+int
+sc_pwrite(struct trapframe *tf, int32_t *retval)
+{
+	off_t pos;
+	int err;
+
+	err = sc_getpos(tf, &pos);
+	if (err) {
+		return err;
+	}
+	return sys_pwrite((int)tf->tf_a0, (userptr_t)tf->tf_a1,
+			  (size_t)tf->tf_a2, pos, (int *)retval);
+}
+
+static
+int
+sc_readv(struct trapframe *tf, int32_t *retval)
+{
+	return sys_readv((int)tf->tf_a0, (userptr_t)tf->tf_a1,
+			 (int)tf->tf_a2, (int *)retval);
+}
+
+static
+int
+sc_writev(struct trapframe *tf, int32_t *retval)
+{
+	return sys_writev((int)tf->tf_a0, (userptr_t)tf->tf_a1,
+			  (int)tf->tf_a2, (int *)retval);
+}
+
+static
+int
+sc_close(struct trapframe *tf, int32_t *retval)
+{
+	(void)retval;
+	return sys_close((int)tf->tf_a0);
+}
+
+/*
+ * lseek(int fd, off_t pos, int whence): pos is in a2/a3, so whence
+ * is on the user stack. The 64-bit result goes back in v0 (via
+ * *retval) and v1.
+ */
+static
+int
+sc_lseek(struct trapframe *tf, int32_t *retval)
+{
+	uint64_t pos;
+	off_t newpos;
+	int whence, err;
+
+	join32to64(tf->tf_a2, tf->tf_a3, &pos);
+	err = copyin((const_userptr_t)(tf->tf_sp + 16), &whence,
+		     sizeof(whence));
+	if (err) {
+		return err;
+	}
+	err = sys_lseek((int)tf->tf_a0, (off_t)pos, whence, &newpos);
+	if (err) {
+		return err;
+	}
+	split64to32((uint64_t)newpos, (uint32_t *)retval, &tf->tf_v1);
+	return 0;
+}
+
+static
+int
+sc_pipe(struct trapframe *tf, int32_t *retval)
+{
+	return sys_pipe((userptr_t)tf->tf_a0, (int *)retval);
+}
+
+static
+int
+sc_poll(struct trapframe *tf, int32_t *retval)
+{
+	return sys_poll((userptr_t)tf->tf_a0, (unsigned)tf->tf_a1,
+			(int)tf->tf_a2, (int *)retval);
+}
+
+static
+int
+sc_aring_setup(struct trapframe *tf, int32_t *retval)
+{
+	(void)retval;
+	return sys_aring_setup((userptr_t)tf->tf_a0);
+}
+
+static
+int
+sc_aring_enter(struct trapframe *tf, int32_t *retval)
+{
+	return sys_aring_enter((unsigned)tf->tf_a0, (int *)retval);
+}
+
+/* len and flags are the fifth and sixth arguments, on the stack */
+static
+int
+sc_copy_file_range(struct trapframe *tf, int32_t *retval)
+{
+	uint32_t words[2];
+	int err;
+
+	err = copyin((const_userptr_t)(tf->tf_sp + 16), words, sizeof(words));
+	if (err) {
+		return err;
+	}
+	if (words[1] != 0) {
+		/* no flags are defined */
+		return EINVAL;
+	}
+	return sys_copy_file_range((int)tf->tf_a0, (userptr_t)tf->tf_a1,
+				   (int)tf->tf_a2, (userptr_t)tf->tf_a3,
+				   (size_t)words[0], (int *)retval);
+}
+
+static
+int
+sc_dup2(struct trapframe *tf, int32_t *retval)
+{
+	return sys_dup2((int)tf->tf_a0, (int)tf->tf_a1, (int *)retval);
+}
+
+static
+int
+sc_getdirentry(struct trapframe *tf, int32_t *retval)
+{
+	return sys_getdirentry((int)tf->tf_a0, (userptr_t)tf->tf_a1,
+			       (size_t)tf->tf_a2, (int *)retval);
+}
+
+static
+int
+sc__exit(struct trapframe *tf, int32_t *retval)
+{
+	(void)retval;
+	sys__exit((int)tf->tf_a0);
+	/* sys__exit does not return, execution should not get here */
+	panic("unexpected return from sys__exit");
+	return 0;
+}
+
+static
+int
+sc_getpid(struct trapframe *tf, int32_t *retval)
+{
+	(void)tf;
+	return sys_getpid((pid_t *)retval);
+}
+
+static
+int
+sc_waitpid(struct trapframe *tf, int32_t *retval)
+{
+	return sys_waitpid((pid_t)tf->tf_a0, (userptr_t)tf->tf_a1,
+			   (int)tf->tf_a2, (pid_t *)retval);
+}
+
+#if OPT_A2
+static
+int
+sc_fork(struct trapframe *tf, int32_t *retval)
+{
+	return sys_fork(tf, (pid_t *)retval);
+}
+
+static
+int
+sc_execv(struct trapframe *tf, int32_t *retval)
+{
+	(void)retval;
+	return sys_execv((char *)tf->tf_a0, (char **)tf->tf_a1);
+}
+
+static
+int
+sc___thread_create(struct trapframe *tf, int32_t *retval)
+{
+	return sys___thread_create(tf, (userptr_t)tf->tf_a0,
+				   (userptr_t)tf->tf_a1,
+				   (userptr_t)tf->tf_a2, (int *)retval);
+}
+
+static
+int
+sc_thread_join(struct trapframe *tf, int32_t *retval)
+{
+	(void)retval;
+	return sys_thread_join((int)tf->tf_a0, (userptr_t)tf->tf_a1);
+}
+
+static
+int
+sc_thread_exit(struct trapframe *tf, int32_t *retval)
+{
+	(void)retval;
+	sys_thread_exit((int)tf->tf_a0);
+	/* sys_thread_exit does not return */
+	panic("unexpected return from sys_thread_exit");
+	return 0;
+}
+
+static
+int
+sc_futex_wait(struct trapframe *tf, int32_t *retval)
+{
+	(void)retval;
+	return sys_futex_wait((userptr_t)tf->tf_a0, (int)tf->tf_a1);
+}
+
+static
+int
+sc_futex_wake(struct trapframe *tf, int32_t *retval)
+{
+	return sys_futex_wake((userptr_t)tf->tf_a0, (int)tf->tf_a1,
+			      (int *)retval);
+}
+#endif /* OPT_A2 */
+#endif /* UW */
+
+static const struct sysent sysent[NSYSCALLS] = {
+	[SYS_reboot] =		{ "reboot",	sc_reboot,	"i" },
+	[SYS___time] =		{ "__time",	sc___time,	"pp" },
+	[SYS_nanosleep] =	{ "nanosleep",	sc_nanosleep,	"pp" },
+	[SYS_ltrace] =		{ "ltrace",	sc_ltrace,	"ii" },
+#ifdef UW
+	[SYS_open] =		{ "open",	sc_open,	"pii" },
+	[SYS_read] =		{ "read",	sc_read,	"ipi" },
+	[SYS_write] =		{ "write",	sc_write,	"ipi" },
+	[SYS_pread] =		{ "pread",	sc_pread,	"ipi" },
+	[SYS_pwrite] =		{ "pwrite",	sc_pwrite,	"ipi" },
+	[SYS_readv] =		{ "readv",	sc_readv,	"ipi" },
+	[SYS_writev] =		{ "writev",	sc_writev,	"ipi" },
+	[SYS_close] =		{ "close",	sc_close,	"i" },
+	[SYS_lseek] =		{ "lseek",	sc_lseek,	"iiii" },
+	[SYS_dup2] =		{ "dup2",	sc_dup2,	"ii" },
+	[SYS_getdirentry] =	{ "getdirentry", sc_getdirentry, "ipi" },
+	[SYS_pipe] =		{ "pipe",	sc_pipe,	"p" },
+	[SYS_copy_file_range] =	{ "copy_file_range", sc_copy_file_range, "ipip" },
+	[SYS_poll] =		{ "poll",	sc_poll,	"pii" },
+	[SYS_aring_setup] =	{ "aring_setup", sc_aring_setup, "p" },
+	[SYS_aring_enter] =	{ "aring_enter", sc_aring_enter, "i" },
+	[SYS__exit] =		{ "_exit",	sc__exit,	"i" },
+	[SYS_getpid] =		{ "getpid",	sc_getpid,	"" },
+	[SYS_waitpid] =		{ "waitpid",	sc_waitpid,	"ipi" },
+#if OPT_A2
+	[SYS_fork] =		{ "fork",	sc_fork,	"" },
+	[SYS_execv] =		{ "execv",	sc_execv,	"pp" },
+	[SYS___thread_create] =	{ "__thread_create", sc___thread_create, "ppp" },
+	[SYS_thread_join] =	{ "thread_join", sc_thread_join, "ip" },
+	[SYS_thread_exit] =	{ "thread_exit", sc_thread_exit, "i" },
+	[SYS_futex_wait] =	{ "futex_wait",	sc_futex_wait,	"pi" },
+	[SYS_futex_wake] =	{ "futex_wake",	sc_futex_wake,	"pi" },
+#endif /* OPT_A2 */
+#endif /* UW */
+};
+
+/*
+ * Per-cpu system call statistics.
+ *
+ * Call and error counts are always kept. Latencies, in log2 buckets
+ * of microseconds, are only measured while syscall_timing is set,
+ * since reading the clock twice per call is not free.
+ *
+ * Each cpu updates its own table without locks. A thread that is
+ * moved to another cpu in the middle of an update can, rarely, lose
+ * a count; that's fine for statistics.
+ */
+
+#define SC_NBUCKETS	16	/* <1us, 1us, 2-3us, 4-7us, ..., >=16384us */
+
+struct syscall_stats {
+	uint32_t ss_calls[NSYSCALLS];
+	uint32_t ss_errors[NSYSCALLS];
+	uint32_t ss_timed[NSYSCALLS];	/* calls measured */
+	uint64_t ss_totalns[NSYSCALLS];	/* ...and their total time */
+	uint32_t ss_hist[NSYSCALLS][SC_NBUCKETS];
+};
+
+/* One table per cpu, indexed by c_number. Set once, never freed. */
+static struct syscall_stats *syscall_stats[MAXCPUS];
+
+/* Measure latencies. Set from the menu. */
+bool syscall_timing = false;
+
+void
+syscall_stats_cpu_start(void)
+{
+	struct syscall_stats *ss;
+	unsigned num;
+
+	num = curcpu->c_number;
+	KASSERT(num < MAXCPUS);
+	KASSERT(syscall_stats[num] == NULL);
+
+	ss = kmalloc(sizeof(*ss));
+	if (ss == NULL) {
+		panic("syscall: out of memory for statistics\n");
+	}
+	bzero(ss, sizeof(*ss));
+	syscall_stats[num] = ss;
+}
+
+/*
+ * Record the end of a call that started at SECS/NSECS.
+ */
+static
+void
+syscall_timed(int callno, time_t secs, uint32_t nsecs)
+{
+	struct syscall_stats *ss;
+	time_t nowsecs, dsecs;
+	uint32_t nownsecs, dnsecs, us;
+	unsigned b;
+
+	gettime(&nowsecs, &nownsecs);
+	getinterval(secs, nsecs, nowsecs, nownsecs, &dsecs, &dnsecs);
+	us = (dsecs >= 4000) ? 0xffffffff : dsecs * 1000000 + dnsecs / 1000;
+
+	for (b = 0; us > 0 && b < SC_NBUCKETS - 1; b++) {
+		us >>= 1;
+	}
+
+	ss = syscall_stats[curcpu->c_number];
+	if (ss == NULL) {
+		return;
+	}
+	ss->ss_timed[callno]++;
+	ss->ss_totalns[callno] += (uint64_t)dsecs * 1000000000 + dnsecs;
+	ss->ss_hist[callno][b]++;
+}
+
+void
+syscall_stats_clear(void)
+{
+	unsigned i;
+
+	for (i=0; i<MAXCPUS; i++) {
+		if (syscall_stats[i] != NULL) {
+			bzero(syscall_stats[i], sizeof(struct syscall_stats));
+		}
+	}
+}
+
+void
+syscall_stats_print(void)
+{
+	static const char *const bucketnames[SC_NBUCKETS] = {
+		"<1", "1", "2", "4", "8", "16", "32", "64", "128", "256",
+		"512", "1k", "2k", "4k", "8k", "16k+",
+	};
+	uint32_t calls, errors, timed, hist[SC_NBUCKETS];
+	uint64_t totalns;
+	unsigned callno, cpu, b;
+	struct syscall_stats *ss;
+
+	kprintf("System calls (latency timing %s):\n",
+		syscall_timing ? "on" : "off");
+	kprintf("  %-16s %10s %8s %8s  latency histogram (us)\n",
+		"call", "count", "errors", "avg us");
+	for (callno=0; callno<NSYSCALLS; callno++) {
+		calls = errors = timed = 0;
+		totalns = 0;
+		for (b=0; b<SC_NBUCKETS; b++) {
+			hist[b] = 0;
+		}
+		for (cpu=0; cpu<MAXCPUS; cpu++) {
+			ss = syscall_stats[cpu];
+			if (ss == NULL) {
+				continue;
+			}
+			calls += ss->ss_calls[callno];
+			errors += ss->ss_errors[callno];
+			timed += ss->ss_timed[callno];
+			totalns += ss->ss_totalns[callno];
+			for (b=0; b<SC_NBUCKETS; b++) {
+				hist[b] += ss->ss_hist[callno][b];
+			}
+		}
+		if (calls == 0) {
+			continue;
+		}
+
+		kprintf("  %-16s %10u %8u ",
+			sysent[callno].sy_name ? sysent[callno].sy_name : "?",
+			calls, errors);
+		if (timed > 0) {
+			kprintf("%8lu ", (unsigned long)(totalns / timed / 1000));
+		}
+		else {
+			kprintf("%8s ", "-");
+		}
+		for (b=0; b<SC_NBUCKETS; b++) {
+			if (hist[b] > 0) {
+				kprintf(" %s:%u", bucketnames[b], hist[b]);
+			}
+		}
+		kprintf("\n");
+	}
+}
+
+/*
+ * Print a call and its arguments, according to its shape.
+ */
+static
+void
+syscall_debugprint(const struct sysent *sy, struct trapframe *tf)
+{
+	uint32_t args[4];
+	unsigned i;
+
+	args[0] = tf->tf_a0;
+	args[1] = tf->tf_a1;
+	args[2] = tf->tf_a2;
+	args[3] = tf->tf_a3;
+
+	kprintf("syscall: %s(", sy->sy_name);
+	for (i=0; i<4 && sy->sy_args[i] != 0; i++) {
+		kprintf(sy->sy_args[i] == 'p' ? "%s0x%x" : "%s%d",
+			i > 0 ? ", " : "", args[i]);
+	}
+	kprintf(")\n");
+}
+
 void
 syscall(struct trapframe *tf)
 {
+	const struct sysent *sy;
+	struct syscall_stats *ss;
 	int callno;
 	int32_t retval;
 	int err;
+	time_t secs = 0;
+	uint32_t nsecs = 0;
+	bool timed;
 
 	KASSERT(curthread != NULL);
 	KASSERT(curthread->t_curspl == 0);
 	KASSERT(curthread->t_iplhigh_count == 0);
 
 	callno = tf->tf_v0;
+	TRACE(TRC_SYSCALL, TE_SYSENTER, callno, tf->tf_a0);
 
 	/*
 	 * Initialize retval to 0. Many of the system calls don't
@@ -99,52 +653,38 @@ syscall(struct trapframe *tf)
 
 	retval = 0;
 
-	switch (callno) {
-	    case SYS_reboot:
-		err = sys_reboot(tf->tf_a0);
-		break;
+	if (callno < 0 || callno >= NSYSCALLS ||
+	    sysent[callno].sy_call == NULL) {
+		kprintf("Unknown syscall %d\n", callno);
+		err = ENOSYS;
+		timed = false;
+	}
+	else {
+		sy = &sysent[callno];
+		if (dbflags & DB_SYSCALL) {
+			syscall_debugprint(sy, tf);
+		}
 
-	    case SYS___time:
-		err = sys___time((userptr_t)tf->tf_a0,
-				 (userptr_t)tf->tf_a1);
-		break;
-#ifdef UW
-	case SYS_write:
-	  err = sys_write((int)tf->tf_a0,
-			  (userptr_t)tf->tf_a1,
-			  (int)tf->tf_a2,
-			  (int *)(&retval));
-	  break;
-	case SYS__exit:
-	  sys__exit((int)tf->tf_a0);
-	  /* sys__exit does not return, execution should not get here */
-	  panic("unexpected return from sys__exit");
-	  break;
-	case SYS_getpid:
-	  err = sys_getpid((pid_t *)&retval);
-	  break;
-	case SYS_waitpid:
-	  err = sys_waitpid((pid_t)tf->tf_a0,
-			    (userptr_t)tf->tf_a1,
-			    (int)tf->tf_a2,
-			    (pid_t *)&retval);
-	  break;
-  #if OPT_A2
-	 case SYS_fork:
-	 	err = sys_fork(tf, (pid_t *)&retval);
-	 	break;
-	 case SYS_execv:
-	 	err = sys_execv((char *)tf->tf_a0, (char **) tf->tf_a1);
-	 	break;
- 	#endif
-#endif // UW
-
-	    /* Add stuff here */
- 
-	default:
-	  kprintf("Unknown syscall %d\n", callno);
-	  err = ENOSYS;
-	  break;
+		ss = syscall_stats[curcpu->c_number];
+		if (ss != NULL) {
+			ss->ss_calls[callno]++;
+		}
+		timed = syscall_timing;
+		if (timed) {
+			gettime(&secs, &nsecs);
+		}
+
+		err = sy->sy_call(tf, &retval);
+
+		if (err) {
+			ss = syscall_stats[curcpu->c_number];
+			if (ss != NULL) {
+				ss->ss_errors[callno]++;
+			}
+		}
+		if (timed) {
+			syscall_timed(callno, secs, nsecs);
+		}
 	}
 
 
@@ -162,6 +702,7 @@ syscall(struct trapframe *tf)
 		tf->tf_v0 = retval;
 		tf->tf_a3 = 0;      /* signal no error */
 	}
+	TRACE(TRC_SYSCALL, TE_SYSEXIT, callno, err);
 	
 	/*
 	 * Now, advance the program counter, to avoid restarting
@@ -190,7 +731,10 @@ enter_forked_process(void *data1, unsigned long data2)
 {
 	struct trapframe *tf = (struct trapframe *)data1;
 	struct trapframe curTf = *tf;
-	(void)data2;
+	/* sys_fork allocated this copy for us; it lives on our stack now */
+	kfree(tf);
+	/* same thread id (and so user stack) as the thread that forked */
+	curthread->t_utid = (int)data2;
 	curTf.tf_v0 = 0;
 	curTf.tf_a3 = 0;
 
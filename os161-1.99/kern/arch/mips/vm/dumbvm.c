@@ -34,11 +34,16 @@
 #include <spinlock.h>
 #include <proc.h>
 #include <current.h>
+#include <cpu.h>
 #include <mips/tlb.h>
 #include <addrspace.h>
 #include <vm.h>
+#include <trace.h>
 #include <opt-A3.h>
+#include <opt-A2.h>
 #include <sfs.h>
+#include <uw-vmstats.h>
+#include <platform/maxcpus.h>
 
 
 /*
@@ -49,7 +54,42 @@
 /* under dumbvm, always have 48k of user stack */
 #define DUMBVM_STACKPAGES    12
 
+#if OPT_A2
+/*
+ * Extra user thread stacks are 16k each, stacked downwards below the
+ * main stack: slot N occupies the DUMBVM_TSTACKPAGES pages ending at
+ * DUMBVM_TSTACKTOP(N).
+ */
+#define DUMBVM_TSTACKPAGES   4
+#define DUMBVM_TSTACKTOP(n) \
+	(USERSTACK - DUMBVM_STACKPAGES * PAGE_SIZE - \
+	 ((n) - 1) * DUMBVM_TSTACKPAGES * PAGE_SIZE)
+#define DUMBVM_TSTACKBOTTOM \
+	DUMBVM_TSTACKTOP(AS_MAXTHREADS)
+#endif
+
+
+
+/*
+ * Page tables for the fast UTLB refill in exception-mips1.S.
+ *
+ * Two levels: a one-page directory of PT_NENTRIES kseg0 pointers to
+ * leaf tables, each a page of PT_NENTRIES TLB entrylo values covering
+ * 4M of address space. A zero pointer or entry means nothing is
+ * mapped there. Every page of a dumbvm address space is entered as
+ * soon as it is allocated, so the refill code finds all valid
+ * addresses and vm_fault only sees bad ones. The assembly code knows
+ * this layout; keep them in sync.
+ */
+#define PT_NENTRIES	1024
+#define PT_DIRINDEX(va)	((va) >> 22)
+#define PT_LEAFINDEX(va) (((va) >> 12) & (PT_NENTRIES - 1))
 
+/* page directory of the address space active on each cpu, or 0 */
+vaddr_t mips_utlb_ptab[MAXCPUS];
+
+/* TLB refills done by the fast path, per cpu */
+uint32_t mips_utlb_reloads[MAXCPUS];
 
 struct coremap_entry
 {
@@ -180,6 +220,115 @@ free_kpages(vaddr_t addr)
 	free_pages_helper(paddr);
 }
 
+/*
+ * Enter NPAGES pages at VADDR, backed by the contiguous physical
+ * pages at PADDR, in the page table of AS.
+ */
+static
+int
+pt_map(struct addrspace *as, vaddr_t vaddr, paddr_t paddr, unsigned npages)
+{
+	uint32_t *dir = (uint32_t *)as->as_ptab;
+	uint32_t *leaf;
+	vaddr_t kva;
+	unsigned i;
+
+	for (i=0; i<npages; i++, vaddr += PAGE_SIZE, paddr += PAGE_SIZE) {
+		leaf = (uint32_t *)dir[PT_DIRINDEX(vaddr)];
+		if (leaf == NULL) {
+			kva = alloc_kpages(1);
+			if (kva == 0) {
+				return ENOMEM;
+			}
+			bzero((void *)kva, PAGE_SIZE);
+			dir[PT_DIRINDEX(vaddr)] = kva;
+			leaf = (uint32_t *)kva;
+		}
+		leaf[PT_LEAFINDEX(vaddr)] = paddr | TLBLO_DIRTY | TLBLO_VALID;
+	}
+	return 0;
+}
+
+/*
+ * Make NPAGES already-mapped pages at VADDR read-only.
+ */
+static
+void
+pt_protect(struct addrspace *as, vaddr_t vaddr, unsigned npages)
+{
+	uint32_t *dir = (uint32_t *)as->as_ptab;
+	uint32_t *leaf;
+	unsigned i;
+
+	for (i=0; i<npages; i++, vaddr += PAGE_SIZE) {
+		leaf = (uint32_t *)dir[PT_DIRINDEX(vaddr)];
+		KASSERT(leaf != NULL);
+		leaf[PT_LEAFINDEX(vaddr)] &= ~TLBLO_DIRTY;
+	}
+}
+
+static
+void
+pt_destroy(struct addrspace *as)
+{
+	uint32_t *dir = (uint32_t *)as->as_ptab;
+	unsigned i;
+
+	if (mips_utlb_ptab[curcpu->c_number] == as->as_ptab) {
+		as_deactivate();
+	}
+	for (i=0; i<PT_NENTRIES; i++) {
+		if (dir[i] != 0) {
+			free_kpages(dir[i]);
+		}
+	}
+	free_kpages(as->as_ptab);
+	as->as_ptab = 0;
+}
+
+/*
+ * Fast-path TLB refills so far, for VMSTAT_TLB_RELOAD.
+ */
+unsigned
+vm_fastreloads(void)
+{
+	unsigned i, total = 0;
+
+	for (i=0; i<MAXCPUS; i++) {
+		total += mips_utlb_reloads[i];
+	}
+	return total;
+}
+
+/*
+ * Physical address of the user page at VADDR in AS, which must be
+ * page-aligned. Used by pipes to hand pages from a writer straight
+ * to a reader, and by I/O rings to reach buffers from a kernel
+ * thread; FORWRITE refuses read-only (text) pages.
+ */
+int
+vm_translate(struct addrspace *as, vaddr_t vaddr, bool forwrite,
+	     paddr_t *ret)
+{
+	uint32_t *dir = (uint32_t *)as->as_ptab;
+	uint32_t *leaf;
+
+	KASSERT((vaddr & PAGE_FRAME) == vaddr);
+
+	if (vaddr >= USERSPACETOP) {
+		return EFAULT;
+	}
+	leaf = (uint32_t *)dir[PT_DIRINDEX(vaddr)];
+	if (leaf == NULL || leaf[PT_LEAFINDEX(vaddr)] == 0) {
+		return EFAULT;
+	}
+	if (forwrite && (leaf[PT_LEAFINDEX(vaddr)] & TLBLO_DIRTY) == 0) {
+		return EFAULT;
+	}
+	*ret = leaf[PT_LEAFINDEX(vaddr)] & TLBLO_PPAGE;
+	return 0;
+}
+
 void
 vm_tlbshootdown_all(void)
 {
@@ -206,6 +355,7 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 	faultaddress &= PAGE_FRAME;
 
 	DEBUG(DB_VM, "dumbvm: fault: 0x%x\n", faultaddress);
+	TRACE(TRC_FAULT, TE_FAULT, faulttype, faultaddress);
 
 	switch (faulttype) {
 	    case VM_FAULT_READONLY:
@@ -260,6 +410,12 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 	stackbase = USERSTACK - DUMBVM_STACKPAGES * PAGE_SIZE;
 	stacktop = USERSTACK;
 
+	/*
+	 * Valid addresses are normally refilled by the fast path in
+	 * exception-mips1.S without coming here, but TLB misses from
+	 * the general exception vector (kernel-mode misses and the
+	 * like) still arrive, so keep doing the lookup.
+	 */
 	if (faultaddress >= vbase1 && faultaddress < vtop1) {
 		paddr = (faultaddress - vbase1) + as->as_pbase1;
 	}
@@ -269,6 +425,19 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 	else if (faultaddress >= stackbase && faultaddress < stacktop) {
 		paddr = (faultaddress - stackbase) + as->as_stackpbase;
 	}
+#if OPT_A2
+	else if (faultaddress >= DUMBVM_TSTACKBOTTOM && faultaddress < stackbase) {
+		int slot = 1 + (stackbase - 1 - faultaddress) /
+			(DUMBVM_TSTACKPAGES * PAGE_SIZE);
+		vaddr_t tbase = DUMBVM_TSTACKTOP(slot) -
+			DUMBVM_TSTACKPAGES * PAGE_SIZE;
+
+		if (as->as_tstackpbase[slot] == 0) {
+			return EFAULT;
+		}
+		paddr = (faultaddress - tbase) + as->as_tstackpbase[slot];
+	}
+#endif
 	else {
 		kprintf("fault address out of bounds \n");
 		return EFAULT;
@@ -331,6 +500,20 @@ as_create(void)
 	as->as_pbase2 = 0;
 	as->as_npages2 = 0;
 	as->as_stackpbase = 0;
+	as->text_seg_loaded = false;
+
+	as->as_ptab = alloc_kpages(1);
+	if (as->as_ptab == 0) {
+		kfree(as);
+		return NULL;
+	}
+	bzero((void *)as->as_ptab, PAGE_SIZE);
+#if OPT_A2
+	for (int i = 0; i < AS_MAXTHREADS; i++) {
+		as->as_tstackpbase[i] = 0;
+	}
+	as->as_tstackused = 0;
+#endif
 	return as;
 }
 
@@ -342,6 +525,14 @@ as_destroy(struct addrspace *as)
 	free_pages_helper(as->as_pbase2);
 	//kprintf("freeing as_stackpbase \n");
 	free_pages_helper(as->as_stackpbase);
+#if OPT_A2
+	for (int i = 1; i < AS_MAXTHREADS; i++) {
+		if (as->as_tstackpbase[i] != 0) {
+			free_pages_helper(as->as_tstackpbase[i]);
+		}
+	}
+#endif
+	pt_destroy(as);
 	kfree(as);
 }
 
@@ -356,12 +547,15 @@ as_activate(void)
         /* Kernel threads don't have an address spaces to activate */
 #endif
 	if (as == NULL) {
+		/* don't leave the refill code pointing at a dead table */
+		mips_utlb_ptab[curcpu->c_number] = 0;
 		return;
 	}
 
 	/* Disable interrupts on this CPU while frobbing the TLB. */
 	spl = splhigh();
 
+	mips_utlb_ptab[curcpu->c_number] = as->as_ptab;
 	for (i=0; i<NUM_TLB; i++) {
 		tlb_write(TLBHI_INVALID(i), TLBLO_INVALID(), i);
 	}
@@ -372,7 +566,12 @@ as_activate(void)
 void
 as_deactivate(void)
 {
-	/* nothing */
+	int spl;
+
+	/* the address space may be destroyed next; stop using its table */
+	spl = splhigh();
+	mips_utlb_ptab[curcpu->c_number] = 0;
+	splx(spl);
 }
 
 int
@@ -450,13 +649,25 @@ as_prepare_load(struct addrspace *as)
 	as_zero_region(as->as_pbase2, as->as_npages2);
 	as_zero_region(as->as_stackpbase, DUMBVM_STACKPAGES);
 
+	if (pt_map(as, as->as_vbase1, as->as_pbase1, as->as_npages1) ||
+	    pt_map(as, as->as_vbase2, as->as_pbase2, as->as_npages2) ||
+	    pt_map(as, USERSTACK - DUMBVM_STACKPAGES * PAGE_SIZE,
+		   as->as_stackpbase, DUMBVM_STACKPAGES)) {
+		return ENOMEM;
+	}
+
 	return 0;
 }
 
 int
 as_complete_load(struct addrspace *as)
 {
+#if OPT_A3
+	/* the text segment is read-only once loaded; see vm_fault */
+	pt_protect(as, as->as_vbase1, as->as_npages1);
+#else
 	(void)as;
+#endif
 	return 0;
 }
 
@@ -469,6 +680,41 @@ as_define_stack(struct addrspace *as, vaddr_t *stackptr)
 	return 0;
 }
 
+#if OPT_A2
+int
+as_define_thread_stack(struct addrspace *as, int slot, vaddr_t *stackptr)
+{
+	KASSERT(slot > 0 && slot < AS_MAXTHREADS);
+	KASSERT((as->as_tstackused & (1U << slot)) == 0);
+
+	/* reuse the pages of an earlier thread if there are some */
+	if (as->as_tstackpbase[slot] == 0) {
+		as->as_tstackpbase[slot] = getppages(DUMBVM_TSTACKPAGES);
+		if (as->as_tstackpbase[slot] == 0) {
+			return ENOMEM;
+		}
+		as_zero_region(as->as_tstackpbase[slot], DUMBVM_TSTACKPAGES);
+		if (pt_map(as, DUMBVM_TSTACKTOP(slot) -
+			   DUMBVM_TSTACKPAGES * PAGE_SIZE,
+			   as->as_tstackpbase[slot], DUMBVM_TSTACKPAGES)) {
+			return ENOMEM;
+		}
+	}
+	as->as_tstackused |= 1U << slot;
+	*stackptr = DUMBVM_TSTACKTOP(slot);
+	return 0;
+}
+
+void
+as_release_thread_stack(struct addrspace *as, int slot)
+{
+	KASSERT(slot > 0 && slot < AS_MAXTHREADS);
+	KASSERT(as->as_tstackused & (1U << slot));
+
+	as->as_tstackused &= ~(1U << slot);
+}
+#endif
+
 int
 as_copy(struct addrspace *old, struct addrspace **ret)
 {
@@ -506,6 +752,40 @@ as_copy(struct addrspace *old, struct addrspace **ret)
 	memmove((void *)PADDR_TO_KVADDR(new->as_stackpbase),
 		(const void *)PADDR_TO_KVADDR(old->as_stackpbase),
 		DUMBVM_STACKPAGES*PAGE_SIZE);
+
+#if OPT_A2
+	/*
+	 * The forking thread may be running on one of the extra thread
+	 * stacks, so copy all of them. Only the forking thread exists in
+	 * the child, so none are marked in use there.
+	 */
+	for (int i = 1; i < AS_MAXTHREADS; i++) {
+		if (old->as_tstackpbase[i] == 0) {
+			continue;
+		}
+		new->as_tstackpbase[i] = getppages(DUMBVM_TSTACKPAGES);
+		if (new->as_tstackpbase[i] == 0) {
+			as_destroy(new);
+			return ENOMEM;
+		}
+		memmove((void *)PADDR_TO_KVADDR(new->as_tstackpbase[i]),
+			(const void *)PADDR_TO_KVADDR(old->as_tstackpbase[i]),
+			DUMBVM_TSTACKPAGES*PAGE_SIZE);
+		if (pt_map(new, DUMBVM_TSTACKTOP(i) -
+			   DUMBVM_TSTACKPAGES * PAGE_SIZE,
+			   new->as_tstackpbase[i], DUMBVM_TSTACKPAGES)) {
+			as_destroy(new);
+			return ENOMEM;
+		}
+	}
+#endif
+
+	new->text_seg_loaded = old->text_seg_loaded;
+#if OPT_A3
+	if (new->text_seg_loaded) {
+		pt_protect(new, new->as_vbase1, new->as_npages1);
+	}
+#endif
 	
 	*ret = new;
 	return 0;
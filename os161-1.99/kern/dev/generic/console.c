@@ -48,15 +48,24 @@
  *
  * Note that we have no input buffering; characters typed too rapidly
  * will be lost.
+ *
+ * Output, on the other hand, is buffered: putch and writes to con:
+ * put characters in the output ring (cs_outbuf) and return, and the
+ * device's write-done interrupt sends the next one. A writer only
+ * waits when the ring is full. Polled output (from interrupt handlers
+ * or with interrupts off, e.g. panic) first sends whatever is in the
+ * ring, so that output still comes out in order.
  */
 
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/poll.h>
 #include <lib.h>
 #include <uio.h>
 #include <thread.h>
 #include <current.h>
 #include <synch.h>
+#include <wchan.h>
 #include <generic/console.h>
 #include <vfs.h>
 #include <device.h>
@@ -111,6 +120,36 @@ flush_delay_buf(void)
 
 //////////////////////////////////////////////////
 
+#define OUTMASK (CONSOLE_OUTPUT_BUFFER_SIZE - 1)
+
+/*
+ * Send everything in the output ring by polling.
+ */
+static
+void
+con_drain_polled(struct con_softc *cs)
+{
+	char ch;
+
+	if (spinlock_do_i_hold(&cs->cs_outlock)) {
+		/* we're in the middle of queueing (panic?); don't deadlock */
+		return;
+	}
+
+	spinlock_acquire(&cs->cs_outlock);
+	while (cs->cs_outhead != cs->cs_outtail) {
+		ch = cs->cs_outbuf[cs->cs_outtail & OUTMASK];
+		cs->cs_outtail++;
+		/* this waits for any character already being sent */
+		cs->cs_sendpolled(cs->cs_devdata, ch);
+	}
+	if (cs->cs_outwaiters > 0) {
+		wchan_wakeall(cs->cs_outwchan);
+	}
+	pollq_wakeup(&cs->cs_pollq);
+	spinlock_release(&cs->cs_outlock);
+}
+
 /*
  * Print a character, using polling instead of interrupts to wait for
  * I/O completion.
@@ -119,6 +158,7 @@ static
 void
 putch_polled(struct con_softc *cs, int ch)
 {
+	con_drain_polled(cs);
 	cs->cs_sendpolled(cs->cs_devdata, ch);
 }
 
@@ -143,16 +183,67 @@ putch_complete_polled(struct con_softc *cs)
 //////////////////////////////////////////////////
 
 /*
- * Print a character, using interrupts to wait for I/O completion.
+ * If the device is idle, start sending the next character in the
+ * output ring. Caller holds cs_outlock.
  */
 static
 void
-putch_intr(struct con_softc *cs, int ch)
+con_kick(struct con_softc *cs)
 {
-	P(cs->cs_wsem);
+	char ch;
+
+	KASSERT(spinlock_do_i_hold(&cs->cs_outlock));
+
+	if (cs->cs_outbusy || cs->cs_outhead == cs->cs_outtail) {
+		return;
+	}
+	ch = cs->cs_outbuf[cs->cs_outtail & OUTMASK];
+	cs->cs_outtail++;
+	cs->cs_outbusy = true;
 	cs->cs_send(cs->cs_devdata, ch);
 }
 
+/*
+ * Put LEN characters in the output ring, waiting for space only if
+ * it fills up.
+ */
+static
+void
+con_put(struct con_softc *cs, const char *buf, size_t len)
+{
+	size_t i;
+
+	spinlock_acquire(&cs->cs_outlock);
+	for (i=0; i<len; i++) {
+		while (cs->cs_outhead - cs->cs_outtail ==
+		       CONSOLE_OUTPUT_BUFFER_SIZE) {
+			con_kick(cs);
+			cs->cs_outwaiters++;
+			wchan_lock(cs->cs_outwchan);
+			spinlock_release(&cs->cs_outlock);
+			wchan_sleep(cs->cs_outwchan);
+			spinlock_acquire(&cs->cs_outlock);
+			cs->cs_outwaiters--;
+		}
+		cs->cs_outbuf[cs->cs_outhead & OUTMASK] = buf[i];
+		cs->cs_outhead++;
+	}
+	con_kick(cs);
+	spinlock_release(&cs->cs_outlock);
+}
+
+/*
+ * Print a character, using interrupts to drain the output.
+ */
+static
+void
+putch_intr(struct con_softc *cs, int ch)
+{
+	char c = ch;
+
+	con_put(cs, &c, 1);
+}
+
 /*
  * Read a character, using interrupts to wait for I/O completion.
  */
@@ -194,17 +285,35 @@ con_input(void *vcs, int ch)
 	cs->cs_gotchars_head = nexthead;
 		
 	V(cs->cs_rsem);
+	if (ch == '\r' || ch == '\n' ||
+	    (nexthead + 1) % CONSOLE_INPUT_BUFFER_SIZE == cs->cs_gotchars_tail) {
+		/* a read won't block now; see con_poll */
+		pollq_wakeup(&cs->cs_pollq);
+	}
 }
 
 /*
- * Called from underlying device when a write-done interrupt occurs.
+ * Called from underlying device when a write-done interrupt occurs:
+ * send the next buffered character. Waiting writers are woken once
+ * half the ring is free, rather than for every character.
  */
 void
 con_start(void *vcs)
 {
 	struct con_softc *cs = vcs;
 
-	V(cs->cs_wsem);
+	spinlock_acquire(&cs->cs_outlock);
+	cs->cs_outbusy = false;
+	con_kick(cs);
+	if (cs->cs_outwaiters > 0 &&
+	    cs->cs_outhead - cs->cs_outtail <= CONSOLE_OUTPUT_BUFFER_SIZE/2) {
+		wchan_wakeall(cs->cs_outwchan);
+	}
+	if (cs->cs_outhead - cs->cs_outtail == CONSOLE_OUTPUT_BUFFER_SIZE/2) {
+		/* just became writable; see con_poll */
+		pollq_wakeup(&cs->cs_pollq);
+	}
+	spinlock_release(&cs->cs_outlock);
 }
 
 //////////////////////////////////////////////////
@@ -298,6 +407,9 @@ con_close(struct device *dev)
 	return 0;
 }
 
+/* Writes are copied in this much at a time. */
+#define CON_WCHUNK 128
+
 static
 int
 con_io(struct device *dev, struct uio *uio)
@@ -305,8 +417,9 @@ con_io(struct device *dev, struct uio *uio)
 	int result;
 	char ch;
 	struct lock *lk;
-
-	(void)dev;  // unused
+	struct con_softc *cs = dev->d_data;
+	char inbuf[CON_WCHUNK], outbuf[2*CON_WCHUNK];
+	size_t i, n, m;
 
 	if (uio->uio_rw==UIO_READ) {
 		lk = con_userlock_read;
@@ -334,15 +447,20 @@ con_io(struct device *dev, struct uio *uio)
 			}
 		}
 		else {
-			result = uiomove(&ch, 1, uio);
+			n = uio->uio_resid < CON_WCHUNK ?
+				uio->uio_resid : CON_WCHUNK;
+			result = uiomove(inbuf, n, uio);
 			if (result) {
 				lock_release(lk);
 				return result;
 			}
-			if (ch=='\n') {
-				putch('\r');
+			for (i=m=0; i<n; i++) {
+				if (inbuf[i]=='\n') {
+					outbuf[m++] = '\r';
+				}
+				outbuf[m++] = inbuf[i];
 			}
-			putch(ch);
+			con_put(cs, outbuf, m);
 		}
 	}
 	lock_release(lk);
@@ -360,6 +478,48 @@ con_ioctl(struct device *dev, int op, userptr_t data)
 	return EINVAL;
 }
 
+/*
+ * A read of con: waits for a whole line, so it's only readable once
+ * a newline has come in, or the input buffer is full. It's writable
+ * when at least half the output ring is free, the point at which
+ * con_start wakes blocked writers.
+ */
+static
+int
+con_poll(struct device *dev, int events, struct pollset *ps, int *revents)
+{
+	struct con_softc *cs = dev->d_data;
+	unsigned i, head, tail;
+	int ready = 0;
+
+	pollq_register(&cs->cs_pollq, ps);
+
+	if (events & POLLIN) {
+		head = cs->cs_gotchars_head;
+		tail = cs->cs_gotchars_tail;
+		if ((head + 1) % CONSOLE_INPUT_BUFFER_SIZE == tail) {
+			ready |= POLLIN;
+		}
+		for (i = tail; i != head; i = (i + 1) % CONSOLE_INPUT_BUFFER_SIZE) {
+			if (cs->cs_gotchars[i] == '\r' ||
+			    cs->cs_gotchars[i] == '\n') {
+				ready |= POLLIN;
+				break;
+			}
+		}
+	}
+	if (events & POLLOUT) {
+		spinlock_acquire(&cs->cs_outlock);
+		if (cs->cs_outhead - cs->cs_outtail <=
+		    CONSOLE_OUTPUT_BUFFER_SIZE/2) {
+			ready |= POLLOUT;
+		}
+		spinlock_release(&cs->cs_outlock);
+	}
+	*revents = ready;
+	return 0;
+}
+
 static
 int
 attach_console_to_vfs(struct con_softc *cs)
@@ -376,6 +536,7 @@ attach_console_to_vfs(struct con_softc *cs)
 	dev->d_close = con_close;
 	dev->d_io = con_io;
 	dev->d_ioctl = con_ioctl;
+	dev->d_poll = con_poll;
 	dev->d_blocks = 0;
 	dev->d_blocksize = 1;
 	dev->d_data = cs;
@@ -398,7 +559,8 @@ attach_console_to_vfs(struct con_softc *cs)
 int
 config_con(struct con_softc *cs, int unit)
 {
-	struct semaphore *rsem, *wsem;
+	struct semaphore *rsem;
+	struct wchan *outwchan;
 	struct lock *rlk, *wlk;
 
 	/*
@@ -418,30 +580,37 @@ config_con(struct con_softc *cs, int unit)
 	if (rsem == NULL) {
 		return ENOMEM;
 	}
-	wsem = sem_create("console write", 1);
-	if (wsem == NULL) {
+	outwchan = wchan_create("console write");
+	if (outwchan == NULL) {
 		sem_destroy(rsem);
 		return ENOMEM;
 	}
 	rlk = lock_create("console-lock-read");
 	if (rlk == NULL) {
 		sem_destroy(rsem);
-		sem_destroy(wsem);
+		wchan_destroy(outwchan);
 		return ENOMEM;
 	}
 	wlk = lock_create("console-lock-write");
 	if (wlk == NULL) {
 		lock_destroy(rlk);
 		sem_destroy(rsem);
-		sem_destroy(wsem);
+		wchan_destroy(outwchan);
 		return ENOMEM;
 	}
 
 	cs->cs_rsem = rsem; 
-	cs->cs_wsem = wsem; 
 	cs->cs_gotchars_head = 0;
 	cs->cs_gotchars_tail = 0;
 
+	spinlock_init(&cs->cs_outlock);
+	cs->cs_outwchan = outwchan;
+	cs->cs_outwaiters = 0;
+	cs->cs_outbusy = false;
+	cs->cs_outhead = 0;
+	cs->cs_outtail = 0;
+	pollq_init(&cs->cs_pollq);
+
 	the_console = cs;
 	con_userlock_read = rlk;
 	con_userlock_write = wlk;
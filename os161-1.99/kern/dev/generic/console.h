@@ -30,14 +30,22 @@
 #ifndef _GENERIC_CONSOLE_H_
 #define _GENERIC_CONSOLE_H_
 
+#include <spinlock.h>
+#include <pollq.h>
+
 /*
  * Device data for the hardware-independent system console.
  *
  * devdata, send, and sendpolled are provided by the underlying
  * device, and are to be initialized by the attach routine.
+ *
+ * Output is buffered in a ring that the device's write-done
+ * interrupt drains (see con_start); writers only wait when it is
+ * full. The ring size must be a power of two.
  */
 
 #define CONSOLE_INPUT_BUFFER_SIZE 32
+#define CONSOLE_OUTPUT_BUFFER_SIZE 1024
 
 struct con_softc {
 	/* initialized by attach routine */
@@ -49,10 +57,19 @@ struct con_softc {
 
 	/* initialized by config routine */
 	struct semaphore *cs_rsem;
-	struct semaphore *cs_wsem;
 	unsigned char cs_gotchars[CONSOLE_INPUT_BUFFER_SIZE];
 	unsigned cs_gotchars_head;	/* next slot to put a char in */
 	unsigned cs_gotchars_tail;	/* next slot to take a char out */
+
+	struct spinlock cs_outlock;	/* protects the output fields */
+	struct wchan *cs_outwchan;	/* writers wait here for space */
+	unsigned cs_outwaiters;		/* ...this many of them */
+	bool cs_outbusy;		/* device is sending a char */
+	unsigned cs_outhead;		/* total chars put in */
+	unsigned cs_outtail;		/* total chars taken out */
+	char cs_outbuf[CONSOLE_OUTPUT_BUFFER_SIZE];
+
+	struct pollq cs_pollq;		/* poll()ers of con: wait here */
 };
 
 /*
@@ -43,6 +43,7 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <kern/fcntl.h>
+#include <kern/poll.h>
 #include <stat.h>
 #include <lib.h>
 #include <array.h>
@@ -611,6 +612,29 @@ emufs_write(struct vnode *v, struct uio *uio)
 	return 0;
 }
 
+/*
+ * VOP_COPYFROM
+ */
+static
+int
+emufs_copyfrom(struct vnode *v, off_t pos, struct vnode *src, off_t srcpos,
+	       size_t len, size_t *copied)
+{
+	/*
+	 * The emulator has no way to copy between files, so the
+	 * caller has to read and write.
+	 */
+
+	(void)v;
+	(void)pos;
+	(void)src;
+	(void)srcpos;
+	(void)len;
+
+	*copied = 0;
+	return EXDEV;
+}
+
 /*
  * VOP_IOCTL
  */
@@ -629,6 +653,24 @@ emufs_ioctl(struct vnode *v, int op, userptr_t data)
 	return EINVAL;
 }
 
+/*
+ * VOP_POLL
+ */
+static
+int
+emufs_poll(struct vnode *v, int events, struct pollset *ps, int *revents)
+{
+	/*
+	 * Host files never block (for long), so always ready.
+	 */
+
+	(void)v;
+	(void)ps;
+
+	*revents = events & (POLLIN | POLLOUT);
+	return 0;
+}
+
 /*
  * VOP_STAT
  */
@@ -1068,6 +1110,20 @@ emufs_truncate_isdir(struct vnode *v, off_t len)
 	return ENOTDIR;
 }
 
+static
+int
+emufs_copyfrom_isdir(struct vnode *v, off_t pos, struct vnode *src,
+		     off_t srcpos, size_t len, size_t *copied)
+{
+	(void)v;
+	(void)pos;
+	(void)src;
+	(void)srcpos;
+	(void)len;
+	(void)copied;
+	return EISDIR;
+}
+
 //////////////////////////////
 
 /*
@@ -1084,7 +1140,9 @@ static const struct vnode_ops emufs_fileops = {
 	emufs_readlink_notlink,
 	emufs_uio_op_notdir, /* getdirentry */
 	emufs_write,
+	emufs_copyfrom,
 	emufs_ioctl,
+	emufs_poll,
 	emufs_stat,
 	emufs_file_gettype,
 	emufs_tryseek,
@@ -1119,7 +1177,9 @@ static const struct vnode_ops emufs_dirops = {
 	emufs_uio_op_isdir,   /* readlink */
 	emufs_getdirentry,
 	emufs_uio_op_isdir,   /* write */
+	emufs_copyfrom_isdir,
 	emufs_ioctl,
+	emufs_poll,
 	emufs_stat,
 	emufs_dir_gettype,
 	emufs_dir_tryseek,
@@ -38,6 +38,7 @@
 #include <synch.h>
 #include <platform/bus.h>
 #include <vfs.h>
+#include <trace.h>
 #include <lamebus/lhd.h>
 #include "autoconf.h"
 
@@ -243,6 +244,9 @@ lhd_io(struct device *d, struct uio *uio)
 			}
 		}
 
+		TRACE(TRC_DISK, TE_DISKSTART, sector+i,
+		      uio->uio_rw == UIO_WRITE);
+
 		/* Tell it what sector we want... */
 		lhd_wreg(lh, LHD_REG_SECT, sector+i);
 
@@ -254,6 +258,7 @@ lhd_io(struct device *d, struct uio *uio)
 
 		/* Get the result value saved by the interrupt handler. */
 		result = lh->lh_result;
+		TRACE(TRC_DISK, TE_DISKDONE, sector+i, result);
 
 		/*
 		 * Are we reading? If so, and if we succeeded,
@@ -306,6 +311,7 @@ config_lhd(struct lhd_softc *lh, int lhdno)
 	lh->lh_dev.d_close = lhd_close;
 	lh->lh_dev.d_io = lhd_io;
 	lh->lh_dev.d_ioctl = lhd_ioctl;
+	lh->lh_dev.d_poll = NULL;
 	lh->lh_dev.d_blocks = bus_read_register(lh->lh_busdata, lh->lh_buspos,
 						LHD_REG_NSECT);
 	lh->lh_dev.d_blocksize = LHD_SECTSIZE;
@@ -38,6 +38,9 @@
 #define LTRACE_REG_TROFF   4
 #define LTRACE_REG_DEBUG   8
 #define LTRACE_REG_DUMP    12
+#define LTRACE_REG_STOP    16
+#define LTRACE_REG_PROFEN  20
+#define LTRACE_REG_PROFCL  24
 
 static struct ltrace_softc *the_trace;
 
@@ -77,6 +80,51 @@ ltrace_dump(uint32_t code)
 	}
 }
 
+void
+ltrace_stop(uint32_t code)
+{
+	if (the_trace != NULL) {
+		bus_write_register(the_trace->lt_busdata, the_trace->lt_buspos,
+				   LTRACE_REG_STOP, code);
+	}
+}
+
+void
+ltrace_setprof(uint32_t onoff)
+{
+	if (the_trace != NULL) {
+		bus_write_register(the_trace->lt_busdata, the_trace->lt_buspos,
+				   LTRACE_REG_PROFEN, onoff);
+	}
+}
+
+void
+ltrace_eraseprof(void)
+{
+	if (the_trace != NULL) {
+		bus_write_register(the_trace->lt_busdata, the_trace->lt_buspos,
+				   LTRACE_REG_PROFCL, 1);
+	}
+}
+
+/*
+ * The debug marker goes outside the profiled part, so the region's
+ * profile holds only the code between the two calls.
+ */
+void
+ltrace_region_begin(uint32_t code)
+{
+	ltrace_debug(code);
+	ltrace_setprof(1);
+}
+
+void
+ltrace_region_end(uint32_t code)
+{
+	ltrace_setprof(0);
+	ltrace_debug(code);
+}
+
 int
 config_ltrace(struct ltrace_softc *sc, int ltraceno)
 {
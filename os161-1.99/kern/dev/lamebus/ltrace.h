@@ -42,6 +42,13 @@ struct ltrace_softc {
  *   ltrace_off:   turns off the trace161 tracing flag CODE.
  *   ltrace_debug: causes sys161/trace161 to print a message with CODE.
  *   ltrace_dump:  causes trace161 to do a complete state dump, tagged CODE.
+ *   ltrace_stop:  causes sys161/trace161 to stop and wait for the
+ *                 debugger, tagged CODE.
+ *   ltrace_setprof:   turns trace161's profiling on (nonzero) or off.
+ *   ltrace_eraseprof: discards the profile collected so far.
+ *   ltrace_region_begin/end: bracket a region of interest, emitting
+ *                 debug marker CODE on each side and profiling only
+ *                 in between.
  *
  * The flags for ltrace_on/off are the characters used to control
  * tracing on the trace161 command line. See the System/161 manual for
@@ -58,10 +65,21 @@ struct ltrace_softc {
  * ltrace_dump dumps the entire system state and is primarily intended
  * for regression testing of System/161. It might or might not prove
  * useful for debugging as well.
+ *
+ * The stop and profiling controls need System/161 2.x; older versions
+ * ignore them. trace161 writes the profile out when it exits.
+ *
+ * User programs get at the same controls through the ltrace() system
+ * call; see <kern/ltrace.h>.
  */
 void ltrace_on(uint32_t code);
 void ltrace_off(uint32_t code);
 void ltrace_debug(uint32_t code);
 void ltrace_dump(uint32_t code);
+void ltrace_stop(uint32_t code);
+void ltrace_setprof(uint32_t onoff);
+void ltrace_eraseprof(void);
+void ltrace_region_begin(uint32_t code);
+void ltrace_region_end(uint32_t code);
 
 #endif /* _LAMEBUS_LTRACE_H_ */
@@ -0,0 +1,633 @@
+/*
+ * SFS block buffer cache.
+ *
+ * Each mounted SFS has a fixed pool of SFS_NBUF block buffers, found
+ * by disk block number through a small hash table and recycled in
+ * least-recently-used order. Writes only dirty the buffer; dirty
+ * buffers go to disk when they're recycled or on sfs_buf_sync.
+ *
+ * Everything here runs under the vfs big lock, which is what keeps
+ * two threads from racing to load the same block. A buffer handed out
+ * by sfs_buf_read or sfs_buf_get is pinned (it won't be recycled)
+ * until sfs_buf_release.
+ *
+ * The superblock and free block bitmap are not cached; they live in
+ * struct sfs_fs and are written directly by sfs_sync.
+ *
+ * Read-ahead: sfs_buf_readahead queues a block to be read into the
+ * cache by a work item, which takes the big lock one block at a time
+ * so whoever asked can keep going in between. Blocks are queued by
+ * disk block number, so nothing here cares if the file they came from
+ * changes in the meantime; a block freed before it's read just sits
+ * in the cache until recycled.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <uio.h>
+#include <vfs.h>
+#include <workqueue.h>
+#include <sfs.h>
+
+/* Buffers per filesystem (64K of blocks). */
+#define SFS_NBUF	128
+
+/* Hash buckets; a power of two so sequential blocks spread out. */
+#define SFS_BUFHASH	64
+
+/* Block number of a buffer holding nothing. */
+#define SFS_NOBUF	((uint32_t)-1)
+
+/* Blocks that can be waiting to be read ahead. */
+#define SFS_RAQSIZE	64
+
+struct sfs_buf {
+	struct sfs_fs *b_fs;
+	uint32_t b_block;		/* disk block, or SFS_NOBUF */
+	void *b_data;			/* SFS_BLOCKSIZE bytes */
+	bool b_valid;			/* b_data holds the block */
+	bool b_dirty;			/* b_data is newer than the disk */
+	bool b_readahead;		/* read ahead, and not used since */
+	unsigned b_pins;		/* users between get/read and release */
+	struct sfs_buf *b_hashnext;	/* hash chain */
+	struct sfs_buf *b_lruprev;	/* LRU list; head is next to recycle */
+	struct sfs_buf *b_lrunext;
+};
+
+struct sfs_bufcache {
+	struct sfs_fs *bc_fs;
+	struct sfs_buf bc_bufs[SFS_NBUF];
+	struct sfs_buf *bc_hash[SFS_BUFHASH];
+	struct sfs_buf *bc_lruhead;
+	struct sfs_buf *bc_lrutail;
+
+	/* read-ahead queue */
+	uint32_t bc_raq[SFS_RAQSIZE];
+	unsigned bc_raqhead, bc_raqlen;
+	struct work bc_rawork;
+	bool bc_rascheduled;		/* bc_rawork queued or running */
+	bool bc_dead;			/* unmounted; bc_rawork frees us */
+};
+
+/* Counters for all filesystems; protected by the big lock. */
+static struct {
+	uint32_t reads;			/* sfs_buf_read calls */
+	uint32_t hits;			/* ...that found the block cached */
+	uint32_t ra_blocks;		/* blocks read ahead */
+	uint32_t ra_hits;		/* reads that found a read-ahead block */
+	uint32_t ra_misses;		/* reads that beat read-ahead to a block */
+	uint32_t ra_wasted;		/* read-ahead blocks recycled unread */
+} sfs_bufstats;
+
+////////////////////////////////////////////////////////////
+// lists
+
+static
+unsigned
+sfs_buf_hashval(uint32_t block)
+{
+	return block % SFS_BUFHASH;
+}
+
+static
+void
+sfs_buf_unhash(struct sfs_bufcache *bc, struct sfs_buf *b)
+{
+	struct sfs_buf **pp;
+
+	if (b->b_block == SFS_NOBUF) {
+		return;
+	}
+	pp = &bc->bc_hash[sfs_buf_hashval(b->b_block)];
+	while (*pp != b) {
+		KASSERT(*pp != NULL);
+		pp = &(*pp)->b_hashnext;
+	}
+	*pp = b->b_hashnext;
+	b->b_hashnext = NULL;
+	b->b_block = SFS_NOBUF;
+	b->b_valid = false;
+}
+
+static
+void
+sfs_buf_hash(struct sfs_bufcache *bc, struct sfs_buf *b, uint32_t block)
+{
+	unsigned hv = sfs_buf_hashval(block);
+
+	KASSERT(b->b_block == SFS_NOBUF);
+	b->b_block = block;
+	b->b_hashnext = bc->bc_hash[hv];
+	bc->bc_hash[hv] = b;
+}
+
+static
+void
+sfs_buf_lruremove(struct sfs_bufcache *bc, struct sfs_buf *b)
+{
+	if (b->b_lruprev != NULL) {
+		b->b_lruprev->b_lrunext = b->b_lrunext;
+	}
+	else {
+		bc->bc_lruhead = b->b_lrunext;
+	}
+	if (b->b_lrunext != NULL) {
+		b->b_lrunext->b_lruprev = b->b_lruprev;
+	}
+	else {
+		bc->bc_lrutail = b->b_lruprev;
+	}
+	b->b_lruprev = b->b_lrunext = NULL;
+}
+
+/* Put B at the recently-used end, or at the recycle end if ATHEAD. */
+static
+void
+sfs_buf_lruinsert(struct sfs_bufcache *bc, struct sfs_buf *b, bool athead)
+{
+	if (athead) {
+		b->b_lruprev = NULL;
+		b->b_lrunext = bc->bc_lruhead;
+		if (bc->bc_lruhead != NULL) {
+			bc->bc_lruhead->b_lruprev = b;
+		}
+		else {
+			bc->bc_lrutail = b;
+		}
+		bc->bc_lruhead = b;
+	}
+	else {
+		b->b_lrunext = NULL;
+		b->b_lruprev = bc->bc_lrutail;
+		if (bc->bc_lrutail != NULL) {
+			bc->bc_lrutail->b_lrunext = b;
+		}
+		else {
+			bc->bc_lruhead = b;
+		}
+		bc->bc_lrutail = b;
+	}
+}
+
+static
+struct sfs_buf *
+sfs_buf_lookup(struct sfs_bufcache *bc, uint32_t block)
+{
+	struct sfs_buf *b;
+
+	for (b = bc->bc_hash[sfs_buf_hashval(block)]; b != NULL;
+	     b = b->b_hashnext) {
+		if (b->b_block == block) {
+			return b;
+		}
+	}
+	return NULL;
+}
+
+////////////////////////////////////////////////////////////
+// disk I/O
+
+static
+int
+sfs_buf_writeout(struct sfs_buf *b)
+{
+	int result;
+
+	KASSERT(b->b_valid && b->b_dirty);
+	result = sfs_wblock(b->b_fs, b->b_data, b->b_block);
+	if (result) {
+		return result;
+	}
+	b->b_dirty = false;
+	return 0;
+}
+
+/*
+ * Find an unpinned buffer to reuse, starting with the least recently
+ * used, and write it out first if it's dirty.
+ */
+static
+int
+sfs_buf_recycle(struct sfs_bufcache *bc, struct sfs_buf **ret)
+{
+	struct sfs_buf *b;
+	int result;
+
+	for (b = bc->bc_lruhead; b != NULL; b = b->b_lrunext) {
+		if (b->b_pins == 0) {
+			break;
+		}
+	}
+	if (b == NULL) {
+		panic("sfs: all %u buffers are in use\n", SFS_NBUF);
+	}
+	if (b->b_readahead) {
+		sfs_bufstats.ra_wasted++;
+		b->b_readahead = false;
+	}
+
+	if (b->b_dirty) {
+		result = sfs_buf_writeout(b);
+		if (result) {
+			return result;
+		}
+	}
+	sfs_buf_unhash(bc, b);
+	*ret = b;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// read-ahead
+
+/* Is BLOCK waiting to be read ahead? */
+static
+bool
+sfs_buf_raqueued(struct sfs_bufcache *bc, uint32_t block)
+{
+	unsigned i;
+
+	for (i=0; i<bc->bc_raqlen; i++) {
+		if (bc->bc_raq[(bc->bc_raqhead + i) % SFS_RAQSIZE] == block) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * Read BLOCK into the cache, unless it's there already. Errors are
+ * ignored; whoever actually wants the block will see them.
+ */
+static
+void
+sfs_buf_fetch(struct sfs_bufcache *bc, uint32_t block)
+{
+	struct sfs_buf *b;
+
+	if (sfs_buf_lookup(bc, block) != NULL) {
+		return;
+	}
+	if (sfs_buf_recycle(bc, &b)) {
+		return;
+	}
+	sfs_buf_hash(bc, b, block);
+	sfs_buf_lruremove(bc, b);
+	if (sfs_rblock(bc->bc_fs, b->b_data, block)) {
+		sfs_buf_unhash(bc, b);
+		sfs_buf_lruinsert(bc, b, true);
+		return;
+	}
+	b->b_valid = true;
+	b->b_readahead = true;
+	sfs_buf_lruinsert(bc, b, false);
+	sfs_bufstats.ra_blocks++;
+}
+
+/*
+ * Work function: drain the read-ahead queue.
+ */
+static
+void
+sfs_buf_rawork(void *arg)
+{
+	struct sfs_bufcache *bc = arg;
+	uint32_t block;
+
+	vfs_biglock_acquire();
+	while (!bc->bc_dead && bc->bc_raqlen > 0) {
+		block = bc->bc_raq[bc->bc_raqhead];
+		bc->bc_raqhead = (bc->bc_raqhead + 1) % SFS_RAQSIZE;
+		bc->bc_raqlen--;
+		if (block == SFS_NOBUF) {
+			continue;
+		}
+		sfs_buf_fetch(bc, block);
+
+		/* let the reader have a turn */
+		vfs_biglock_release();
+		vfs_biglock_acquire();
+	}
+	bc->bc_rascheduled = false;
+	if (bc->bc_dead) {
+		kfree(bc);
+	}
+	vfs_biglock_release();
+}
+
+/*
+ * BLOCK has been read from the disk without going through the cache.
+ * If read-ahead hadn't got to it yet, it's too late now.
+ */
+void
+sfs_buf_readaround(struct sfs_fs *sfs, uint32_t block)
+{
+	struct sfs_bufcache *bc = sfs->sfs_bufcache;
+	unsigned i, ix;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	for (i=0; i<bc->bc_raqlen; i++) {
+		ix = (bc->bc_raqhead + i) % SFS_RAQSIZE;
+		if (bc->bc_raq[ix] == block) {
+			/* leave a hole for sfs_buf_rawork to skip */
+			bc->bc_raq[ix] = SFS_NOBUF;
+			sfs_bufstats.ra_misses++;
+			return;
+		}
+	}
+}
+
+/*
+ * Ask for BLOCK to be read into the cache in the background. If the
+ * queue is full the request is dropped; it's only a hint.
+ */
+void
+sfs_buf_readahead(struct sfs_fs *sfs, uint32_t block)
+{
+	struct sfs_bufcache *bc = sfs->sfs_bufcache;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	if (sfs_buf_lookup(bc, block) != NULL ||
+	    bc->bc_raqlen == SFS_RAQSIZE ||
+	    sfs_buf_raqueued(bc, block)) {
+		return;
+	}
+	bc->bc_raq[(bc->bc_raqhead + bc->bc_raqlen) % SFS_RAQSIZE] = block;
+	bc->bc_raqlen++;
+	if (!bc->bc_rascheduled) {
+		bc->bc_rascheduled = true;
+		work_enqueue(&bc->bc_rawork);
+	}
+}
+
+////////////////////////////////////////////////////////////
+// interface
+
+/*
+ * Get the buffer for BLOCK, pinned. Its contents are the block's if
+ * it was already cached; otherwise they're garbage and the caller
+ * must fill the whole block and call sfs_buf_dirty.
+ */
+int
+sfs_buf_get(struct sfs_fs *sfs, uint32_t block, struct sfs_buf **ret)
+{
+	struct sfs_bufcache *bc = sfs->sfs_bufcache;
+	struct sfs_buf *b;
+	int result;
+
+	KASSERT(vfs_biglock_do_i_hold());
+	KASSERT(block < sfs->sfs_super.sp_nblocks);
+
+	b = sfs_buf_lookup(bc, block);
+	if (b == NULL) {
+		result = sfs_buf_recycle(bc, &b);
+		if (result) {
+			return result;
+		}
+		sfs_buf_hash(bc, b, block);
+	}
+
+	b->b_pins++;
+	sfs_buf_lruremove(bc, b);
+	sfs_buf_lruinsert(bc, b, false);
+	*ret = b;
+	return 0;
+}
+
+/*
+ * Get the buffer for BLOCK, pinned, reading the block in if it
+ * wasn't cached.
+ */
+int
+sfs_buf_read(struct sfs_fs *sfs, uint32_t block, struct sfs_buf **ret)
+{
+	struct sfs_buf *b;
+	int result;
+
+	result = sfs_buf_get(sfs, block, &b);
+	if (result) {
+		return result;
+	}
+	sfs_bufstats.reads++;
+	if (b->b_valid) {
+		sfs_bufstats.hits++;
+		if (b->b_readahead) {
+			sfs_bufstats.ra_hits++;
+			b->b_readahead = false;
+		}
+	}
+	else {
+		if (sfs_buf_raqueued(sfs->sfs_bufcache, block)) {
+			sfs_bufstats.ra_misses++;
+		}
+		result = sfs_rblock(sfs, b->b_data, block);
+		if (result) {
+			sfs_buf_release(b);
+			return result;
+		}
+		b->b_valid = true;
+	}
+	*ret = b;
+	return 0;
+}
+
+void *
+sfs_buf_data(struct sfs_buf *b)
+{
+	return b->b_data;
+}
+
+bool
+sfs_buf_isvalid(struct sfs_buf *b)
+{
+	return b->b_valid;
+}
+
+/*
+ * The buffer's contents have been changed (or, for a buffer from
+ * sfs_buf_get, filled in) and need to reach the disk eventually.
+ */
+void
+sfs_buf_dirty(struct sfs_buf *b)
+{
+	KASSERT(b->b_pins > 0);
+	b->b_valid = true;
+	b->b_dirty = true;
+}
+
+/*
+ * Unpin a buffer. One that never got valid contents is forgotten and
+ * goes to the front of the line for reuse.
+ */
+void
+sfs_buf_release(struct sfs_buf *b)
+{
+	struct sfs_bufcache *bc = b->b_fs->sfs_bufcache;
+
+	KASSERT(vfs_biglock_do_i_hold());
+	KASSERT(b->b_pins > 0);
+	b->b_pins--;
+	if (b->b_pins == 0 && !b->b_valid) {
+		sfs_buf_unhash(bc, b);
+		sfs_buf_lruremove(bc, b);
+		sfs_buf_lruinsert(bc, b, true);
+	}
+}
+
+/*
+ * BLOCK has been freed: throw away any cached copy, dirty or not, so
+ * it isn't written over whatever the block is used for next.
+ */
+void
+sfs_buf_drop(struct sfs_fs *sfs, uint32_t block)
+{
+	struct sfs_bufcache *bc = sfs->sfs_bufcache;
+	struct sfs_buf *b;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	b = sfs_buf_lookup(bc, block);
+	if (b == NULL) {
+		return;
+	}
+	KASSERT(b->b_pins == 0);
+	b->b_dirty = false;
+	sfs_buf_unhash(bc, b);
+	sfs_buf_lruremove(bc, b);
+	sfs_buf_lruinsert(bc, b, true);
+}
+
+/*
+ * Is BLOCK in the cache? If so the cached copy is the one to use.
+ */
+bool
+sfs_buf_incache(struct sfs_fs *sfs, uint32_t block)
+{
+	KASSERT(vfs_biglock_do_i_hold());
+	return sfs_buf_lookup(sfs->sfs_bufcache, block) != NULL;
+}
+
+/*
+ * Write back every dirty buffer.
+ */
+int
+sfs_buf_sync(struct sfs_fs *sfs)
+{
+	struct sfs_bufcache *bc = sfs->sfs_bufcache;
+	struct sfs_buf *b;
+	unsigned i;
+	int result;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	for (i=0; i<SFS_NBUF; i++) {
+		b = &bc->bc_bufs[i];
+		if (b->b_dirty) {
+			result = sfs_buf_writeout(b);
+			if (result) {
+				return result;
+			}
+		}
+	}
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// setup and teardown
+
+int
+sfs_bufcache_create(struct sfs_fs *sfs)
+{
+	struct sfs_bufcache *bc;
+	struct sfs_buf *b;
+	unsigned i;
+
+	bc = kmalloc(sizeof(*bc));
+	if (bc == NULL) {
+		return ENOMEM;
+	}
+	bc->bc_fs = sfs;
+	for (i=0; i<SFS_BUFHASH; i++) {
+		bc->bc_hash[i] = NULL;
+	}
+	bc->bc_lruhead = bc->bc_lrutail = NULL;
+	bc->bc_raqhead = bc->bc_raqlen = 0;
+	work_init(&bc->bc_rawork, sfs_buf_rawork, bc);
+	bc->bc_rascheduled = false;
+	bc->bc_dead = false;
+
+	for (i=0; i<SFS_NBUF; i++) {
+		b = &bc->bc_bufs[i];
+		b->b_data = kmalloc(SFS_BLOCKSIZE);
+		if (b->b_data == NULL) {
+			while (i-- > 0) {
+				kfree(bc->bc_bufs[i].b_data);
+			}
+			kfree(bc);
+			return ENOMEM;
+		}
+		b->b_fs = sfs;
+		b->b_block = SFS_NOBUF;
+		b->b_valid = false;
+		b->b_dirty = false;
+		b->b_readahead = false;
+		b->b_pins = 0;
+		b->b_hashnext = NULL;
+		sfs_buf_lruinsert(bc, b, false);
+	}
+
+	sfs->sfs_bufcache = bc;
+	return 0;
+}
+
+/*
+ * Free the cache. It must already have been synced. If read-ahead
+ * work is still outstanding, it gets to free the rest.
+ */
+void
+sfs_bufcache_destroy(struct sfs_fs *sfs)
+{
+	struct sfs_bufcache *bc = sfs->sfs_bufcache;
+	unsigned i;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	for (i=0; i<SFS_NBUF; i++) {
+		KASSERT(bc->bc_bufs[i].b_pins == 0);
+		KASSERT(!bc->bc_bufs[i].b_dirty);
+		kfree(bc->bc_bufs[i].b_data);
+	}
+	sfs->sfs_bufcache = NULL;
+	if (bc->bc_rascheduled) {
+		bc->bc_dead = true;
+	}
+	else {
+		kfree(bc);
+	}
+}
+
+/*
+ * Print the cache and read-ahead counters.
+ */
+void
+sfs_bufstats_print(void)
+{
+	uint32_t reads, hits, ra_blocks, ra_hits, ra_misses, ra_wasted;
+
+	/* copy out so we don't kprintf with the big lock held */
+	vfs_biglock_acquire();
+	reads = sfs_bufstats.reads;
+	hits = sfs_bufstats.hits;
+	ra_blocks = sfs_bufstats.ra_blocks;
+	ra_hits = sfs_bufstats.ra_hits;
+	ra_misses = sfs_bufstats.ra_misses;
+	ra_wasted = sfs_bufstats.ra_wasted;
+	vfs_biglock_release();
+
+	kprintf("SFS buffer cache: %u reads, %u hits\n", reads, hits);
+	kprintf("  read-ahead: %u blocks, %u hits, %u misses, "
+		"%u wasted\n", ra_blocks, ra_hits, ra_misses, ra_wasted);
+}
@@ -35,6 +35,7 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <kern/fcntl.h>
+#include <kern/poll.h>
 #include <stat.h>
 #include <lib.h>
 #include <array.h>
@@ -45,6 +46,13 @@
 #include <device.h>
 #include <sfs.h>
 
+/* Read-ahead window limits, in blocks. */
+#define SFS_RAMIN 4
+#define SFS_RAMAX 32
+
+/* Most blocks sent to the device in one request by sfs_blockio. */
+#define SFS_MAXCLUSTER 64
+
 /* At bottom of file */
 static int sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int type,
 			 struct sfs_vnode **ret);
@@ -53,27 +61,41 @@ static int sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int type,
 //
 // Simple stuff
 
-/* Zero out a disk block. */
+/* Zero out a disk block. (In the buffer cache; no need to read it.) */
 static
 int
 sfs_clearblock(struct sfs_fs *sfs, uint32_t block)
 {
-	/* static -> automatically initialized to zero */
-	static char zeros[SFS_BLOCKSIZE];
-	return sfs_wblock(sfs, zeros, block);
+	struct sfs_buf *buf;
+	int result;
+
+	result = sfs_buf_get(sfs, block, &buf);
+	if (result) {
+		return result;
+	}
+	bzero(sfs_buf_data(buf), SFS_BLOCKSIZE);
+	sfs_buf_dirty(buf);
+	sfs_buf_release(buf);
+	return 0;
 }
 
-/* Write an on-disk inode structure back out to disk. */
+/* Write an on-disk inode structure back out (to the buffer cache). */
 static
 int
 sfs_sync_inode(struct sfs_vnode *sv)
 {
+	struct sfs_buf *buf;
+	int result;
+
 	if (sv->sv_dirty) {
 		struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
-		int result = sfs_wblock(sfs, &sv->sv_i, sv->sv_ino);
+		result = sfs_buf_get(sfs, sv->sv_ino, &buf);
 		if (result) {
 			return result;
 		}
+		memcpy(sfs_buf_data(buf), &sv->sv_i, SFS_BLOCKSIZE);
+		sfs_buf_dirty(buf);
+		sfs_buf_release(buf);
 		sv->sv_dirty = false;
 	}
 	return 0;
@@ -113,6 +135,7 @@ static
 void
 sfs_bfree(struct sfs_fs *sfs, uint32_t diskblock)
 {
+	sfs_buf_drop(sfs, diskblock);
 	bitmap_unmark(sfs->sfs_freemap, diskblock);
 	sfs->sfs_freemapdirty = true;
 }
@@ -146,23 +169,14 @@ int
 sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, int doalloc,
 	 uint32_t *diskblock)
 {
-	/*
-	 * I/O buffer for handling indirect blocks.
-	 *
-	 * Note: in real life (and when you've done the fs assignment)
-	 * you would get space from the disk buffer cache for this,
-	 * not use a static area.
-	 */
-	static uint32_t idbuf[SFS_DBPERIDB];
-
 	struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
+	struct sfs_buf *idbuf;
+	uint32_t *idptrs;
 	uint32_t block;
 	uint32_t idblock;
 	uint32_t idnum, idoff;
 	int result;
 
-	KASSERT(sizeof(idbuf)==SFS_BLOCKSIZE);
-
 	/*
 	 * If the block we want is one of the direct blocks...
 	 */
@@ -246,39 +260,36 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, int doalloc,
 
 		/* Mark the inode dirty */
 		sv->sv_dirty = true;
-
-		/* Clear the indirect block buffer */
-		bzero(idbuf, sizeof(idbuf));
 	}
-	else {
-		/*
-		 * We already have an indirect block allocated; load it.
-		 */
-		result = sfs_rblock(sfs, idbuf, idblock);
-		if (result) {
-			return result;
-		}
+
+	/*
+	 * Get the indirect block from the buffer cache. (A new one
+	 * was zeroed there by sfs_balloc.)
+	 */
+	result = sfs_buf_read(sfs, idblock, &idbuf);
+	if (result) {
+		return result;
 	}
+	idptrs = sfs_buf_data(idbuf);
 
 	/* Get the block out of the indirect block buffer */
-	block = idbuf[idoff];
+	block = idptrs[idoff];
 
 	/* If there's no block there, allocate one */
 	if (block==0 && doalloc) {
 		result = sfs_balloc(sfs, &block);
 		if (result) {
+			sfs_buf_release(idbuf);
 			return result;
 		}
 
 		/* Remember the block we allocated */
-		idbuf[idoff] = block;
+		idptrs[idoff] = block;
 
-		/* The indirect block is now dirty; write it back */
-		result = sfs_wblock(sfs, idbuf, idblock);
-		if (result) {
-			return result;
-		}
+		/* The indirect block is now dirty */
+		sfs_buf_dirty(idbuf);
 	}
+	sfs_buf_release(idbuf);
 
 	/* Hand back the result and return. */
 	if (block != 0 && !sfs_bused(sfs, block)) {
@@ -308,16 +319,8 @@ int
 sfs_partialio(struct sfs_vnode *sv, struct uio *uio,
 	      uint32_t skipstart, uint32_t len)
 {
-	/*
-	 * I/O buffer for handling partial sectors.
-	 *
-	 * Note: in real life (and when you've done the fs assignment)
-	 * you would get space from the disk buffer cache for this,
-	 * not use a static area.
-	 */
-	static char iobuf[SFS_BLOCKSIZE];
-
 	struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
+	struct sfs_buf *iobuf;
 	uint32_t diskblock;
 	uint32_t fileblock;
 	int result;
@@ -339,52 +342,93 @@ sfs_partialio(struct sfs_vnode *sv, struct uio *uio,
 	if (diskblock == 0) {
 		/*
 		 * There was no block mapped at this point in the file.
-		 * Zero the buffer.
+		 * Read zeros.
 		 */
 		KASSERT(uio->uio_rw == UIO_READ);
-		bzero(iobuf, sizeof(iobuf));
-	}
-	else {
-		/*
-		 * Read the block.
-		 */
-		result = sfs_rblock(sfs, iobuf, diskblock);
-		if (result) {
-			return result;
-		}
+		return uiomovezeros(len, uio);
 	}
 
 	/*
-	 * Now perform the requested operation into/out of the buffer.
+	 * Get the block. It stays in the cache, so a run of small
+	 * writes to the same block only dirties it in memory.
 	 */
-	result = uiomove(iobuf+skipstart, len, uio);
+	result = sfs_buf_read(sfs, diskblock, &iobuf);
 	if (result) {
 		return result;
 	}
 
 	/*
-	 * If it was a write, write back the modified block.
+	 * Now perform the requested operation into/out of the buffer.
+	 * Even a failed write may have changed part of it.
 	 */
+	result = uiomove((char *)sfs_buf_data(iobuf)+skipstart, len, uio);
 	if (uio->uio_rw == UIO_WRITE) {
-		result = sfs_wblock(sfs, iobuf, diskblock);
+		sfs_buf_dirty(iobuf);
+	}
+	sfs_buf_release(iobuf);
+
+	return result;
+}
+
+/*
+ * Do I/O (either read or write) of a single whole block, through the
+ * buffer cache.
+ */
+static
+int
+sfs_cachedblockio(struct sfs_fs *sfs, uint32_t diskblock, struct uio *uio)
+{
+	struct sfs_buf *iobuf;
+	int result;
+
+	if (uio->uio_rw == UIO_READ) {
+		result = sfs_buf_read(sfs, diskblock, &iobuf);
 		if (result) {
 			return result;
 		}
+		result = uiomove(sfs_buf_data(iobuf), SFS_BLOCKSIZE, uio);
+		sfs_buf_release(iobuf);
+		return result;
 	}
 
-	return 0;
+	/*
+	 * Writing the whole block, so there's no need to read it
+	 * first. If the copy fails partway, an uncached buffer is
+	 * just discarded; a cached one has been partly overwritten
+	 * and has to be kept.
+	 */
+	result = sfs_buf_get(sfs, diskblock, &iobuf);
+	if (result) {
+		return result;
+	}
+	result = uiomove(sfs_buf_data(iobuf), SFS_BLOCKSIZE, uio);
+	if (result == 0 || sfs_buf_isvalid(iobuf)) {
+		sfs_buf_dirty(iobuf);
+	}
+	sfs_buf_release(iobuf);
+	return result;
 }
 
 /*
- * Do I/O (either read or write) of a single whole block.
+ * Do I/O of up to MAXBLOCKS whole blocks, handing back the number
+ * done in *DONE.
+ *
+ * Consecutive file blocks that are also consecutive on disk go to the
+ * device together, straight to or from the uio, in one request of up
+ * to SFS_MAXCLUSTER blocks. A run stops short of a block that's in
+ * the buffer cache when reading, since the cached copy may be newer
+ * than the disk; writing a run instead throws away any cached copies
+ * of what it overwrote. A lone block goes through the cache.
  */
 static
 int
-sfs_blockio(struct sfs_vnode *sv, struct uio *uio)
+sfs_blockio(struct sfs_vnode *sv, struct uio *uio, uint32_t maxblocks,
+	    uint32_t *done)
 {
 	struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
-	uint32_t diskblock;
+	uint32_t diskblock, nextblock;
 	uint32_t fileblock;
+	uint32_t n, i;
 	int result;
 	int doalloc = (uio->uio_rw==UIO_WRITE);
 	off_t saveoff;
@@ -392,6 +436,9 @@ sfs_blockio(struct sfs_vnode *sv, struct uio *uio)
 	off_t saveres;
 	off_t diskres;
 
+	KASSERT(maxblocks > 0);
+	*done = 1;
+
 	/* Get the block number within the file */
 	fileblock = uio->uio_offset / SFS_BLOCKSIZE;
 
@@ -412,24 +459,67 @@ sfs_blockio(struct sfs_vnode *sv, struct uio *uio)
 		return uiomovezeros(SFS_BLOCKSIZE, uio);
 	}
 
+	if (uio->uio_rw == UIO_READ && sfs_buf_incache(sfs, diskblock)) {
+		return sfs_cachedblockio(sfs, diskblock, uio);
+	}
+
+	/*
+	 * See how far the run goes. An error here just ends the run;
+	 * the next call will run into it again and report it.
+	 */
+	if (maxblocks > SFS_MAXCLUSTER) {
+		maxblocks = SFS_MAXCLUSTER;
+	}
+	for (n=1; n<maxblocks; n++) {
+		if (sfs_bmap(sv, fileblock+n, doalloc, &nextblock)) {
+			break;
+		}
+		if (nextblock != diskblock+n) {
+			break;
+		}
+		if (uio->uio_rw == UIO_READ &&
+		    sfs_buf_incache(sfs, nextblock)) {
+			break;
+		}
+	}
+
+	if (n == 1) {
+		return sfs_cachedblockio(sfs, diskblock, uio);
+	}
+
 	/*
 	 * Do the I/O directly to the uio region. Save the uio_offset,
 	 * and substitute one that makes sense to the device.
 	 */
 	saveoff = uio->uio_offset;
-	diskoff = diskblock * SFS_BLOCKSIZE;
+	diskoff = (off_t)diskblock * SFS_BLOCKSIZE;
 	uio->uio_offset = diskoff;
 
 	/*
-	 * Temporarily set the residue to be one block size.
+	 * Temporarily set the residue to the length of the run.
 	 */
-	KASSERT(uio->uio_resid >= SFS_BLOCKSIZE);
+	KASSERT(uio->uio_resid >= n * SFS_BLOCKSIZE);
 	saveres = uio->uio_resid;
-	diskres = SFS_BLOCKSIZE;
+	diskres = n * SFS_BLOCKSIZE;
 	uio->uio_resid = diskres;
 	
 	result = sfs_rwblock(sfs, uio);
 
+	/*
+	 * Anything written is newer than whatever the cache had, and
+	 * anything read needn't be read ahead any more. The device
+	 * only moves whole blocks, so a failed transfer stops at a
+	 * block boundary.
+	 */
+	for (i=0; i<(diskres - uio->uio_resid) / SFS_BLOCKSIZE; i++) {
+		if (uio->uio_rw == UIO_WRITE) {
+			sfs_buf_drop(sfs, diskblock+i);
+		}
+		else {
+			sfs_buf_readaround(sfs, diskblock+i);
+		}
+	}
+
 	/*
 	 * Now, restore the original uio_offset and uio_resid and update 
 	 * them by the amount of I/O done.
@@ -437,6 +527,7 @@ sfs_blockio(struct sfs_vnode *sv, struct uio *uio)
 	uio->uio_offset = (uio->uio_offset - diskoff) + saveoff;
 	uio->uio_resid = (uio->uio_resid - diskres) + saveres;
 
+	*done = n;
 	return result;
 }
 
@@ -448,7 +539,7 @@ int
 sfs_io(struct sfs_vnode *sv, struct uio *uio)
 {
 	uint32_t blkoff;
-	uint32_t nblocks, i;
+	uint32_t nblocks, done;
 	int result = 0;
 	uint32_t extraresid = 0;
 
@@ -506,11 +597,12 @@ sfs_io(struct sfs_vnode *sv, struct uio *uio)
 	 */
 	KASSERT(uio->uio_offset % SFS_BLOCKSIZE == 0);
 	nblocks = uio->uio_resid / SFS_BLOCKSIZE;
-	for (i=0; i<nblocks; i++) {
-		result = sfs_blockio(sv, uio);
+	while (nblocks > 0) {
+		result = sfs_blockio(sv, uio, nblocks, &done);
 		if (result) {
 			goto out;
 		}
+		nblocks -= done;
 	}
 
 	/*
@@ -545,36 +637,82 @@ sfs_io(struct sfs_vnode *sv, struct uio *uio)
 //
 // Directory I/O
 
+/* Directory entries in one block. */
+#define SFS_DIRPERBLOCK (SFS_BLOCKSIZE / sizeof(struct sfs_dir))
+
+/* No block in sv_dirbuf. */
+#define SFS_NODIRBLOCK ((uint32_t)-1)
+
 /*
- * Read the directory entry out of slot SLOT of a directory vnode.
- * The "slot" is the index of the directory entry, starting at 0.
+ * Make sure directory block BLOCK (counted from the start of the
+ * directory) is in the vnode's directory buffer. Walking a directory
+ * slot by slot thus costs one read per block rather than one per
+ * entry. The buffer is kept up to date by sfs_writedir, and is only
+ * read through the part of the block the directory actually covers.
  */
 static
 int
-sfs_readdir(struct sfs_vnode *sv, struct sfs_dir *sd, int slot)
+sfs_dir_loadblock(struct sfs_vnode *sv, uint32_t block)
 {
 	struct iovec iov;
 	struct uio ku;
-	off_t actualpos;
+	off_t pos, len;
 	int result;
 
-	/* Compute the actual position in the directory to read. */
-	actualpos = slot * sizeof(struct sfs_dir);
+	if (sv->sv_dirbuf == NULL) {
+		sv->sv_dirbuf = kmalloc(SFS_BLOCKSIZE);
+		if (sv->sv_dirbuf == NULL) {
+			return ENOMEM;
+		}
+		sv->sv_dirblock = SFS_NODIRBLOCK;
+	}
+	if (sv->sv_dirblock == block) {
+		return 0;
+	}
 
-	/* Set up a uio to do the read */ 
-	uio_kinit(&iov, &ku, sd, sizeof(struct sfs_dir), actualpos, UIO_READ);
+	pos = (off_t)block * SFS_BLOCKSIZE;
+	len = sv->sv_i.sfi_size - pos;
+	KASSERT(len > 0);
+	if (len > SFS_BLOCKSIZE) {
+		len = SFS_BLOCKSIZE;
+	}
 
-	/* do it */
+	/* don't leave a half-loaded block looking valid */
+	sv->sv_dirblock = SFS_NODIRBLOCK;
+
+	uio_kinit(&iov, &ku, sv->sv_dirbuf, len, pos, UIO_READ);
 	result = sfs_io(sv, &ku);
 	if (result) {
 		return result;
 	}
 
-	/* We should not hit EOF in the middle of a directory entry */
+	/* We should not hit EOF in the middle of a directory block */
 	if (ku.uio_resid > 0) {
 		panic("sfs: readdir: Short entry (inode %u)\n", sv->sv_ino);
 	}
 
+	sv->sv_dirblock = block;
+	return 0;
+}
+
+/*
+ * Read the directory entry out of slot SLOT of a directory vnode.
+ * The "slot" is the index of the directory entry, starting at 0.
+ */
+static
+int
+sfs_readdir(struct sfs_vnode *sv, struct sfs_dir *sd, int slot)
+{
+	int result;
+
+	KASSERT(slot>=0);
+
+	result = sfs_dir_loadblock(sv, slot / SFS_DIRPERBLOCK);
+	if (result) {
+		return result;
+	}
+	*sd = sv->sv_dirbuf[slot % SFS_DIRPERBLOCK];
+
 	/* Done */
 	return 0;
 }
@@ -610,6 +748,12 @@ sfs_writedir(struct sfs_vnode *sv, struct sfs_dir *sd, int slot)
 		panic("sfs: writedir: Short write (ino %u)\n", sv->sv_ino);
 	}
 
+	/* Keep the cached block, if it's this one, in step */
+	if (sv->sv_dirbuf != NULL &&
+	    sv->sv_dirblock == (uint32_t)slot / SFS_DIRPERBLOCK) {
+		sv->sv_dirbuf[slot % SFS_DIRPERBLOCK] = *sd;
+	}
+
 	/* Done */
 	return 0;
 }
@@ -953,12 +1097,74 @@ sfs_reclaim(struct vnode *v)
 	vfs_biglock_release();
 
 	/* Release the storage for the vnode structure itself. */
+	if (sv->sv_dirbuf != NULL) {
+		kfree(sv->sv_dirbuf);
+	}
 	kfree(sv);
 
 	/* Done */
 	return 0;
 }
 
+/*
+ * Sequential read-ahead, for the stream of reads RA belongs to (an
+ * open file; see struct uio_readahead), so readers sharing the file
+ * don't disturb each other. A read that starts where the last one
+ * left off opens the read-ahead window, or doubles it up to SFS_RAMAX
+ * blocks; any other read closes it. While the window is open, that
+ * many blocks past the end of the read are queued to be read into
+ * the buffer cache in the background, so they're there by the time
+ * the next read wants them. The state is protected by the big lock.
+ */
+static
+void
+sfs_readahead(struct sfs_vnode *sv, struct uio_readahead *ra,
+	      off_t start, off_t end)
+{
+	struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
+	uint32_t fileblock, lastblock, nblocks, diskblock;
+
+	if (start == ra->ra_nextpos && end > start) {
+		if (ra->ra_window == 0) {
+			ra->ra_window = SFS_RAMIN;
+		}
+		else if (ra->ra_window < SFS_RAMAX) {
+			ra->ra_window *= 2;
+		}
+	}
+	else {
+		ra->ra_window = 0;
+		ra->ra_end = 0;
+	}
+	ra->ra_nextpos = end;
+	if (ra->ra_window == 0) {
+		return;
+	}
+
+	/* The block END is in, if any, was just read */
+	fileblock = DIVROUNDUP(end, SFS_BLOCKSIZE);
+	lastblock = fileblock + ra->ra_window;
+	nblocks = DIVROUNDUP(sv->sv_i.sfi_size, SFS_BLOCKSIZE);
+	if (lastblock > nblocks) {
+		lastblock = nblocks;
+	}
+	if (fileblock < ra->ra_end) {
+		fileblock = ra->ra_end;
+	}
+
+	for (; fileblock < lastblock; fileblock++) {
+		if (sfs_bmap(sv, fileblock, 0, &diskblock)) {
+			break;
+		}
+		if (diskblock != 0) {
+			sfs_buf_readahead(sfs, diskblock);
+		}
+	}
+	if (fileblock > ra->ra_end) {
+		ra->ra_end = fileblock;
+	}
+}
+
 /*
  * Called for read(). sfs_io() does the work.
  */
@@ -967,12 +1173,16 @@ int
 sfs_read(struct vnode *v, struct uio *uio)
 {
 	struct sfs_vnode *sv = v->vn_data;
+	off_t start = uio->uio_offset;
 	int result;
 
 	KASSERT(uio->uio_rw==UIO_READ);
 
 	vfs_biglock_acquire();
 	result = sfs_io(sv, uio);
+	if (!result && uio->uio_ra != NULL) {
+		sfs_readahead(sv, uio->uio_ra, start, uio->uio_offset);
+	}
 	vfs_biglock_release();
 
 	return result;
@@ -997,6 +1207,154 @@ sfs_write(struct vnode *v, struct uio *uio)
 	return result;
 }
 
+/*
+ * Called for copy_file_range(). Each piece goes straight from the
+ * source's block in the buffer cache to the destination's, with no
+ * buffer in between; a destination block that is overwritten whole
+ * isn't read first. Holes in the source come out as zeros.
+ */
+static
+int
+sfs_copyfrom(struct vnode *v, off_t pos, struct vnode *srcv, off_t srcpos,
+	     size_t len, size_t *copied)
+{
+	struct sfs_vnode *sv = v->vn_data;
+	struct sfs_vnode *src;
+	struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
+	struct sfs_buf *sbuf, *dbuf;
+	uint32_t sblock, dblock;
+	uint32_t soff, doff, chunk;
+	size_t done;
+	int result = 0;
+
+	*copied = 0;
+
+	/* only from another file on this filesystem */
+	if (srcv->vn_ops != v->vn_ops || srcv->vn_fs != v->vn_fs) {
+		return EXDEV;
+	}
+	if (srcv == v) {
+		return EINVAL;
+	}
+	src = srcv->vn_data;
+
+	vfs_biglock_acquire();
+
+	/* stop at the end of the source */
+	if (srcpos >= (off_t)src->sv_i.sfi_size) {
+		len = 0;
+	}
+	else if (len > src->sv_i.sfi_size - srcpos) {
+		len = src->sv_i.sfi_size - srcpos;
+	}
+
+	for (done = 0; done < len; done += chunk) {
+		soff = srcpos % SFS_BLOCKSIZE;
+		doff = pos % SFS_BLOCKSIZE;
+		chunk = SFS_BLOCKSIZE - (soff > doff ? soff : doff);
+		if (chunk > len - done) {
+			chunk = len - done;
+		}
+
+		result = sfs_bmap(src, srcpos / SFS_BLOCKSIZE, 0, &sblock);
+		if (result) {
+			break;
+		}
+		result = sfs_bmap(sv, pos / SFS_BLOCKSIZE, 1, &dblock);
+		if (result) {
+			break;
+		}
+
+		if (doff == 0 && chunk == SFS_BLOCKSIZE) {
+			result = sfs_buf_get(sfs, dblock, &dbuf);
+		}
+		else {
+			result = sfs_buf_read(sfs, dblock, &dbuf);
+		}
+		if (result) {
+			break;
+		}
+
+		if (sblock == 0) {
+			bzero((char *)sfs_buf_data(dbuf) + doff, chunk);
+		}
+		else {
+			result = sfs_buf_read(sfs, sblock, &sbuf);
+			if (result) {
+				/* nothing was changed */
+				sfs_buf_release(dbuf);
+				break;
+			}
+			memcpy((char *)sfs_buf_data(dbuf) + doff,
+			       (char *)sfs_buf_data(sbuf) + soff, chunk);
+			sfs_buf_release(sbuf);
+		}
+		sfs_buf_dirty(dbuf);
+		sfs_buf_release(dbuf);
+
+		srcpos += chunk;
+		pos += chunk;
+	}
+
+	if (done > 0 && pos > (off_t)sv->sv_i.sfi_size) {
+		sv->sv_i.sfi_size = pos;
+		sv->sv_dirty = true;
+	}
+
+	vfs_biglock_release();
+
+	*copied = done;
+	return result;
+}
+
+/*
+ * Called for getdirentry(). The offset in the uio is the slot to
+ * start looking at; empty slots are skipped, and the offset is left
+ * at the slot after the name returned. At the end of the directory
+ * nothing is transferred.
+ */
+static
+int
+sfs_getdirentry(struct vnode *v, struct uio *uio)
+{
+	struct sfs_vnode *sv = v->vn_data;
+	struct sfs_dir tsd;
+	off_t slot;
+	int nentries, result;
+
+	KASSERT(uio->uio_rw==UIO_READ);
+
+	vfs_biglock_acquire();
+
+	nentries = sfs_dir_nentries(sv);
+	for (slot = uio->uio_offset; slot < nentries; slot++) {
+		result = sfs_readdir(sv, &tsd, slot);
+		if (result) {
+			vfs_biglock_release();
+			return result;
+		}
+		if (tsd.sfd_ino != SFS_NOINO) {
+			break;
+		}
+	}
+	if (slot >= nentries) {
+		vfs_biglock_release();
+		return 0;
+	}
+
+	/* Ensure null termination, just in case */
+	tsd.sfd_name[sizeof(tsd.sfd_name)-1] = 0;
+	result = uiomove(tsd.sfd_name, strlen(tsd.sfd_name), uio);
+	if (result) {
+		vfs_biglock_release();
+		return result;
+	}
+	uio->uio_offset = slot + 1;
+
+	vfs_biglock_release();
+	return 0;
+}
+
 /*
  * Called for ioctl()
  */
@@ -1015,6 +1373,21 @@ sfs_ioctl(struct vnode *v, int op, userptr_t data)
 	return EINVAL;
 }
 
+/*
+ * Called for poll. Disk files never block, so they are always ready
+ * and there's nothing to wait on.
+ */
+static
+int
+sfs_poll(struct vnode *v, int events, struct pollset *ps, int *revents)
+{
+	(void)v;
+	(void)ps;
+
+	*revents = events & (POLLIN | POLLOUT);
+	return 0;
+}
+
 /*
  * Called for stat/fstat/lstat.
  */
@@ -1104,6 +1477,10 @@ sfs_fsync(struct vnode *v)
 
 	vfs_biglock_acquire();
 	result = sfs_sync_inode(sv);
+	if (!result) {
+		/* We don't track which buffers are whose; push them all */
+		result = sfs_buf_sync(v->vn_fs->fs_data);
+	}
 	vfs_biglock_release();
 
 	return result;
@@ -1127,17 +1504,10 @@ static
 int
 sfs_truncate(struct vnode *v, off_t len)
 {
-	/*
-	 * I/O buffer for handling the indirect block.
-	 *
-	 * Note: in real life (and when you've done the fs assignment)
-	 * you would get space from the disk buffer cache for this,
-	 * not use a static area.
-	 */
-	static uint32_t idbuf[SFS_DBPERIDB];
-
 	struct sfs_vnode *sv = v->vn_data;
 	struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
+	struct sfs_buf *idbuf;
+	uint32_t *idptrs;
 
 	/* Length in blocks (divide rounding up) */
 	uint32_t blocklen = DIVROUNDUP(len, SFS_BLOCKSIZE);
@@ -1147,8 +1517,6 @@ sfs_truncate(struct vnode *v, off_t len)
 	int result;
 	int hasnonzero, iddirty;
 
-	KASSERT(sizeof(idbuf)==SFS_BLOCKSIZE);
-
 	vfs_biglock_acquire();
 
 	/*
@@ -1177,41 +1545,40 @@ sfs_truncate(struct vnode *v, off_t len)
 		/* We're past the proposed EOF; may need to free stuff */
 
 		/* Read the indirect block */
-		result = sfs_rblock(sfs, idbuf, idblock);
+		result = sfs_buf_read(sfs, idblock, &idbuf);
 		if (result) {
 			vfs_biglock_release();
 			return result;
 		}
+		idptrs = sfs_buf_data(idbuf);
 		
 		hasnonzero = 0;
 		iddirty = 0;
 		for (j=0; j<SFS_DBPERIDB; j++) {
 			/* Discard any blocks that are past the new EOF */
-			if (blocklen < baseblock+j && idbuf[j] != 0) {
-				sfs_bfree(sfs, idbuf[j]);
-				idbuf[j] = 0;
+			if (blocklen < baseblock+j && idptrs[j] != 0) {
+				sfs_bfree(sfs, idptrs[j]);
+				idptrs[j] = 0;
 				iddirty = 1;
 			}
 			/* Remember if we see any nonzero blocks in here */
-			if (idbuf[j]!=0) {
+			if (idptrs[j]!=0) {
 				hasnonzero=1;
 			}
 		}
 
+		if (iddirty) {
+			/* The indirect block is dirty */
+			sfs_buf_dirty(idbuf);
+		}
+		sfs_buf_release(idbuf);
+
 		if (!hasnonzero) {
 			/* The whole indirect block is empty now; free it */
 			sfs_bfree(sfs, idblock);
 			sv->sv_i.sfi_indirect = 0;
 			sv->sv_dirty = true;
 		}
-		else if (iddirty) {
-			/* The indirect block is dirty; write it back */
-			result = sfs_wblock(sfs, idbuf, idblock);
-			if (result) {
-				vfs_biglock_release();
-				return result;
-			}
-		}
 	}
 
 	/* Set the file size */
@@ -1586,7 +1953,9 @@ static const struct vnode_ops sfs_fileops = {
 	NOTDIR,  /* readlink */
 	NOTDIR,  /* getdirentry */
 	sfs_write,
+	sfs_copyfrom,
 	sfs_ioctl,
+	sfs_poll,
 	sfs_stat,
 	sfs_gettype,
 	sfs_tryseek,
@@ -1619,12 +1988,14 @@ static const struct vnode_ops sfs_dirops = {
 	
 	ISDIR,   /* read */
 	ISDIR,   /* readlink */
-	UNIMP,   /* getdirentry */
+	sfs_getdirentry,
 	ISDIR,   /* write */
+	ISDIR,   /* copyfrom */
 	sfs_ioctl,
+	sfs_poll,
 	sfs_stat,
 	sfs_gettype,
-	UNIMP,   /* tryseek */
+	sfs_tryseek,
 	sfs_fsync,
 	ISDIR,   /* mmap */
 	ISDIR,   /* truncate */
@@ -1653,6 +2024,7 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 {
 	struct vnode *v;
 	struct sfs_vnode *sv;
+	struct sfs_buf *buf;
 	const struct vnode_ops *ops = NULL;
 	unsigned i, num;
 	int result;
@@ -1697,15 +2069,21 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 	}
 
 	/* Read the block the inode is in */
-	result = sfs_rblock(sfs, &sv->sv_i, ino);
+	result = sfs_buf_read(sfs, ino, &buf);
 	if (result) {
 		kfree(sv);
 		return result;
 	}
+	memcpy(&sv->sv_i, sfs_buf_data(buf), SFS_BLOCKSIZE);
+	sfs_buf_release(buf);
 
 	/* Not dirty yet */
 	sv->sv_dirty = false;
 
+	/* Directory blocks are cached on first use */
+	sv->sv_dirbuf = NULL;
+	sv->sv_dirblock = SFS_NODIRBLOCK;
+
 	/*
 	 * FORCETYPE is set if we're creating a new file, because the
 	 * block on disk will have been zeroed out and thus the type
@@ -36,9 +36,19 @@
 
 
 #include <vm.h>
+#include "opt-A2.h"
 
 struct vnode;
 
+#if OPT_A2
+/*
+ * Max number of user threads per address space, including the main
+ * thread. Each extra thread gets its own stack region below the main
+ * stack; slot 0 is the main stack.
+ */
+#define AS_MAXTHREADS 16
+#endif
+
 
 /* 
  * Address space - data structure associated with the virtual memory
@@ -70,6 +80,14 @@ struct addrspace {
   //struct pageEntry *ptable_stack;
 
   bool text_seg_loaded;
+
+  vaddr_t as_ptab;                /* page directory for TLB refill */
+
+#if OPT_A2
+  /* stacks for extra user threads; slot 0 unused (main stack above) */
+  paddr_t as_tstackpbase[AS_MAXTHREADS];  /* 0 if never allocated */
+  uint32_t as_tstackused;                 /* bit per slot in use */
+#endif
 };
 
 /*
@@ -123,6 +141,24 @@ int               as_prepare_load(struct addrspace *as);
 int               as_complete_load(struct addrspace *as);
 int               as_define_stack(struct addrspace *as, vaddr_t *initstackptr);
 
+#if OPT_A2
+/*
+ * User thread stacks. The caller serializes calls on the same
+ * address space (sys___thread_create/join hold p_tlock).
+ *
+ *    as_define_thread_stack - claim stack slot SLOT (1..AS_MAXTHREADS-1)
+ *                and hand back its initial stack pointer.
+ *
+ *    as_release_thread_stack - give the slot back for reuse. The
+ *                memory stays mapped until the address space is
+ *                destroyed, so stale TLB entries on other cpus can
+ *                never point at freed pages.
+ */
+int               as_define_thread_stack(struct addrspace *as, int slot,
+                                         vaddr_t *stackptr);
+void              as_release_thread_stack(struct addrspace *as, int slot);
+#endif
+
 
 /*
  * Functions in loadelf.c
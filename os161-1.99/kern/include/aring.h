@@ -0,0 +1,26 @@
+#ifndef _ARING_H_
+#define _ARING_H_
+
+/*
+ * Asynchronous I/O rings (see kern/aring.h for the interface seen by
+ * user programs).
+ *
+ * Each process may set up one ring. Its worker is a kernel thread
+ * that reaches the ring and the I/O buffers through kseg0 (see
+ * vm_translate), so the ring has to be torn down, with aring_destroy,
+ * before the address space it lives in goes away.
+ */
+
+struct proc;
+
+/*
+ * aring_stop tells P's ring worker to stop, without waiting for it;
+ * an operation still waiting for its file to become ready gives up
+ * with EINTR, and threads waiting in aring_enter return. It may be
+ * called more than once. aring_destroy stops the worker, waits for whatever it
+ * was doing to finish, and frees the ring.
+ */
+void aring_stop(struct proc *p);
+void aring_destroy(struct proc *p);
+
+#endif /* _ARING_H_ */
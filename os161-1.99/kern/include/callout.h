@@ -0,0 +1,53 @@
+#ifndef _CALLOUT_H_
+#define _CALLOUT_H_
+
+/*
+ * Callouts: call a function after a number of timer ticks (one tick
+ * every LT_GRANULARITY usec).
+ *
+ * Pending callouts live on a hashed timing wheel, so each timer tick
+ * only looks at the callouts in one wheel slot instead of every
+ * pending timeout in the system. Callout functions run from the
+ * timer interrupt, so they must not sleep.
+ *
+ * Like struct work, struct callout is allocated by the caller, so
+ * scheduling one never allocates memory and is safe in interrupt
+ * context. A callout that may still be pending or running must be
+ * stopped with callout_stop before its memory is reused.
+ */
+
+struct callout {
+	void (*c_func)(void *arg);	/* what to call */
+	void *c_arg;			/* argument for c_func */
+	struct callout *c_next;		/* wheel slot link */
+	struct callout **c_prevp;	/* pointer to us, for removal */
+	struct callout *c_duenext;	/* link while waiting to run */
+	unsigned c_rounds;		/* wheel turns left before due */
+	bool c_pending;			/* on the wheel */
+	volatile bool c_running;	/* due, c_func not yet returned */
+};
+
+/* Initialize a callout. */
+void callout_init(struct callout *c, void (*func)(void *), void *arg);
+
+/*
+ * Call C's function after TICKS timer ticks (at least 1). Returns
+ * false, doing nothing, if C is already pending.
+ */
+bool callout_schedule(struct callout *c, unsigned ticks);
+
+/*
+ * Cancel C. Returns true if it was pending and now will not run.
+ * Either way, if its function is running (or about to), waits for it
+ * to finish, so C can be freed afterwards. Must not be called from a
+ * callout function.
+ */
+bool callout_stop(struct callout *c);
+
+/* Call once during system startup. */
+void callout_bootstrap(void);
+
+/* Called from timerclock() to run callouts that have come due. */
+void callout_tick(void);
+
+#endif /* _CALLOUT_H_ */
@@ -31,6 +31,7 @@
 #define _CLOCK_H_
 
 #include "opt-synchprobs.h"
+#include <lamebus/ltimer.h> /* for LT_GRANULARITY */
 
 /*
  * Time-related definitions.
@@ -38,8 +39,8 @@
  * hardclock() is called on every CPU HZ times a second, possibly only
  * when the CPU is not idle, for scheduling.
  *
- * timerclock() is called on one CPU once a second to allow simple
- * timed operations. (This is a fairly simpleminded interface.)
+ * timerclock() is called on one CPU every LT_GRANULARITY usec to run
+ * callouts (see callout.h).
  *
  * gettime() may be used to fetch the current time of day.
  * getinterval() computes the time from time1 to time2.
@@ -56,6 +57,9 @@
 #define HZ  100
 #endif
 
+/* timer ticks (timerclock calls) per second */
+#define TICKS_PER_SECOND (1000000 / LT_GRANULARITY)
+
 void hardclock_bootstrap(void);
 
 void hardclock(void);
@@ -71,7 +75,7 @@ void getinterval(time_t secs1, uint32_t nsecs,
  * clocksleep() suspends execution for the requested number of seconds,
  * like userlevel sleep(3). (Don't confuse it with wchan_sleep.)
  *
- *  this will be more efficient than clocknap() for longer sleeps
+ * The thread is woken once, when the time is up.
  */
 void clocksleep(int seconds);
 
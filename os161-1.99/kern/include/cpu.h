@@ -35,6 +35,8 @@
 #include <threadlist.h>
 #include <machine/vm.h>  /* for TLBSHOOTDOWN_MAX */
 
+struct trapframe;
+
 
 /*
  * Per-cpu structure
@@ -59,7 +61,9 @@ struct cpu {
 	 */
 	struct thread *c_curthread;	/* Current thread on cpu */
 	struct threadlist c_zombies;	/* List of exited threads */
+	struct threadlist c_threadcache; /* Exited threads kept for reuse */
 	unsigned c_hardclocks;		/* Counter of hardclock() calls */
+	struct trapframe *c_intrtf;	/* Trapframe of current interrupt */
 
 	/*
 	 * Accessed by other cpus.
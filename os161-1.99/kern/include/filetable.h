@@ -0,0 +1,86 @@
+#ifndef _FILETABLE_H_
+#define _FILETABLE_H_
+
+/*
+ * Open files and per-process file descriptor tables.
+ *
+ * An open file (struct openfile) is what open() creates: a vnode, the
+ * access mode, the seek offset, and the read-ahead state. Descriptors
+ * that share one (after dup2 or fork) share the offset. It is
+ * reference counted and goes away when the last descriptor using it
+ * is closed.
+ *
+ * A file table maps descriptors to open files. It is a fixed array of
+ * OPEN_MAX slots, so lookup is an index. The table's spinlock is held
+ * only to read or change a slot and take a reference; the I/O itself
+ * is done with no table lock held, so threads of the same process
+ * don't serialize on each other's reads and writes. Only seekable
+ * files have an offset lock, held for the length of each read or
+ * write so that concurrent users of the same offset don't interleave.
+ */
+
+#include <limits.h>
+#include <spinlock.h>
+#include <uio.h>
+
+struct vnode;
+struct lock;
+
+struct openfile {
+	struct vnode *of_vnode;
+	int of_accmode;			/* O_RDONLY, O_WRONLY, or O_RDWR */
+	bool of_append;			/* O_APPEND */
+	struct lock *of_offsetlock;	/* NULL if not seekable */
+	off_t of_offset;		/* protected by of_offsetlock */
+	struct uio_readahead of_ra;	/* handed to VOP_READ */
+
+	struct spinlock of_reflock;
+	unsigned of_refcount;
+};
+
+struct filetable {
+	struct spinlock ft_lock;
+	struct openfile *ft_files[OPEN_MAX];	/* NULL if not open */
+};
+
+/* Open PATH (which is destroyed) and return a new open file. */
+int openfile_open(char *path, int flags, mode_t mode, struct openfile **ret);
+
+/* Make a new open file for VN, which is already open (by vfs_open). */
+int openfile_create(struct vnode *vn, int flags, struct openfile **ret);
+
+void openfile_incref(struct openfile *of);
+void openfile_decref(struct openfile *of);	/* closes on last reference */
+
+/*
+ * Do I/O on OF at its current offset, advancing it, or at POS without
+ * touching it if USEPOS. The uio's offset and read-ahead state are
+ * set here, so reads through one open file are one stream for
+ * read-ahead, whoever else is reading the same file. Returns EBADF if
+ * the file was not opened for that direction.
+ */
+int openfile_io(struct openfile *of, struct uio *uio, bool usepos, off_t pos);
+
+struct filetable *filetable_create(void);
+void filetable_destroy(struct filetable *ft);
+
+/* Make DST refer to the same open files as SRC; DST's are closed. */
+void filetable_copy(struct filetable *src, struct filetable *dst);
+
+/* Get the open file for FD, with a reference the caller must drop. */
+int filetable_get(struct filetable *ft, int fd, struct openfile **ret);
+
+/* Put OF in the lowest free slot, taking over the caller's reference. */
+int filetable_place(struct filetable *ft, struct openfile *of, int *fd);
+
+/*
+ * Put OF in slot FD, taking over the caller's reference. Whatever was
+ * there is returned in *OLDRET, for the caller to drop, or NULL.
+ */
+int filetable_setfd(struct filetable *ft, int fd, struct openfile *of,
+		    struct openfile **oldret);
+
+/* Empty slot FD and return its file, for the caller to drop. */
+int filetable_remove(struct filetable *ft, int fd, struct openfile **ret);
+
+#endif /* _FILETABLE_H_ */
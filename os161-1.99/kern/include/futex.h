@@ -0,0 +1,25 @@
+#ifndef _FUTEX_H_
+#define _FUTEX_H_
+
+/*
+ * Futexes: user-level sleeping on a word of user memory.
+ *
+ * A thread sleeps in futex_wait only if the word at ADDR still holds
+ * the value it expects, and futex_wake wakes sleepers on the same
+ * (address space, address) pair. Sleepers are kept in a hash table
+ * of wait channels; a wait channel exists only while someone sleeps
+ * on it, so an uncontended user lock never reaches the kernel.
+ */
+
+struct addrspace;
+
+/* Call once during system startup. */
+void futex_bootstrap(void);
+
+/*
+ * Wake every thread sleeping on any futex in AS; used when a process
+ * is exiting so its sleeping threads can leave.
+ */
+void futex_wakeall_as(struct addrspace *as);
+
+#endif /* _FUTEX_H_ */
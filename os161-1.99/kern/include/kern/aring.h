@@ -0,0 +1,65 @@
+#ifndef _KERN_ARING_H_
+#define _KERN_ARING_H_
+
+/*
+ * Asynchronous I/O rings.
+ *
+ * A process hands aring_setup() one page-aligned struct aring in its
+ * own memory. To submit I/O it fills in sqes[sq_tail % ARING_ENTRIES]
+ * and increments sq_tail; a kernel worker takes entries from sq_head,
+ * does them in order, and for each one fills in cqes[cq_tail %
+ * ARING_ENTRIES] and increments cq_tail. The process consumes
+ * completions by incrementing cq_head. The counters run freely.
+ *
+ * None of this needs a system call, except that the worker sleeps
+ * when it runs out of work: aring_enter() wakes it, and also waits
+ * until at least MIN_COMPLETE completions are ready (or nothing is
+ * outstanding), returning how many are.
+ *
+ * The kernel owns sq_head and cq_tail; the process owns sq_tail and
+ * cq_head. The worker won't take a submission while the completion
+ * queue is full.
+ */
+
+#define ARING_ENTRIES	64		/* slots in each queue */
+#define ARING_MAXLEN	(64*1024)	/* longer transfers are cut short */
+
+/* Operations */
+#define ARING_OP_NOP	0	/* just complete */
+#define ARING_OP_READ	1	/* read(2) or pread(2) */
+#define ARING_OP_WRITE	2	/* write(2) or pwrite(2) */
+#define ARING_OP_FSYNC	3	/* fsync(2) */
+
+/* Submission queue entry */
+struct aring_sqe {
+	__i32 sqe_op;		/* ARING_OP_* */
+	__i32 sqe_fd;		/* file descriptor */
+	__off_t sqe_offset;	/* file position, or -1 for the file offset */
+#ifdef _KERNEL
+	userptr_t sqe_buf;	/* buffer to read into or write from */
+#else
+	void *sqe_buf;
+#endif
+	__u32 sqe_len;		/* transfer length */
+	__u32 sqe_data;		/* passed through to the completion */
+	__u32 sqe_reserved;	/* must be 0 */
+};
+
+/* Completion queue entry */
+struct aring_cqe {
+	__u32 cqe_data;		/* sqe_data of the submission */
+	__i32 cqe_res;		/* bytes transferred (or 0), or -errno */
+};
+
+/* The shared ring; must be page-aligned and fit in one page. */
+struct aring {
+	volatile __u32 sq_head;	/* kernel: next entry to take */
+	volatile __u32 sq_tail;	/* process: next free entry */
+	volatile __u32 cq_head;	/* process: next completion to read */
+	volatile __u32 cq_tail;	/* kernel: next completion to post */
+	__u32 ar_reserved[4];
+	struct aring_sqe sqes[ARING_ENTRIES];
+	struct aring_cqe cqes[ARING_ENTRIES];
+};
+
+#endif /* _KERN_ARING_H_ */
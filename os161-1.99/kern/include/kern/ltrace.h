@@ -0,0 +1,25 @@
+#ifndef _KERN_LTRACE_H_
+#define _KERN_LTRACE_H_
+
+/*
+ * Operations for the ltrace() system call, which gives user programs
+ * the trace161 controls of the ltrace device. Under plain sys161, or
+ * with no ltrace device, they do nothing.
+ *
+ * For LTR_TRACEON and LTR_TRACEOFF the code is a trace161 tracing
+ * flag character (e.g. 'k' for kernel instructions, 'u' for user
+ * instructions). For the others it is an arbitrary number that shows
+ * up in sys161's output, so markers can be told apart.
+ */
+
+#define LTR_TRACEON	0	/* turn on trace161 flag CODE */
+#define LTR_TRACEOFF	1	/* turn off trace161 flag CODE */
+#define LTR_DEBUG	2	/* print debug marker CODE */
+#define LTR_DUMP	3	/* dump the machine state, tagged CODE */
+#define LTR_PROFON	4	/* start profiling */
+#define LTR_PROFOFF	5	/* stop profiling */
+#define LTR_PROFCLEAR	6	/* discard the profile so far */
+#define LTR_BEGIN	7	/* marker CODE, then start profiling */
+#define LTR_END		8	/* stop profiling, then marker CODE */
+
+#endif /* _KERN_LTRACE_H_ */
@@ -0,0 +1,21 @@
+#ifndef _KERN_POLL_H_
+#define _KERN_POLL_H_
+
+/*
+ * Definitions for the poll() system call.
+ */
+
+struct pollfd {
+	int fd;			/* descriptor to check; ignored if negative */
+	short events;		/* events asked about */
+	short revents;		/* events that happened */
+};
+
+#define POLLIN		0x001	/* reading won't block */
+#define POLLPRI		0x002	/* urgent data (never set) */
+#define POLLOUT		0x004	/* writing won't block */
+#define POLLERR		0x008	/* error, e.g. pipe has no reader; always checked */
+#define POLLHUP		0x010	/* hung up, e.g. pipe has no writer; always checked */
+#define POLLNVAL	0x020	/* fd is not open; always checked */
+
+#endif /* _KERN_POLL_H_ */
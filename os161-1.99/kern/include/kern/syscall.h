@@ -109,12 +109,12 @@
 #define SYS_close        49
 #define SYS_read         50
 #define SYS_pread        51
-//#define SYS_readv      52
+#define SYS_readv        52
 //#define SYS_preadv     53
 #define SYS_getdirentry  54
 #define SYS_write        55
 #define SYS_pwrite       56
-//#define SYS_writev     57
+#define SYS_writev       57
 //#define SYS_pwritev    58
 #define SYS_lseek        59
 #define SYS_flock        60
@@ -197,6 +197,23 @@
 #define SYS_reboot       119
 //#define SYS___sysctl   120
 
+//                              -- Threads --
+#define SYS___thread_create 130
+#define SYS_thread_join  131
+#define SYS_thread_exit  132
+#define SYS_futex_wait   133
+#define SYS_futex_wake   134
+
+//                              -- Tracing --
+#define SYS_ltrace       135
+
+//                              -- In-kernel copying --
+#define SYS_copy_file_range 136
+
+//                              -- Asynchronous I/O --
+#define SYS_aring_setup  137
+#define SYS_aring_enter  138
+
 /*CALLEND*/
 
 
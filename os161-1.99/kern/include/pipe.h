@@ -0,0 +1,18 @@
+#ifndef _PIPE_H_
+#define _PIPE_H_
+
+/*
+ * Pipes.
+ *
+ * A pipe is a pair of vnodes, a read end and a write end, over a
+ * ring buffer. Each end is handed back already open (as if by
+ * vfs_open), so it is released with vfs_close like any other file.
+ * Reads get EOF once the write end is closed; writes get EPIPE once
+ * the read end is closed.
+ */
+
+struct vnode;
+
+int pipe_create(struct vnode **readret, struct vnode **writeret);
+
+#endif /* _PIPE_H_ */
@@ -0,0 +1,51 @@
+#ifndef _POLLQ_H_
+#define _POLLQ_H_
+
+/*
+ * Poll wait queues.
+ *
+ * Each object poll() can wait on (a pipe, the console) embeds a
+ * struct pollq. Its VOP_POLL first calls pollq_register to put the
+ * caller's pollset on the queue, then checks its own state, so a
+ * change between the check and the caller going to sleep still
+ * wakes it. Whenever the object's state changes in a way that might
+ * make it readable or writable, it calls pollq_wakeup, which wakes
+ * every pollset on the queue.
+ *
+ * A pollset is one poll() call's waiting state: a wait channel and
+ * one queue entry per descriptor, so a VOP_POLL call may register on
+ * at most one queue. A pollset can be NULL (for a caller that doesn't
+ * want to wait), in which case pollq_register does nothing.
+ *
+ * pollq_wakeup may be called from interrupt handlers.
+ */
+
+#include <spinlock.h>
+
+struct pollset;		/* Opaque. */
+struct pollent;		/* Opaque. */
+
+struct pollq {
+	struct spinlock pq_lock;
+	struct pollent *pq_head;	/* registered pollsets */
+};
+
+void pollq_init(struct pollq *pq);
+void pollq_cleanup(struct pollq *pq);	/* must be empty */
+void pollq_register(struct pollq *pq, struct pollset *ps);
+void pollq_wakeup(struct pollq *pq);
+
+/*
+ * pollset_create makes a pollset with room for MAXENTS registrations.
+ * pollset_wait sleeps until a registered queue is woken or the
+ * pollset's timeout (if any; see pollset_settimeout) runs out, and
+ * returns true in the latter case. It returns at once if a wakeup
+ * happened since the last call. pollset_destroy removes the pollset
+ * from every queue it is on.
+ */
+struct pollset *pollset_create(unsigned maxents);
+void pollset_settimeout(struct pollset *ps, unsigned ticks);
+bool pollset_wait(struct pollset *ps);
+void pollset_destroy(struct pollset *ps);
+
+#endif /* _POLLQ_H_ */
@@ -40,10 +40,13 @@ s161-1.99/kern/include/proc.h
 
 #include <spinlock.h>
 #include <thread.h> /* required for struct threadarray */
+#include <addrspace.h> /* for AS_MAXTHREADS */
 #include "opt-A2.h"
 
 struct addrspace;
 struct vnode;
+struct filetable;
+struct aring_ctx;
 #ifdef UW
 struct semaphore;
 #endif // UW
@@ -54,9 +57,23 @@ struct semaphore;
 #define P_NOID -1
 
 #if OPT_A2
+/* States of a user thread slot (struct uthread) */
+#define UT_FREE 0   /* not in use */
+#define UT_RUN 1    /* thread running */
+#define UT_DONE 2   /* thread exited, waiting for thread_join */
+
+/*
+ * A user-level thread of a process. The thread id is the index in
+ * p_uthreads, and also the stack slot the thread runs on (see
+ * as_define_thread_stack); tid 0 runs on the main stack.
+ */
+struct uthread {
+     int ut_state;
+     int ut_exitval;       /* valid in UT_DONE */
+};
+
 struct array *processTable;
 struct lock *ptLock;
-struct cv *ptCV;
 struct lock *waitPidLock;
 #endif
 /*
@@ -74,14 +91,22 @@ struct proc {
 	struct vnode *p_cwd;		/* current working directory */
 
 #ifdef UW
-  /* a vnode to refer to the console device */
-  /* this is a quick-and-dirty way to get console writes working */
-  /* you will probably need to change this when implementing file-related
-     system calls, since each process will need to keep track of all files
-     it has opened, not just the console. */
-  struct vnode *console;                /* a vnode for the console device */
+  /* open files, by descriptor; shared with nobody (see filetable.h) */
+  struct filetable *p_files;
+  /* asynchronous I/O ring, if set up (see aring.h) */
+  struct aring_ctx *p_aring;
 #endif
      int pId;
+
+#if OPT_A2
+     /* user threads; all protected by p_tlock */
+     struct lock *p_tlock;
+     struct cv *p_tcv;               /* thread_join sleeps here */
+     unsigned p_nuthreads;           /* user threads not yet gone */
+     bool p_exiting;                 /* _exit called; all threads must leave */
+     int p_exitcode;                 /* exit code for the whole process */
+     struct uthread p_uthreads[AS_MAXTHREADS];
+#endif
 	/* add more material here as needed */
 };
 
@@ -89,10 +114,12 @@ struct proc {
 struct procEntry {
 
      int parentId;
-     int childId;
+     int childId;          /* first child, or P_NOID */
+     int siblingId;        /* next child of the same parent, or P_NOID */
      int pId;
      int status;
      int exitCode;
+     struct cv *exitCV;    /* parent sleeps here in waitpid; protected by waitPidLock */
      
   /* add more material here as needed */
 };
@@ -110,10 +137,22 @@ extern struct semaphore *no_proc_sem;
 
 struct procEntry *getProcess(int pid);
 
-int removeProcess(int pid);
-
 int proc_assignNewPid(struct procEntry *proc);
 
+#if OPT_A2
+/* Record the exit code of process pid and wake its parent if it is waiting. */
+void proc_signalExit(int pid, int exitcode);
+
+/* Link a freshly forked child to its parent. */
+void proc_setParent(int childPid, int parentPid);
+
+/* Free the entry of a process that never ran (failed fork). */
+void proc_discardEntry(int pid);
+
+/* Free a zombie child after waitpid; caller holds waitPidLock. */
+void proc_reapChild(struct procEntry *entry);
+#endif
+
 /* Call once during system startup to allocate data structures. */
 void proc_bootstrap(void);
 
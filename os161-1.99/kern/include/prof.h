@@ -0,0 +1,35 @@
+#ifndef _PROF_H_
+#define _PROF_H_
+
+/*
+ * Sampling kernel profiler.
+ *
+ * While profiling is on, every hardclock() on every cpu records the
+ * pc it interrupted, whether that was in user or kernel mode, and the
+ * current process, in a per-cpu table. prof_dump merges the tables
+ * and prints the most frequent pcs; kernel addresses can be looked up
+ * in the kernel image with addr2line or nm.
+ *
+ * Each sample costs a hash and at most PROF_MAXPROBE probes of the
+ * cpu's own table, with no locks. Samples that find no slot are
+ * counted as dropped rather than slowing the interrupt down.
+ */
+
+struct trapframe;
+
+/* Allocate the current cpu's table. Called on each cpu at startup. */
+void prof_cpu_start(void);
+
+/* Record one sample for the interrupt TF. Called from hardclock. */
+void prof_sample(const struct trapframe *tf);
+
+/* Clear all tables and start sampling. */
+void prof_start(void);
+
+/* Stop sampling. The tables are kept for prof_dump. */
+void prof_stop(void);
+
+/* Print a summary and the NTOP most frequent pcs. */
+void prof_dump(unsigned ntop);
+
+#endif /* _PROF_H_ */
@@ -48,11 +48,15 @@
  */
 #include <kern/sfs.h>
 
+struct sfs_bufcache;		/* in sfs_buf.c */
+
 struct sfs_vnode {
 	struct vnode sv_v;              /* abstract vnode structure */
 	struct sfs_inode sv_i;		/* on-disk inode */
 	uint32_t sv_ino;                /* inode number */
 	bool sv_dirty;                  /* true if sv_i modified */
+	struct sfs_dir *sv_dirbuf;      /* directories: one cached block */
+	uint32_t sv_dirblock;           /* which block sv_dirbuf holds */
 };
 
 struct sfs_fs {
@@ -63,6 +67,7 @@ struct sfs_fs {
 	struct vnodearray *sfs_vnodes;  /* vnodes loaded into memory */
 	struct bitmap *sfs_freemap;     /* blocks in use are marked 1 */
 	bool sfs_freemapdirty;          /* true if freemap modified */
+	struct sfs_bufcache *sfs_bufcache; /* cached blocks */
 };
 
 /*
@@ -84,6 +89,23 @@ int sfs_rwblock(struct sfs_fs *sfs, struct uio *uio);
 int sfs_rblock(struct sfs_fs *sfs, void *data, uint32_t block);
 int sfs_wblock(struct sfs_fs *sfs, void *data, uint32_t block);
 
+/* Block buffer cache (sfs_buf.c) */
+struct sfs_buf;
+int sfs_bufcache_create(struct sfs_fs *sfs);
+void sfs_bufcache_destroy(struct sfs_fs *sfs);
+int sfs_buf_get(struct sfs_fs *sfs, uint32_t block, struct sfs_buf **ret);
+int sfs_buf_read(struct sfs_fs *sfs, uint32_t block, struct sfs_buf **ret);
+void *sfs_buf_data(struct sfs_buf *b);
+bool sfs_buf_isvalid(struct sfs_buf *b);
+void sfs_buf_dirty(struct sfs_buf *b);
+void sfs_buf_release(struct sfs_buf *b);
+void sfs_buf_drop(struct sfs_fs *sfs, uint32_t block);
+bool sfs_buf_incache(struct sfs_fs *sfs, uint32_t block);
+void sfs_buf_readaround(struct sfs_fs *sfs, uint32_t block);
+int sfs_buf_sync(struct sfs_fs *sfs);
+void sfs_buf_readahead(struct sfs_fs *sfs, uint32_t block);
+void sfs_bufstats_print(void);
+
 /* Get root vnode */
 struct vnode *sfs_getroot(struct fs *fs);
 
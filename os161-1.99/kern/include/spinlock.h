@@ -36,6 +36,7 @@
  */
 
 #include <cdefs.h>
+#include "opt-ticketlock.h"
 
 /* Inlining support - for making sure an out-of-line copy gets built */
 #ifndef SPINLOCK_INLINE
@@ -53,16 +54,31 @@
  * This structure is made public so spinlocks do not have to be
  * malloc'd; however, code that uses spinlocks should not look inside
  * the structure directly but always use the spinlock API functions.
+ *
+ * With "options ticketlock" spinlocks are ticket locks: each CPU
+ * takes a number and waits for it to come up, so the lock is handed
+ * out in FIFO order and waiters only read while spinning. Otherwise
+ * they are test-and-test-and-set locks.
  */
 struct spinlock {
+#if OPT_TICKETLOCK
+	volatile spinlock_data_t lk_next; /* Next ticket to hand out. */
+	volatile spinlock_data_t lk_owner; /* Ticket now holding the lock. */
+#else
 	volatile spinlock_data_t lk_lock; /* The memory word where we spin. */
+#endif
 	struct cpu *lk_holder;		/* CPU holding this lock. */
 };
 
 /*
  * Initializer for cases where a spinlock needs to be static or global.
  */
+#if OPT_TICKETLOCK
+#define SPINLOCK_INITIALIZER	{ SPINLOCK_DATA_INITIALIZER, \
+				  SPINLOCK_DATA_INITIALIZER, NULL }
+#else
 #define SPINLOCK_INITIALIZER	{ SPINLOCK_DATA_INITIALIZER, NULL }
+#endif
 
 /*
  * Spinlock functions.
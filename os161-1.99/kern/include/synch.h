@@ -137,8 +137,14 @@ void cv_destroy(struct cv *);
  * on all operations with any particular CV.
  *
  * These operations must be atomic. You get to write them.
+ *
+ *    cv_timedwait - Like cv_wait, but give up after TICKS timer ticks
+ *                   (one every LT_GRANULARITY usec). Returns ETIMEDOUT
+ *                   if the time ran out, 0 if woken. The lock is
+ *                   re-acquired either way.
  */
 void cv_wait(struct cv *cv, struct lock *lock);
+int cv_timedwait(struct cv *cv, struct lock *lock, unsigned ticks);
 void cv_signal(struct cv *cv, struct lock *lock);
 void cv_broadcast(struct cv *cv, struct lock *lock);
 
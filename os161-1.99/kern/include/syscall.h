@@ -39,6 +39,15 @@ struct trapframe; /* from <machine/trapframe.h> */
 
 void syscall(struct trapframe *tf);
 
+/*
+ * Per-cpu system call counts and latency histograms. Latencies are
+ * only measured while syscall_timing is true.
+ */
+extern bool syscall_timing;
+void syscall_stats_cpu_start(void);	/* called on each cpu at startup */
+void syscall_stats_print(void);
+void syscall_stats_clear(void);
+
 /*
  * Support functions.
  */
@@ -57,14 +66,45 @@ void enter_new_process(int argc, userptr_t argv, vaddr_t stackptr,
 
 int sys_reboot(int code);
 int sys___time(userptr_t user_seconds, userptr_t user_nanoseconds);
+int sys_nanosleep(userptr_t user_req, userptr_t user_rem);
+int sys_ltrace(int op, uint32_t code);
 
 #ifdef UW
+int sys_open(userptr_t path, int flags, mode_t mode, int *retval);
+int sys_read(int fdesc,userptr_t ubuf,unsigned int nbytes,int *retval);
 int sys_write(int fdesc,userptr_t ubuf,unsigned int nbytes,int *retval);
+int sys_pread(int fdesc, userptr_t ubuf, size_t nbytes, off_t pos, int *retval);
+int sys_pwrite(int fdesc, userptr_t ubuf, size_t nbytes, off_t pos,
+               int *retval);
+int sys_readv(int fdesc, userptr_t iov, int iovcnt, int *retval);
+int sys_writev(int fdesc, userptr_t iov, int iovcnt, int *retval);
+int sys_close(int fdesc);
+int sys_pipe(userptr_t fds, int *retval);
+int sys_copy_file_range(int infd, userptr_t inpos, int outfd,
+                        userptr_t outpos, size_t len, int *retval);
+int sys_poll(userptr_t fds, unsigned nfds, int timeout, int *retval);
+int sys_aring_setup(userptr_t ring);
+int sys_aring_enter(unsigned min_complete, int *retval);
+int sys_lseek(int fdesc, off_t pos, int whence, off_t *retval);
+int sys_dup2(int oldfd, int newfd, int *retval);
+int sys_getdirentry(int fdesc, userptr_t ubuf, size_t buflen, int *retval);
 void sys__exit(int exitcode);
 int sys_getpid(pid_t *retval);
 int sys_waitpid(pid_t pid, userptr_t status, int options, pid_t *retval);
 pid_t sys_fork(struct trapframe *curTf, pid_t *retval);
 int sys_execv(const char *program, char **args);
+int sys___thread_create(struct trapframe *tf, userptr_t start,
+                        userptr_t arg1, userptr_t arg2, int *retval);
+int sys_thread_join(int tid, userptr_t status);
+void sys_thread_exit(int exitval);
+int sys_futex_wait(userptr_t addr, int val);
+int sys_futex_wake(userptr_t addr, int n, int *retval);
+
+/* Make every thread of the current process exit with exitcode. */
+void uthread_exitall(int exitcode);
+/* Take the current thread out of its process; the last one out
+   destroys the process. Does not return. */
+void uthread_leave(void);
 
 #endif // UW
 
@@ -72,6 +72,7 @@ struct thread {
 	 */
 	char *t_name;			/* Name of this thread */
 	const char *t_wchan_name;	/* Name of wait channel, if sleeping */
+	struct wchan *t_wchan;		/* Wait channel, if on its list */
 	threadstate_t t_state;		/* State this thread is in */
 
 	/*
@@ -83,6 +84,8 @@ struct thread {
 	struct switchframe *t_context;	/* Saved register context (on stack) */
 	struct cpu *t_cpu;		/* CPU thread runs on */
 	struct proc *t_proc;		/* Process thread belongs to */
+	bool t_pinned;			/* Never migrate to another cpu */
+	int t_utid;			/* User thread id within t_proc */
 
 	/*
 	 * Interrupt state fields.
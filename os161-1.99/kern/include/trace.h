@@ -0,0 +1,88 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+/*
+ * Kernel event tracing.
+ *
+ * TRACE() records a small timestamped binary event in the current
+ * cpu's trace ring, if its category is enabled in trace_mask. Unlike
+ * DEBUG() nothing is formatted or printed at the time; the rings are
+ * printed from the menu ("trace dump") or written to a file ("trace
+ * save") for offline analysis. Each ring holds the most recent
+ * TRACE_NEVENTS events of its cpu; older ones are overwritten.
+ *
+ * With the category disabled, TRACE() costs a load and a test, so it
+ * can be left in hot paths.
+ */
+
+/* Event categories, for trace_mask. */
+#define TRC_SCHED	0x0001	/* context switches */
+#define TRC_SYSCALL	0x0002	/* system call entry and exit */
+#define TRC_FAULT	0x0004	/* vm faults */
+#define TRC_DISK	0x0008	/* disk I/O */
+#define TRC_WAKEUP	0x0010	/* wait channel wakeups */
+#define TRC_LOCK	0x0020	/* sleeping for a lock */
+#define TRC_PROC	0x0040	/* process creation, fork, exec */
+#define TRC_ALL		0x007f
+
+/* Event types. The two arguments depend on the type. */
+#define TE_SWITCH	1	/* old thread, new thread */
+#define TE_SYSENTER	2	/* call number, first argument */
+#define TE_SYSEXIT	3	/* call number, error */
+#define TE_FAULT	4	/* fault type, address */
+#define TE_DISKSTART	5	/* sector, nonzero if write */
+#define TE_DISKDONE	6	/* sector, error */
+#define TE_WAKEUP	7	/* wait channel, thread woken */
+#define TE_LOCKWAIT	8	/* lock, 0 */
+#define TE_LOCKGOT	9	/* lock, 0 */
+#define TE_PROCCREATE	10	/* new pid, 0 */
+#define TE_FORK		11	/* parent pid, child pid */
+#define TE_EXEC		12	/* pid, argc */
+
+/*
+ * One event; 24 bytes. This is also the record format of saved
+ * trace files, after a struct trace_filehdr.
+ */
+struct trace_event {
+	uint32_t te_secs;		/* timestamp */
+	uint32_t te_nsecs;
+	uint16_t te_type;		/* TE_* */
+	uint16_t te_cpu;		/* cpu number */
+	int32_t te_pid;			/* current process, or -1 */
+	uint32_t te_arg[2];
+};
+
+#define TRACE_MAGIC	0x54524331	/* "TRC1" */
+
+struct trace_filehdr {
+	uint32_t th_magic;		/* TRACE_MAGIC */
+	uint32_t th_eventsize;		/* sizeof(struct trace_event) */
+	uint32_t th_nevents;		/* events following, oldest first */
+	uint32_t th_mask;		/* trace_mask while recording */
+};
+
+extern uint32_t trace_mask;
+
+#define TRACE(cat, type, a0, a1) \
+	((trace_mask & (cat)) ? \
+	 trace_record((type), (uint32_t)(a0), (uint32_t)(a1)) : (void)0)
+
+/* Record an event unconditionally. Use TRACE() instead. */
+void trace_record(unsigned type, uint32_t arg0, uint32_t arg1);
+
+/* Allocate the current cpu's ring. Called on each cpu at startup. */
+void trace_cpu_start(void);
+
+/* Print the most recent MAX events of all cpus, in time order. */
+void trace_dump(unsigned max);
+
+/* Write all events to the file PATH. */
+int trace_save(const char *path);
+
+/* Discard all recorded events. */
+void trace_clear(void);
+
+/* Mask for a category name ("sched", "disk", ..., "all"), or 0. */
+uint32_t trace_category(const char *name);
+
+#endif /* _TRACE_H_ */
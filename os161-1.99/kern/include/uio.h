@@ -52,6 +52,18 @@ enum uio_seg {
         UIO_SYSSPACE,			/* Kernel. */
 };
 
+/*
+ * Sequential read-ahead state for one stream of reads, such as an
+ * open file's. Whoever issues the reads keeps it, zeroed to start,
+ * and hands it down in uio_ra; the filesystem interprets it (in its
+ * own units, under its own locking) or ignores it.
+ */
+struct uio_readahead {
+	off_t ra_nextpos;		/* where a sequential read would start */
+	uint32_t ra_window;		/* how far to read ahead; 0 if random */
+	uint32_t ra_end;		/* how far read-ahead has got */
+};
+
 struct uio {
 	struct iovec     *uio_iov;	/* Data blocks */
 	unsigned          uio_iovcnt;	/* Number of iovecs */
@@ -60,6 +72,7 @@ struct uio {
 	enum uio_seg      uio_segflg;	/* What kind of pointer we have */
 	enum uio_rw       uio_rw;	/* Whether op is a read or write */
 	struct addrspace *uio_space;	/* Address space for user pointer */
+	struct uio_readahead *uio_ra;	/* Reader's read-ahead, or NULL */
 };
 
 
@@ -77,14 +90,16 @@ struct uio {
  *   (4) set up uio_seg and uio_rw correctly;
  *   (5) if uio_seg is UIO_SYSSPACE, set uio_space to NULL; otherwise,
  *       initialize uio_space to the address space in which the buffer
- *       should be found.
+ *       should be found;
+ *   (6) set uio_ra to NULL, or for reads to the read-ahead state of
+ *       the stream they belong to.
  *
  * After calling, 
  *   (1) the contents of uio_iov and uio_iovcnt may be altered and
  *       should not be interpreted;
  *   (2) uio_offset will have been incremented by the amount transferred;
  *   (3) uio_resid will have been decremented by the amount transferred;
- *   (4) uio_segflg, uio_rw, and uio_space will be unchanged.
+ *   (4) uio_segflg, uio_rw, uio_space, and uio_ra will be unchanged.
  *
  * uiomove() may be called repeatedly on the same uio to transfer
  * additional data until the available buffer space the uio refers to
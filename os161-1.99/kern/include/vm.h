@@ -39,6 +39,8 @@
 
 #include <machine/vm.h>
 
+struct addrspace;
+
 /* Fault-type arguments to vm_fault() */
 #define VM_FAULT_READ        0    /* A read was attempted */
 #define VM_FAULT_WRITE       1    /* A write was attempted */
@@ -62,5 +64,15 @@ void free_kpages(vaddr_t addr);
 void vm_tlbshootdown_all(void);
 void vm_tlbshootdown(const struct tlbshootdown *);
 
+/* TLB misses handled by the MD fast refill path, if there is one. */
+unsigned vm_fastreloads(void);
+
+/*
+ * Physical address of the mapped user page at VADDR in AS, or EFAULT
+ * (also if FORWRITE and the page is read-only).
+ */
+int vm_translate(struct addrspace *as, vaddr_t vaddr, bool forwrite,
+		 paddr_t *ret);
+
 
 #endif /* _VM_H_ */
@@ -33,6 +33,7 @@
 
 struct uio;
 struct stat;
+struct pollset;
 
 /*
  * A struct vnode is an abstract representation of a file.
@@ -116,10 +117,29 @@ struct vnode {
  *                      amount written, and updating uio_offset to match.
  *                      Not allowed on directories or symlinks.
  *
+ *    vop_copyfrom    - Copy up to LEN bytes of file SRC, starting at
+ *                      offset SRCPOS, into file at offset POS, and
+ *                      store the number of bytes copied in *COPIED.
+ *                      Fewer than LEN means end of SRC or an error.
+ *                      For filesystems that can copy without an
+ *                      intermediate buffer; if SRC isn't a regular
+ *                      file on the same filesystem, or there's no
+ *                      way to do better, return EXDEV and the caller
+ *                      will use vop_read and vop_write instead.
+ *                      Not allowed on directories or symlinks.
+ *
  *    vop_ioctl       - Perform ioctl operation OP on file using data
  *                      DATA. The interpretation of the data is specific
  *                      to each ioctl.
  *
+ *    vop_poll        - Check which of the poll events EVENTS (see
+ *                      kern/poll.h) are ready, and store them, plus
+ *                      any of POLLERR and POLLHUP that apply, in
+ *                      *REVENTS. Unless the object is always ready,
+ *                      first register PS on the object's pollq (see
+ *                      pollq.h), so the caller can sleep until its
+ *                      state changes.
+ *
  *    vop_stat        - Return info about a file. The pointer is a 
  *                      pointer to struct stat; see kern/stat.h.
  *
@@ -204,7 +224,12 @@ struct vnode_ops {
 	int (*vop_readlink)(struct vnode *link, struct uio *uio);
 	int (*vop_getdirentry)(struct vnode *dir, struct uio *uio);
 	int (*vop_write)(struct vnode *file, struct uio *uio);
+	int (*vop_copyfrom)(struct vnode *file, off_t pos,
+			    struct vnode *src, off_t srcpos,
+			    size_t len, size_t *copied);
 	int (*vop_ioctl)(struct vnode *object, int op, userptr_t data);
+	int (*vop_poll)(struct vnode *object, int events,
+			struct pollset *ps, int *revents);
 	int (*vop_stat)(struct vnode *object, struct stat *statbuf);
 	int (*vop_gettype)(struct vnode *object, mode_t *result);
 	int (*vop_tryseek)(struct vnode *object, off_t pos);
@@ -249,7 +274,10 @@ struct vnode_ops {
 #define VOP_READLINK(vn, uio)           (__VOP(vn, readlink)(vn, uio))
 #define VOP_GETDIRENTRY(vn, uio)        (__VOP(vn,getdirentry)(vn, uio))
 #define VOP_WRITE(vn, uio)              (__VOP(vn, write)(vn, uio))
+#define VOP_COPYFROM(vn, pos, src, srcpos, len, ret) \
+	(__VOP(vn, copyfrom)(vn, pos, src, srcpos, len, ret))
 #define VOP_IOCTL(vn, code, buf)        (__VOP(vn, ioctl)(vn,code,buf))
+#define VOP_POLL(vn, ev, ps, rev)       (__VOP(vn, poll)(vn, ev, ps, rev))
 #define VOP_STAT(vn, ptr) 	        (__VOP(vn, stat)(vn, ptr))
 #define VOP_GETTYPE(vn, result)         (__VOP(vn, gettype)(vn, result))
 #define VOP_TRYSEEK(vn, pos)            (__VOP(vn, tryseek)(vn, pos))
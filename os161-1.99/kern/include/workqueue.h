@@ -0,0 +1,62 @@
+#ifndef _WORKQUEUE_H_
+#define _WORKQUEUE_H_
+
+/*
+ * Deferred work.
+ *
+ * A work item is a function and argument to be called later from a
+ * kernel worker thread, where it may sleep, take locks and generally
+ * do things an interrupt handler or a hot path can't. Each cpu has
+ * its own queue and worker thread; work is run on the cpu it was
+ * queued from.
+ *
+ * struct work is allocated by the caller (typically embedded in some
+ * other structure) so that queueing it never allocates memory. This
+ * is what makes work_enqueue safe to call from interrupt handlers.
+ *
+ * A work item may be queued at most once at a time. Queueing an item
+ * that is already pending does nothing and returns false. Once the
+ * function has started running the item may be queued again,
+ * including from the function itself.
+ */
+
+#include <spinlock.h>
+#include <callout.h>
+
+struct work {
+	void (*w_func)(void *arg);	/* what to call */
+	void *w_arg;			/* argument for w_func */
+	struct work *w_next;		/* queue link */
+	struct workqueue *w_queue;	/* queue to run on when delay expires */
+	struct callout w_callout;	/* timer for delayed work */
+	bool w_pending;			/* queued or delayed, not yet run */
+	time_t w_secs;			/* when queued, for latency stats */
+	uint32_t w_nsecs;
+};
+
+/* Initialize a work item. */
+void work_init(struct work *w, void (*func)(void *), void *arg);
+
+/*
+ * Queue W on the current cpu's work queue. Callable from interrupt
+ * context. Returns false if W was already pending.
+ */
+bool work_enqueue(struct work *w);
+
+/*
+ * Queue W on the current cpu's work queue after TICKS timer ticks
+ * (one tick every LT_GRANULARITY usec). Callable from interrupt
+ * context. Returns false if W was already pending.
+ */
+bool work_enqueue_delayed(struct work *w, unsigned ticks);
+
+/* Call once during system startup, before any work is queued. */
+void workqueue_bootstrap(void);
+
+/* Start the worker thread for the current cpu. Called on each cpu. */
+void workqueue_cpu_start(void);
+
+/* Print per-cpu queue depth and latency statistics. */
+void workqueue_printstats(void);
+
+#endif /* _WORKQUEUE_H_ */
@@ -50,7 +50,12 @@
 #include <vfs.h>
 #include <synch.h>
 #include <kern/fcntl.h>  
+#include <kern/unistd.h>
+#include <filetable.h>
 #include <lib.h>
+#include <limits.h>
+#include <queue.h>
+#include <trace.h>
 
 
 
@@ -74,8 +79,200 @@ struct semaphore *no_proc_sem;
 #endif  // UW
 
 #if OPT_A2
+/*
+ * Pids that have been reaped and can be handed out again. Pids are
+ * stored directly in the queue's pointer slots. The queue is always
+ * preallocated to hold every pid in processTable, so putting a pid
+ * back never has to allocate (and so never fails). Protected by ptLock.
+ */
+static struct queue *freePids;
+
+#define PID_TO_QPTR(pid) ((void *)(uintptr_t)(pid))
+#define QPTR_TO_PID(ptr) ((int)(uintptr_t)(ptr))
+
+/*
+ * Look up a process table entry. Entries are only freed with
+ * waitPidLock held, so the result stays valid for as long as the
+ * caller holds waitPidLock.
+ */
 struct procEntry* getProcess(int pid) {
-	return array_get(processTable, pid);
+	struct procEntry *entry = NULL;
+
+	lock_acquire(ptLock);
+	if (pid >= 0 && (unsigned)pid < array_num(processTable)) {
+		entry = array_get(processTable, pid);
+	}
+	lock_release(ptLock);
+	return entry;
+}
+
+/*
+ * Free a process table entry and put its pid back on the free list.
+ * The entry must no longer be linked into its parent's child list.
+ */
+static
+void
+proc_freeEntry(struct procEntry *entry)
+{
+	int result;
+
+	KASSERT(lock_do_i_hold(waitPidLock));
+	KASSERT(entry->childId == P_NOID);
+
+	lock_acquire(ptLock);
+	KASSERT(array_get(processTable, entry->pId) == entry);
+	array_set(processTable, entry->pId, NULL);
+	result = q_addtail(freePids, PID_TO_QPTR(entry->pId));
+	/* cannot fail: see proc_assignNewPid */
+	KASSERT(result == 0);
+	lock_release(ptLock);
+
+	DEBUG(DB_SYSCALL, "reaped pid %d\n", entry->pId);
+	cv_destroy(entry->exitCV);
+	kfree(entry);
+}
+
+/*
+ * Take an entry off its parent's child list.
+ */
+static
+void
+proc_unlinkChild(struct procEntry *entry)
+{
+	struct procEntry *parent, *cur;
+
+	KASSERT(lock_do_i_hold(waitPidLock));
+
+	if (entry->parentId == P_NOID) {
+		return;
+	}
+	parent = getProcess(entry->parentId);
+	KASSERT(parent != NULL);
+
+	if (parent->childId == entry->pId) {
+		parent->childId = entry->siblingId;
+	}
+	else {
+		cur = getProcess(parent->childId);
+		while (cur->siblingId != entry->pId) {
+			KASSERT(cur->siblingId != P_NOID);
+			cur = getProcess(cur->siblingId);
+		}
+		cur->siblingId = entry->siblingId;
+	}
+	entry->parentId = P_NOID;
+	entry->siblingId = P_NOID;
+}
+
+/*
+ * Detach all children of an exiting process. Children that have
+ * already exited are reaped on the spot, since nobody can wait for
+ * them any more; running children will reap themselves when they
+ * exit. (There is no init process to hand them to.)
+ */
+static
+void
+proc_orphanChildren(struct procEntry *entry)
+{
+	struct procEntry *child;
+	int next;
+
+	KASSERT(lock_do_i_hold(waitPidLock));
+
+	next = entry->childId;
+	entry->childId = P_NOID;
+	while (next != P_NOID) {
+		child = getProcess(next);
+		KASSERT(child != NULL);
+		next = child->siblingId;
+		child->parentId = P_NOID;
+		child->siblingId = P_NOID;
+		if (child->status == P_ZOMBIE) {
+			proc_freeEntry(child);
+		}
+	}
+}
+
+/*
+ * Make parentPid the parent of childPid (used by fork).
+ */
+void
+proc_setParent(int childPid, int parentPid)
+{
+	struct procEntry *child, *parent;
+
+	lock_acquire(waitPidLock);
+	child = getProcess(childPid);
+	parent = getProcess(parentPid);
+	KASSERT(child != NULL && parent != NULL);
+	KASSERT(child->parentId == P_NOID);
+	child->parentId = parentPid;
+	child->siblingId = parent->childId;
+	parent->childId = childPid;
+	lock_release(waitPidLock);
+}
+
+/*
+ * Throw away the entry of a process that never got to run, e.g. when
+ * fork fails after the child proc was created.
+ */
+void
+proc_discardEntry(int pid)
+{
+	struct procEntry *entry;
+
+	lock_acquire(waitPidLock);
+	entry = getProcess(pid);
+	KASSERT(entry != NULL);
+	KASSERT(entry->status == P_RUN && entry->childId == P_NOID);
+	proc_unlinkChild(entry);
+	proc_freeEntry(entry);
+	lock_release(waitPidLock);
+}
+
+/*
+ * Called by the parent in waitpid once it has collected the exit
+ * status of a zombie child. Caller holds waitPidLock.
+ */
+void
+proc_reapChild(struct procEntry *entry)
+{
+	KASSERT(lock_do_i_hold(waitPidLock));
+	KASSERT(entry->status == P_ZOMBIE);
+
+	proc_unlinkChild(entry);
+	proc_freeEntry(entry);
+}
+
+/*
+ * Called by an exiting process (sys__exit or a fatal trap). Each
+ * child has its own exitCV and only its parent ever sleeps on it, so
+ * an exit wakes exactly the one waitpid() that cares instead of every
+ * waiting parent in the system.
+ *
+ * A process nobody can wait for is reaped immediately; otherwise it
+ * stays a zombie until its parent waits for it or exits itself.
+ */
+void
+proc_signalExit(int pid, int exitcode)
+{
+	struct procEntry *entry;
+
+	lock_acquire(waitPidLock);
+	entry = getProcess(pid);
+	KASSERT(entry != NULL);
+	entry->exitCode = exitcode;
+	proc_orphanChildren(entry);
+	if (entry->parentId != P_NOID) {
+		/* keep the entry around until the parent collects it */
+		entry->status = P_ZOMBIE;
+		cv_broadcast(entry->exitCV, waitPidLock);
+	}
+	else {
+		entry->status = P_EXIT;
+		proc_freeEntry(entry);
+	}
+	lock_release(waitPidLock);
 }
 #endif
 /*
@@ -86,7 +283,7 @@ struct proc *
 proc_create(const char *name)
 {
 	struct proc *proc;
-	kprintf("creating new process");
+
 	proc = kmalloc(sizeof(*proc));
 	if (proc == NULL) {
 		return NULL;
@@ -107,29 +304,77 @@ proc_create(const char *name)
 	proc->p_cwd = NULL;
 
 #ifdef UW
-	proc->console = NULL;
+	proc->p_files = NULL;
+	proc->p_aring = NULL;
 #endif // UW
+	proc->pId = P_NOID;
+
+#if OPT_A2
+	proc->p_tlock = lock_create("proc-threads");
+	if (proc->p_tlock == NULL) {
+		kfree(proc->p_name);
+		kfree(proc);
+		return NULL;
+	}
+	proc->p_tcv = cv_create("thread-join");
+	if (proc->p_tcv == NULL) {
+		lock_destroy(proc->p_tlock);
+		kfree(proc->p_name);
+		kfree(proc);
+		return NULL;
+	}
+	/* the thread that will run the process is tid 0 */
+	for (unsigned i = 0; i < AS_MAXTHREADS; i++) {
+		proc->p_uthreads[i].ut_state = UT_FREE;
+		proc->p_uthreads[i].ut_exitval = 0;
+	}
+	proc->p_uthreads[0].ut_state = UT_RUN;
+	proc->p_nuthreads = 1;
+	proc->p_exiting = false;
+	proc->p_exitcode = 0;
+#endif
 
 	return proc;
 }
 
 #if OPT_A2
+/*
+ * Give proc a pid, reusing a reaped one if there is one. O(1) apart
+ * from the occasional array growth. Returns P_NOID if the table is
+ * full or out of memory. Caller holds ptLock.
+ */
 int 
 proc_assignNewPid(struct procEntry *proc) {
-	//if(q_empty(openEntries)) {
-	array_add(processTable, proc, NULL);
-	return array_num(processTable) - 1;
-	// } else {
-	// 	int *top = q_peek(openEntries);
-	// 	int idx = *top;
-	// 	DEBUG(DB_SYSCALL, "before queue idx : %d\n", idx);
-	// 	q_remhead(openEntries);
-	// 	kfree(top);
-	// 	kfree(array_get(processTable, idx));
-	// 	array_set(processTable, idx, proc);
-	// 	DEBUG(DB_SYSCALL, "queue idx : %d\n", idx);
-	// 	return idx;
-	// }
+	unsigned idx;
+	int pid, result;
+
+	KASSERT(lock_do_i_hold(ptLock));
+
+	if (!q_empty(freePids)) {
+		pid = QPTR_TO_PID(q_remhead(freePids));
+		KASSERT(array_get(processTable, pid) == NULL);
+		array_set(processTable, pid, proc);
+		return pid;
+	}
+
+	idx = array_num(processTable);
+	if (idx > PID_MAX) {
+		return P_NOID;
+	}
+	/*
+	 * Grow the free list along with the table so that every pid can
+	 * be returned to it later without allocating. (The queue keeps
+	 * one slot empty, hence the +2.)
+	 */
+	result = q_preallocate(freePids, idx + 2);
+	if (result) {
+		return P_NOID;
+	}
+	result = array_add(processTable, proc, &idx);
+	if (result) {
+		return P_NOID;
+	}
+	return idx;
 }
 #endif
 /*
@@ -162,16 +407,6 @@ proc_destroy(struct proc *proc)
 		proc->p_cwd = NULL;
 	}
 	
-	// struct procEntry *curEntry = NULL;
- //    for(unsigned int i = 0; i < array_num(processTable); i++) {	
- //    	curEntry = array_get(processTable, i);
-	// 	if(curEntry->pId == proc->pId) {
-	// 		//array_remove(processTable, i);
-	// 		kfree(curEntry);
-	//         break;
- //    	}	
- //    }
-
 #ifndef UW  // in the UW version, space destruction occurs in sys_exit, not here
 	if (proc->p_addrspace) {
 		/*
@@ -193,11 +428,18 @@ proc_destroy(struct proc *proc)
 #endif // UW
 
 #ifdef UW
-	if (proc->console) {
-	  vfs_close(proc->console);
+	/* torn down with the address space */
+	KASSERT(proc->p_aring == NULL);
+	if (proc->p_files) {
+	  filetable_destroy(proc->p_files);
 	}
 #endif // UW
 
+#if OPT_A2
+	cv_destroy(proc->p_tcv);
+	lock_destroy(proc->p_tlock);
+#endif
+
 	threadarray_cleanup(&proc->p_threads);
 	spinlock_cleanup(&proc->p_lock);
 
@@ -248,21 +490,27 @@ proc_bootstrap(void)
   	panic("Failed to create process table lock\n");
   }
 
-  waitPidLock = lock_create("process-table-lock");
+  waitPidLock = lock_create("waitpid-lock");
   if(waitPidLock == NULL) {
   	panic("Failed to create waitpid lock\n");
   }
-
-  ptCV = cv_create("process-table-cv");
-  if(ptCV == NULL) {
-  	panic("Failed to create process table cv\n");
-  }
   
   processTable = array_create();
-  array_init(processTable);
+  if (processTable == NULL) {
+  	panic("Failed to create process table\n");
+  }
+  /* pids below PID_MIN are never handed out; fork returns 0 to the child */
+  if (array_setsize(processTable, PID_MIN)) {
+  	panic("Failed to size process table\n");
+  }
+  for (unsigned i = 0; i < PID_MIN; i++) {
+  	array_set(processTable, i, NULL);
+  }
 
-  // openEntries = q_create(10);
-  // q_preallocate(openEntries, 10);
+  freePids = q_create(PID_MIN + 2);
+  if (freePids == NULL) {
+  	panic("Failed to create free pid list\n");
+  }
 
 #endif
 #endif // UW 
@@ -279,6 +527,8 @@ proc_create_runprogram(const char *name)
 {
 	struct proc *proc;
 	char *console_path;
+	struct openfile *of;
+	int fd;
 
 	proc = proc_create(name);
 	if (proc == NULL) {
@@ -286,15 +536,30 @@ proc_create_runprogram(const char *name)
 	}
 
 #ifdef UW
-	/* open the console - this should always succeed z*/
-	console_path = kstrdup("con:");
-	if (console_path == NULL) {
-	  panic("unable to copy console path name during process creation\n");
+	proc->p_files = filetable_create();
+	if (proc->p_files == NULL) {
+	  panic("unable to create file table during process creation\n");
 	}
-	if (vfs_open(console_path,O_WRONLY,0,&(proc->console))) {
-	  panic("unable to open the console during process creation\n");
+
+	/*
+	 * open the console as stdin, stdout and stderr - this should
+	 * always succeed. stdout and stderr share one open file. (fork
+	 * replaces these with the parent's files.)
+	 */
+	for (fd = STDIN_FILENO; fd <= STDOUT_FILENO; fd++) {
+	  console_path = kstrdup("con:");
+	  if (console_path == NULL) {
+	    panic("unable to copy console path name during process creation\n");
+	  }
+	  if (openfile_open(console_path, fd == STDIN_FILENO ? O_RDONLY : O_WRONLY,
+			    0, &of)) {
+	    panic("unable to open the console during process creation\n");
+	  }
+	  kfree(console_path);
+	  proc->p_files->ft_files[fd] = of;
 	}
-	kfree(console_path);
+	openfile_incref(of);
+	proc->p_files->ft_files[STDERR_FILENO] = of;
 #endif // UW
 	  
 	/* VM fields */
@@ -321,25 +586,45 @@ proc_create_runprogram(const char *name)
 #endif // UW
 
 #ifdef UW
+	/* increment the count of processes */
+        /* we are assuming that all procs, including those  created by fork(),
+           are created using a call to proc_create_runprogram  */
+	/* done first so that proc_destroy below can undo it on failure */
+	P(proc_count_mutex); 
+	proc_count++;
+	V(proc_count_mutex);
 
 		struct procEntry *pEntry = kmalloc(sizeof(struct procEntry));
+		if (pEntry == NULL) {
+			proc_destroy(proc);
+			return NULL;
+		}
+		pEntry->exitCV = cv_create("exit-cv");
+		if (pEntry->exitCV == NULL) {
+			kfree(pEntry);
+			proc_destroy(proc);
+			return NULL;
+		}
 		pEntry->status = P_RUN;
 		pEntry->exitCode = 0;
 		pEntry->parentId = P_NOID;
+		pEntry->childId = P_NOID;
+		pEntry->siblingId = P_NOID;
 
 		lock_acquire(ptLock);
 		pEntry->pId = proc_assignNewPid(pEntry);
 		DEBUG(DB_SYSCALL, "pid: %d\n", pEntry->pId);
 		DEBUG(DB_SYSCALL, "numEntries: %d\n", array_num(processTable));
 		lock_release(ptLock);
+		if (pEntry->pId == P_NOID) {
+			cv_destroy(pEntry->exitCV);
+			kfree(pEntry);
+			proc_destroy(proc);
+			return NULL;
+		}
 
 		proc->pId = pEntry->pId;
-	/* increment the count of processes */
-        /* we are assuming that all procs, including those  created by fork(),
-           are created using a call to proc_create_runprogram  */
-	P(proc_count_mutex); 
-	proc_count++;
-	V(proc_count_mutex);
+		TRACE(TRC_PROC, TE_PROCCREATE, proc->pId, 0);
 #endif // UW
 
 	return proc;
@@ -49,6 +49,10 @@
 #include <syscall.h>
 #include <test.h>
 #include <version.h>
+#include <workqueue.h>
+#include <prof.h>
+#include <trace.h>
+#include <futex.h>
 #include "autoconf.h"  // for pseudoconfig
 
 
@@ -110,6 +114,8 @@ boot(void)
 	proc_bootstrap();
 	thread_bootstrap();
 	hardclock_bootstrap();
+	workqueue_bootstrap();
+	futex_bootstrap();
 	vfs_bootstrap();
 
 	/* Probe and initialize devices. Interrupts should come on. */
@@ -124,6 +130,10 @@ boot(void)
 	/* Late phase of initialization. */
 	vm_bootstrap();
 	kprintf_bootstrap();
+	workqueue_cpu_start();
+	prof_cpu_start();
+	trace_cpu_start();
+	syscall_stats_cpu_start();
 	thread_start_cpus();
 
 	/* Default bootfs - but ignore failure, in case emu0 doesn't exist */
@@ -42,6 +42,9 @@
 #include <sfs.h>
 #include <syscall.h>
 #include <test.h>
+#include <workqueue.h>
+#include <prof.h>
+#include <trace.h>
 #include "opt-synchprobs.h"
 #include "opt-sfs.h"
 #include "opt-net.h"
@@ -144,6 +147,9 @@ common_prog(int nargs, char **args)
 			args /* thread arg */, nargs /* thread arg */);
 	if (result) {
 		kprintf("thread_fork failed: %s\n", strerror(result));
+#if OPT_A2
+		proc_discardEntry(proc->pId);
+#endif
 		proc_destroy(proc);
 		return result;
 	}
@@ -404,6 +410,139 @@ cmd_kheapstats(int nargs, char **args)
 	return 0;
 }
 
+static
+int
+cmd_wqstats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	workqueue_printstats();
+
+	return 0;
+}
+
+#if OPT_SFS
+static
+int
+cmd_sfsstats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	sfs_bufstats_print();
+
+	return 0;
+}
+#endif
+
+/*
+ * Command for the sampling profiler.
+ */
+static
+int
+cmd_prof(int nargs, char **args)
+{
+	unsigned ntop = 20;
+
+	if (nargs == 2 && !strcmp(args[1], "start")) {
+		prof_start();
+		kprintf("Profiling started\n");
+		return 0;
+	}
+	if (nargs == 2 && !strcmp(args[1], "stop")) {
+		prof_stop();
+		kprintf("Profiling stopped\n");
+		return 0;
+	}
+	if ((nargs == 2 || nargs == 3) && !strcmp(args[1], "dump")) {
+		if (nargs == 3) {
+			ntop = atoi(args[2]);
+		}
+		prof_dump(ntop);
+		return 0;
+	}
+	kprintf("Usage: prof start | stop | dump [count]\n");
+	return EINVAL;
+}
+
+/*
+ * Command for system call statistics.
+ */
+static
+int
+cmd_scstats(int nargs, char **args)
+{
+	if (nargs == 1) {
+		syscall_stats_print();
+		return 0;
+	}
+	if (nargs == 3 && !strcmp(args[1], "timing")) {
+		if (!strcmp(args[2], "on")) {
+			syscall_timing = true;
+			return 0;
+		}
+		if (!strcmp(args[2], "off")) {
+			syscall_timing = false;
+			return 0;
+		}
+	}
+	if (nargs == 2 && !strcmp(args[1], "clear")) {
+		syscall_stats_clear();
+		return 0;
+	}
+	kprintf("Usage: sc [timing on | timing off | clear]\n");
+	return EINVAL;
+}
+
+/*
+ * Command for the event trace.
+ */
+static
+int
+cmd_trace(int nargs, char **args)
+{
+	uint32_t mask, m;
+	int i, result;
+
+	if (nargs >= 2 && !strcmp(args[1], "on")) {
+		mask = (nargs == 2) ? TRC_ALL : 0;
+		for (i=2; i<nargs; i++) {
+			m = trace_category(args[i]);
+			if (m == 0) {
+				kprintf("trace: unknown category %s\n",
+					args[i]);
+				return EINVAL;
+			}
+			mask |= m;
+		}
+		trace_mask |= mask;
+		return 0;
+	}
+	if (nargs == 2 && !strcmp(args[1], "off")) {
+		trace_mask = 0;
+		return 0;
+	}
+	if (nargs == 2 && !strcmp(args[1], "clear")) {
+		trace_clear();
+		return 0;
+	}
+	if ((nargs == 2 || nargs == 3) && !strcmp(args[1], "dump")) {
+		trace_dump(nargs == 3 ? (unsigned)atoi(args[2]) : 100);
+		return 0;
+	}
+	if (nargs == 3 && !strcmp(args[1], "save")) {
+		result = trace_save(args[2]);
+		if (result) {
+			kprintf("trace save: %s\n", strerror(result));
+		}
+		return result;
+	}
+	kprintf("Usage: trace on [sched syscall fault disk wakeup lock proc]\n");
+	kprintf("       trace off | clear | dump [count] | save file\n");
+	return EINVAL;
+}
+
 ////////////////////////////////////////
 //
 // Menus.
@@ -474,6 +613,7 @@ static const char *testmenu[] = {
 	"[sy1] Semaphore test                ",
 	"[sy2] Lock test             (1)     ",
 	"[sy3] CV test               (1)     ",
+	"[slb] Spinlock contention bench     ",
 #ifdef UW
 	"[uw1] UW lock test          (1)     ",
 	"[uw2] UW vmstats test       (3)     ",
@@ -514,6 +654,13 @@ static const char *mainmenu[] = {
 #endif /* UW */
 #endif
 	"[kh] Kernel heap stats              ",
+	"[wq] Work queue stats               ",
+#if OPT_SFS
+	"[bc] SFS buffer cache stats         ",
+#endif
+	"[prof] Sampling profiler            ",
+	"[trace] Kernel event trace          ",
+	"[sc] System call stats              ",
 	"[q] Quit and shut down              ",
 	NULL
 };
@@ -571,6 +718,13 @@ static struct {
 
 	/* stats */
 	{ "kh",         cmd_kheapstats },
+	{ "wq",         cmd_wqstats },
+#if OPT_SFS
+	{ "bc",		cmd_sfsstats },
+#endif
+	{ "prof",	cmd_prof },
+	{ "trace",	cmd_trace },
+	{ "sc",		cmd_scstats },
 
 	/* base system tests */
 	{ "at",		arraytest },
@@ -588,6 +742,7 @@ static struct {
 	/* synchronization assignment tests */
 	{ "sy2",	locktest },
 	{ "sy3",	cvtest },
+	{ "slb",	spinlockbench },
 #ifdef UW
 	{ "uw1",	uwlocktest1 },
 	{ "uw2",	uwvmstatstest },
@@ -0,0 +1,443 @@
+/*
+ * Asynchronous I/O rings. See aring.h and kern/aring.h.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/aring.h>
+#include <kern/poll.h>
+#include <lib.h>
+#include <uio.h>
+#include <synch.h>
+#include <thread.h>
+#include <current.h>
+#include <proc.h>
+#include <addrspace.h>
+#include <vm.h>
+#include <vnode.h>
+#include <filetable.h>
+#include <pollq.h>
+#include <syscall.h>
+#include <aring.h>
+
+/* Pages an ARING_MAXLEN transfer can touch, if it isn't aligned. */
+#define ARING_MAXIOV	(ARING_MAXLEN / PAGE_SIZE + 1)
+
+struct aring_ctx {
+	struct proc *ar_proc;
+	struct addrspace *ar_as;
+	struct aring *ar_ring;		/* the process's page, through kseg0 */
+
+	/* our own copies of the kernel-owned counters */
+	uint32_t ar_sqhead;
+	uint32_t ar_cqtail;
+
+	struct lock *ar_lock;		/* protects everything below */
+	struct cv *ar_workcv;		/* the worker waits here for a kick */
+	struct cv *ar_donecv;		/* aring_enter waits here */
+	bool ar_kicked;			/* aring_enter since the worker looked */
+	bool ar_busy;			/* worker is doing an operation */
+	bool ar_stopping;		/* aring_stop wants the worker gone */
+	bool ar_stopped;		/* ...and it is */
+
+	struct pollq ar_cancelq;	/* woken by aring_stop */
+};
+
+////////////////////////////////////////////////////////////
+// operations
+
+/*
+ * Wait until OF can be read or written without blocking, as poll()
+ * would, or until the ring is stopped, in which case return EINTR.
+ * This is what keeps a read from the console, or from a pipe nobody
+ * is going to write, from holding up aring_destroy forever.
+ */
+static
+int
+aring_waitready(struct aring_ctx *ar, struct openfile *of, enum uio_rw rw)
+{
+	struct pollset *ps;
+	bool registered, stopping;
+	int events, rev, result;
+
+	events = (rw == UIO_READ) ? POLLIN : POLLOUT;
+
+	/* one entry for the cancel queue, one for the object */
+	ps = pollset_create(2);
+	if (ps == NULL) {
+		return ENOMEM;
+	}
+	/* on the queue before looking, so aring_stop can't be missed */
+	pollq_register(&ar->ar_cancelq, ps);
+
+	registered = false;
+	for (;;) {
+		lock_acquire(ar->ar_lock);
+		stopping = ar->ar_stopping;
+		lock_release(ar->ar_lock);
+		if (stopping) {
+			result = EINTR;
+			break;
+		}
+		result = VOP_POLL(of->of_vnode, events,
+				  registered ? NULL : ps, &rev);
+		registered = true;
+		if (result || (rev & (events | POLLHUP | POLLERR)) != 0) {
+			break;
+		}
+		pollset_wait(ps);
+	}
+	pollset_destroy(ps);
+	return result;
+}
+
+/*
+ * Read or write OF for SQE. The buffer is reached through kseg0 one
+ * page at a time, since the worker isn't running in the process.
+ */
+static
+int
+aring_rw(struct aring_ctx *ar, const struct aring_sqe *sqe,
+	 struct openfile *of, enum uio_rw rw, int *retval)
+{
+	struct iovec iov[ARING_MAXIOV];
+	struct uio u;
+	vaddr_t va, page;
+	paddr_t pa;
+	size_t len, done, chunk;
+	unsigned n;
+	int result;
+
+	len = sqe->sqe_len;
+	if (len > ARING_MAXLEN) {
+		len = ARING_MAXLEN;
+	}
+
+	/* reading into memory needs it to be writable */
+	n = 0;
+	for (done = 0; done < len; done += chunk) {
+		va = (vaddr_t)sqe->sqe_buf + done;
+		page = va & PAGE_FRAME;
+		chunk = PAGE_SIZE - (va - page);
+		if (chunk > len - done) {
+			chunk = len - done;
+		}
+		result = vm_translate(ar->ar_as, page, rw == UIO_READ, &pa);
+		if (result) {
+			return result;
+		}
+		KASSERT(n < ARING_MAXIOV);
+		iov[n].iov_kbase = (void *)(PADDR_TO_KVADDR(pa) + (va - page));
+		iov[n].iov_len = chunk;
+		n++;
+	}
+
+	u.uio_iov = iov;
+	u.uio_iovcnt = n;
+	u.uio_offset = 0;
+	u.uio_resid = len;
+	u.uio_segflg = UIO_SYSSPACE;
+	u.uio_rw = rw;
+	u.uio_space = NULL;
+
+	result = aring_waitready(ar, of, rw);
+	if (result) {
+		return result;
+	}
+	result = openfile_io(of, &u, sqe->sqe_offset >= 0, sqe->sqe_offset);
+	if (result) {
+		return result;
+	}
+	*retval = len - u.uio_resid;
+	return 0;
+}
+
+/*
+ * Do one submission on OF (NULL for operations without a file);
+ * returns the completion's cqe_res.
+ */
+static
+int32_t
+aring_do(struct aring_ctx *ar, const struct aring_sqe *sqe,
+	 struct openfile *of)
+{
+	int result, ret = 0;
+
+	if (sqe->sqe_reserved != 0) {
+		return -EINVAL;
+	}
+	switch (sqe->sqe_op) {
+	    case ARING_OP_NOP:
+		result = 0;
+		break;
+	    case ARING_OP_READ:
+		result = aring_rw(ar, sqe, of, UIO_READ, &ret);
+		break;
+	    case ARING_OP_WRITE:
+		result = aring_rw(ar, sqe, of, UIO_WRITE, &ret);
+		break;
+	    case ARING_OP_FSYNC:
+		result = VOP_FSYNC(of->of_vnode);
+		break;
+	    default:
+		result = EINVAL;
+		break;
+	}
+	return result ? -result : ret;
+}
+
+////////////////////////////////////////////////////////////
+// the worker
+
+/*
+ * Does SQE name a file descriptor? (Bad submissions don't, so that
+ * they fail with EINVAL whatever is in sqe_fd.)
+ */
+static
+bool
+aring_usesfile(const struct aring_sqe *sqe)
+{
+	if (sqe->sqe_reserved != 0) {
+		return false;
+	}
+	switch (sqe->sqe_op) {
+	    case ARING_OP_READ:
+	    case ARING_OP_WRITE:
+	    case ARING_OP_FSYNC:
+		return true;
+	}
+	return false;
+}
+
+/*
+ * Take submissions in order, as long as there is somewhere to put the
+ * completion, and sleep when there's nothing to do. Everything read
+ * from the ring is the process's to scribble on, so it is copied
+ * before use and only our own counters are trusted.
+ *
+ * The file is looked up while holding ar_lock and not stopping: an
+ * exiting process closes its descriptors once aring_stop returns,
+ * without waiting for us.
+ */
+static
+void
+aring_worker(void *data1, unsigned long data2)
+{
+	struct aring_ctx *ar = data1;
+	struct aring *ring = ar->ar_ring;
+	struct aring_sqe sqe;
+	struct aring_cqe *cqe;
+	struct openfile *of;
+	int32_t res;
+	int result;
+
+	(void)data2;
+
+	lock_acquire(ar->ar_lock);
+	while (!ar->ar_stopping) {
+		if (ring->sq_tail == ar->ar_sqhead ||
+		    ar->ar_cqtail - ring->cq_head >= ARING_ENTRIES) {
+			while (!ar->ar_kicked && !ar->ar_stopping) {
+				cv_wait(ar->ar_workcv, ar->ar_lock);
+			}
+			ar->ar_kicked = false;
+			continue;
+		}
+
+		sqe = ring->sqes[ar->ar_sqhead % ARING_ENTRIES];
+		ar->ar_sqhead++;
+		ring->sq_head = ar->ar_sqhead;
+		ar->ar_busy = true;
+		of = NULL;
+		result = 0;
+		if (aring_usesfile(&sqe)) {
+			result = filetable_get(ar->ar_proc->p_files,
+					       sqe.sqe_fd, &of);
+		}
+		lock_release(ar->ar_lock);
+
+		if (result) {
+			res = -result;
+		}
+		else {
+			res = aring_do(ar, &sqe, of);
+		}
+		if (of != NULL) {
+			openfile_decref(of);
+		}
+
+		lock_acquire(ar->ar_lock);
+		cqe = &ring->cqes[ar->ar_cqtail % ARING_ENTRIES];
+		cqe->cqe_data = sqe.sqe_data;
+		cqe->cqe_res = res;
+		/* the entry has to be there before the process can see it */
+		ar->ar_cqtail++;
+		ring->cq_tail = ar->ar_cqtail;
+		ar->ar_busy = false;
+		cv_broadcast(ar->ar_donecv, ar->ar_lock);
+	}
+	ar->ar_stopped = true;
+	cv_broadcast(ar->ar_donecv, ar->ar_lock);
+	lock_release(ar->ar_lock);
+}
+
+static
+void
+aring_free(struct aring_ctx *ar)
+{
+	pollq_cleanup(&ar->ar_cancelq);
+	cv_destroy(ar->ar_donecv);
+	cv_destroy(ar->ar_workcv);
+	lock_destroy(ar->ar_lock);
+	kfree(ar);
+}
+
+void
+aring_stop(struct proc *p)
+{
+	struct aring_ctx *ar = p->p_aring;
+
+	if (ar == NULL) {
+		return;
+	}
+
+	lock_acquire(ar->ar_lock);
+	ar->ar_stopping = true;
+	cv_signal(ar->ar_workcv, ar->ar_lock);
+	/* threads in aring_enter stop waiting too */
+	cv_broadcast(ar->ar_donecv, ar->ar_lock);
+	lock_release(ar->ar_lock);
+	/* and out of any wait for a file to become ready */
+	pollq_wakeup(&ar->ar_cancelq);
+}
+
+void
+aring_destroy(struct proc *p)
+{
+	struct aring_ctx *ar = p->p_aring;
+
+	if (ar == NULL) {
+		return;
+	}
+	aring_stop(p);
+	p->p_aring = NULL;
+
+	lock_acquire(ar->ar_lock);
+	while (!ar->ar_stopped) {
+		cv_wait(ar->ar_donecv, ar->ar_lock);
+	}
+	lock_release(ar->ar_lock);
+	aring_free(ar);
+}
+
+////////////////////////////////////////////////////////////
+// system calls
+
+/* handler for aring_setup() system call */
+int
+sys_aring_setup(userptr_t uring)
+{
+	struct proc *p = curproc;
+	struct aring_ctx *ar;
+	paddr_t pa;
+	int result;
+
+	KASSERT(sizeof(struct aring) <= PAGE_SIZE);
+
+	if (((vaddr_t)uring & ~PAGE_FRAME) != 0) {
+		return EINVAL;
+	}
+	ar = kmalloc(sizeof(*ar));
+	if (ar == NULL) {
+		return ENOMEM;
+	}
+	result = vm_translate(p->p_addrspace, (vaddr_t)uring, true, &pa);
+	if (result) {
+		kfree(ar);
+		return result;
+	}
+	ar->ar_proc = p;
+	ar->ar_as = p->p_addrspace;
+	ar->ar_ring = (struct aring *)PADDR_TO_KVADDR(pa);
+	ar->ar_sqhead = 0;
+	ar->ar_cqtail = 0;
+	ar->ar_kicked = false;
+	ar->ar_busy = false;
+	ar->ar_stopping = false;
+	ar->ar_stopped = false;
+	pollq_init(&ar->ar_cancelq);
+	ar->ar_lock = lock_create("aring");
+	ar->ar_workcv = cv_create("aring-work");
+	ar->ar_donecv = cv_create("aring-done");
+	if (ar->ar_lock == NULL || ar->ar_workcv == NULL ||
+	    ar->ar_donecv == NULL) {
+		if (ar->ar_donecv != NULL) {
+			cv_destroy(ar->ar_donecv);
+		}
+		if (ar->ar_workcv != NULL) {
+			cv_destroy(ar->ar_workcv);
+		}
+		if (ar->ar_lock != NULL) {
+			lock_destroy(ar->ar_lock);
+		}
+		pollq_cleanup(&ar->ar_cancelq);
+		kfree(ar);
+		return ENOMEM;
+	}
+	bzero(ar->ar_ring, sizeof(struct aring));
+
+	/* one ring per process */
+	spinlock_acquire(&p->p_lock);
+	if (p->p_aring != NULL) {
+		spinlock_release(&p->p_lock);
+		aring_free(ar);
+		return EBUSY;
+	}
+	p->p_aring = ar;
+	spinlock_release(&p->p_lock);
+
+	result = thread_fork("aring", kproc, aring_worker, ar, 0);
+	if (result) {
+		spinlock_acquire(&p->p_lock);
+		p->p_aring = NULL;
+		spinlock_release(&p->p_lock);
+		aring_free(ar);
+		return result;
+	}
+	return 0;
+}
+
+/*
+ * handler for aring_enter() system call: wake the worker, then wait
+ * for MIN_COMPLETE completions to be ready, or for the worker to run
+ * out of work, and return how many are ready.
+ */
+int
+sys_aring_enter(unsigned min_complete, int *retval)
+{
+	struct aring_ctx *ar = curproc->p_aring;
+	struct aring *ring;
+	uint32_t ready;
+
+	if (ar == NULL) {
+		return EINVAL;
+	}
+	ring = ar->ar_ring;
+	if (min_complete > ARING_ENTRIES) {
+		min_complete = ARING_ENTRIES;
+	}
+
+	lock_acquire(ar->ar_lock);
+	ar->ar_kicked = true;
+	cv_signal(ar->ar_workcv, ar->ar_lock);
+	while (ar->ar_cqtail - ring->cq_head < min_complete &&
+	       (ar->ar_busy || ring->sq_tail != ar->ar_sqhead) &&
+	       !ar->ar_stopping) {
+		cv_wait(ar->ar_donecv, ar->ar_lock);
+	}
+	ready = ar->ar_cqtail - ring->cq_head;
+	lock_release(ar->ar_lock);
+
+	*retval = ready > ARING_ENTRIES ? ARING_ENTRIES : ready;
+	return 0;
+}
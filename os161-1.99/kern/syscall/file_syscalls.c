@@ -1,60 +1,810 @@
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <kern/poll.h>
+#include <kern/seek.h>
+#include <kern/stat.h>
 #include <kern/unistd.h>
+#include <limits.h>
 #include <lib.h>
 #include <uio.h>
 #include <syscall.h>
 #include <vnode.h>
 #include <vfs.h>
+#include <synch.h>
 #include <current.h>
 #include <proc.h>
+#include <copyinout.h>
+#include <clock.h>
+#include <vm.h>
+#include <filetable.h>
+#include <pollq.h>
+#include <pipe.h>
 
-/* handler for write() system call                  */
 /*
- * n.b.
- * This implementation handles only writes to standard output 
- * and standard error, both of which go to the console.
- * Also, it does not provide any synchronization, so writes
- * are not atomic.
- *
- * You will need to improve this implementation
+ * File system calls. Descriptors are looked up in curproc->p_files;
+ * see filetable.h for how open files are shared and locked.
  */
 
+/* handler for open() system call */
+int
+sys_open(userptr_t upath, int flags, mode_t mode, int *retval)
+{
+  struct openfile *of;
+  char *path;
+  int fd, res;
+
+  path = kmalloc(PATH_MAX);
+  if (path == NULL) {
+    return ENOMEM;
+  }
+  res = copyinstr(upath, path, PATH_MAX, NULL);
+  if (res) {
+    kfree(path);
+    return res;
+  }
+
+  /* vfs_open destroys the path */
+  res = openfile_open(path, flags, mode, &of);
+  kfree(path);
+  if (res) {
+    return res;
+  }
+
+  res = filetable_place(curproc->p_files, of, &fd);
+  if (res) {
+    openfile_decref(of);
+    return res;
+  }
+  *retval = fd;
+  return 0;
+}
+
+/*
+ * Common code for all the read and write calls: transfer to or from
+ * the IOVCNT user buffers in IOV, at the file's offset or, if USEPOS,
+ * at POS.
+ */
+static
+int
+file_rw(int fdesc, struct iovec *iov, unsigned iovcnt, size_t nbytes,
+        enum uio_rw rw, bool usepos, off_t pos, int *retval)
+{
+  struct openfile *of;
+  struct uio u;
+  int res;
+
+  res = filetable_get(curproc->p_files, fdesc, &of);
+  if (res) {
+    return res;
+  }
+
+  /* set up a uio structure to refer to the user program's buffers */
+  u.uio_iov = iov;
+  u.uio_iovcnt = iovcnt;
+  u.uio_resid = nbytes;
+  u.uio_segflg = UIO_USERSPACE;
+  u.uio_rw = rw;
+  u.uio_space = curproc->p_addrspace;
+
+  res = openfile_io(of, &u, usepos, pos);
+  openfile_decref(of);
+  if (res) {
+    return res;
+  }
+
+  /* pass back the number of bytes actually transferred */
+  *retval = nbytes - u.uio_resid;
+  KASSERT(*retval >= 0);
+  return 0;
+}
+
+/* handler for read() system call */
+int
+sys_read(int fdesc,userptr_t ubuf,unsigned int nbytes,int *retval)
+{
+  struct iovec iov;
+
+  iov.iov_ubase = ubuf;
+  iov.iov_len = nbytes;
+  return file_rw(fdesc, &iov, 1, nbytes, UIO_READ, false, 0, retval);
+}
+
+/* handler for write() system call */
 int
 sys_write(int fdesc,userptr_t ubuf,unsigned int nbytes,int *retval)
 {
   struct iovec iov;
+
+  iov.iov_ubase = ubuf;
+  iov.iov_len = nbytes;
+  return file_rw(fdesc, &iov, 1, nbytes, UIO_WRITE, false, 0, retval);
+}
+
+/* handler for pread() system call; leaves the file offset alone */
+int
+sys_pread(int fdesc, userptr_t ubuf, size_t nbytes, off_t pos, int *retval)
+{
+  struct iovec iov;
+
+  iov.iov_ubase = ubuf;
+  iov.iov_len = nbytes;
+  return file_rw(fdesc, &iov, 1, nbytes, UIO_READ, true, pos, retval);
+}
+
+/* handler for pwrite() system call; leaves the file offset alone */
+int
+sys_pwrite(int fdesc, userptr_t ubuf, size_t nbytes, off_t pos, int *retval)
+{
+  struct iovec iov;
+
+  iov.iov_ubase = ubuf;
+  iov.iov_len = nbytes;
+  return file_rw(fdesc, &iov, 1, nbytes, UIO_WRITE, true, pos, retval);
+}
+
+/*
+ * Vectors of up to this many buffers are copied in on the stack;
+ * only longer ones need kmalloc.
+ */
+#define SMALL_IOVCNT 8
+
+/*
+ * Common code for readv() and writev(): copy the whole iovec array
+ * in at once and hand it to file_rw as a single uio.
+ */
+static
+int
+file_rwv(int fdesc, userptr_t uiov, int iovcnt, enum uio_rw rw, int *retval)
+{
+  struct iovec small[SMALL_IOVCNT];
+  struct iovec *iov;
+  size_t nbytes;
+  int i, res;
+
+  if (iovcnt <= 0 || iovcnt > IOV_MAX) {
+    return EINVAL;
+  }
+  if (iovcnt <= SMALL_IOVCNT) {
+    iov = small;
+  }
+  else {
+    iov = kmalloc(iovcnt * sizeof(struct iovec));
+    if (iov == NULL) {
+      return ENOMEM;
+    }
+  }
+
+  res = copyin(uiov, iov, iovcnt * sizeof(struct iovec));
+  if (res) {
+    goto out;
+  }
+
+  /* the total has to fit in the (int) return value */
+  nbytes = 0;
+  for (i = 0; i < iovcnt; i++) {
+    if (iov[i].iov_len > (size_t)0x7fffffff - nbytes) {
+      res = EINVAL;
+      goto out;
+    }
+    nbytes += iov[i].iov_len;
+  }
+
+  res = file_rw(fdesc, iov, iovcnt, nbytes, rw, false, 0, retval);
+
+ out:
+  if (iov != small) {
+    kfree(iov);
+  }
+  return res;
+}
+
+/* handler for readv() system call */
+int
+sys_readv(int fdesc, userptr_t iov, int iovcnt, int *retval)
+{
+  return file_rwv(fdesc, iov, iovcnt, UIO_READ, retval);
+}
+
+/* handler for writev() system call */
+int
+sys_writev(int fdesc, userptr_t iov, int iovcnt, int *retval)
+{
+  return file_rwv(fdesc, iov, iovcnt, UIO_WRITE, retval);
+}
+
+/* handler for close() system call */
+int
+sys_close(int fdesc)
+{
+  struct openfile *of;
+  int res;
+
+  res = filetable_remove(curproc->p_files, fdesc, &of);
+  if (res) {
+    return res;
+  }
+  openfile_decref(of);
+  return 0;
+}
+
+/* handler for lseek() system call */
+int
+sys_lseek(int fdesc, off_t pos, int whence, off_t *retval)
+{
+  struct openfile *of;
+  struct stat st;
+  off_t newpos;
+  int res;
+
+  res = filetable_get(curproc->p_files, fdesc, &of);
+  if (res) {
+    return res;
+  }
+  if (of->of_offsetlock == NULL) {
+    openfile_decref(of);
+    return ESPIPE;
+  }
+
+  lock_acquire(of->of_offsetlock);
+  switch (whence) {
+  case SEEK_SET:
+    newpos = pos;
+    break;
+  case SEEK_CUR:
+    newpos = of->of_offset + pos;
+    break;
+  case SEEK_END:
+    res = VOP_STAT(of->of_vnode, &st);
+    newpos = st.st_size + pos;
+    break;
+  default:
+    res = EINVAL;
+    break;
+  }
+  if (!res && newpos < 0) {
+    res = EINVAL;
+  }
+  if (!res) {
+    res = VOP_TRYSEEK(of->of_vnode, newpos);
+  }
+  if (!res) {
+    of->of_offset = newpos;
+    *retval = newpos;
+  }
+  lock_release(of->of_offsetlock);
+
+  openfile_decref(of);
+  return res;
+}
+
+/* handler for dup2() system call */
+int
+sys_dup2(int oldfd, int newfd, int *retval)
+{
+  struct openfile *of, *old;
+  int res;
+
+  res = filetable_get(curproc->p_files, oldfd, &of);
+  if (res) {
+    return res;
+  }
+  if (oldfd == newfd) {
+    openfile_decref(of);
+    *retval = newfd;
+    return 0;
+  }
+
+  /* the reference from filetable_get becomes the new slot's */
+  res = filetable_setfd(curproc->p_files, newfd, of, &old);
+  if (res) {
+    openfile_decref(of);
+    return res;
+  }
+  if (old != NULL) {
+    openfile_decref(old);
+  }
+  *retval = newfd;
+  return 0;
+}
+
+/*
+ * handler for getdirentry() system call: read the next name from a
+ * directory. The file offset is the filesystem's cursor, not a byte
+ * count, and moves past the entry returned.
+ */
+int
+sys_getdirentry(int fdesc, userptr_t ubuf, size_t buflen, int *retval)
+{
+  struct openfile *of;
+  struct iovec iov;
   struct uio u;
   int res;
 
-  DEBUG(DB_SYSCALL,"Syscall: write(%d,%x,%d)\n",fdesc,(unsigned int)ubuf,nbytes);
-  
-  /* only stdout and stderr writes are currently implemented */
-  if (!((fdesc==STDOUT_FILENO)||(fdesc==STDERR_FILENO))) {
-    return EUNIMP;
+  res = filetable_get(curproc->p_files, fdesc, &of);
+  if (res) {
+    return res;
+  }
+  if (of->of_accmode == O_WRONLY) {
+    openfile_decref(of);
+    return EBADF;
   }
-  KASSERT(curproc != NULL);
-  KASSERT(curproc->console != NULL);
-  KASSERT(curproc->p_addrspace != NULL);
 
-  /* set up a uio structure to refer to the user program's buffer (ubuf) */
   iov.iov_ubase = ubuf;
-  iov.iov_len = nbytes;
+  iov.iov_len = buflen;
   u.uio_iov = &iov;
   u.uio_iovcnt = 1;
-  u.uio_offset = 0;  /* not needed for the console */
-  u.uio_resid = nbytes;
+  u.uio_resid = buflen;
   u.uio_segflg = UIO_USERSPACE;
-  u.uio_rw = UIO_WRITE;
+  u.uio_rw = UIO_READ;
   u.uio_space = curproc->p_addrspace;
+  u.uio_ra = NULL;
 
-  res = VOP_WRITE(curproc->console,&u);
+  if (of->of_offsetlock == NULL) {
+    /* not a directory; let the object say so */
+    u.uio_offset = 0;
+    res = VOP_GETDIRENTRY(of->of_vnode, &u);
+  }
+  else {
+    lock_acquire(of->of_offsetlock);
+    u.uio_offset = of->of_offset;
+    res = VOP_GETDIRENTRY(of->of_vnode, &u);
+    if (!res) {
+      of->of_offset = u.uio_offset;
+    }
+    lock_release(of->of_offsetlock);
+  }
+  openfile_decref(of);
   if (res) {
     return res;
   }
 
-  /* pass back the number of bytes actually written */
-  *retval = nbytes - u.uio_resid;
-  KASSERT(*retval >= 0);
+  *retval = buflen - u.uio_resid;
+  return 0;
+}
+
+/*
+ * copy_file_range moves data through a kernel buffer this big, so
+ * it never crosses the user boundary at all, unless the filesystem
+ * can copy by itself (see VOP_COPYFROM), in which case it is asked
+ * for this much at a time, so as not to hold the offsets (and the
+ * filesystem) for the whole copy.
+ */
+#define COPY_CHUNK PAGE_SIZE
+#define COPY_DIRECTMAX (64 * 1024)
+
+/*
+ * Move LEN bytes between KBUF and OF, at POS if USEPOS and otherwise
+ * at the file offset; the count actually moved goes in *MOVED.
+ */
+static
+int
+copy_io(struct openfile *of, void *kbuf, size_t len, enum uio_rw rw,
+        bool usepos, off_t pos, size_t *moved)
+{
+  struct iovec iov;
+  struct uio u;
+  int res;
+
+  uio_kinit(&iov, &u, kbuf, len, 0, rw);
+  res = openfile_io(of, &u, usepos, pos);
+  *moved = len - u.uio_resid;
+  return res;
+}
+
+/*
+ * Copy up to LEN bytes from IN to OUT with VOP_COPYFROM. Positions
+ * are *INPOS and *OUTPOS if USEINPOS/USEOUTPOS, and the file offsets
+ * otherwise; either way they are advanced by what was copied, which
+ * goes in *DONE. Returns EXDEV, having done nothing, when the
+ * filesystem can't do it.
+ */
+static
+int
+copy_direct(struct openfile *in, bool useinpos, off_t *inpos,
+            struct openfile *out, bool useoutpos, off_t *outpos,
+            size_t len, size_t *done)
+{
+  struct lock *first, *second, *tmp;
+  struct stat st;
+  off_t from, to;
+  size_t n, moved;
+  int res;
+
+  *done = 0;
+  /* pipes and the console have no positions to copy between */
+  if (in->of_offsetlock == NULL || out->of_offsetlock == NULL) {
+    return EXDEV;
+  }
+  if (in->of_accmode == O_WRONLY || out->of_accmode == O_RDONLY) {
+    return EBADF;
+  }
+  if ((useinpos && *inpos < 0) || (useoutpos && *outpos < 0)) {
+    return EINVAL;
+  }
+
+  /*
+   * The offsets used are locked in address order, so two copies
+   * going opposite ways between the same open files can't deadlock.
+   */
+  first = useinpos ? NULL : in->of_offsetlock;
+  second = useoutpos ? NULL : out->of_offsetlock;
+  if (first == NULL || (second != NULL && (vaddr_t)second < (vaddr_t)first)) {
+    tmp = first;
+    first = second;
+    second = tmp;
+  }
+
+  res = 0;
+  while (*done < len) {
+    n = len - *done;
+    if (n > COPY_DIRECTMAX) {
+      n = COPY_DIRECTMAX;
+    }
+
+    if (first != NULL) {
+      lock_acquire(first);
+    }
+    if (second != NULL) {
+      lock_acquire(second);
+    }
+    from = useinpos ? *inpos : in->of_offset;
+    if (useoutpos) {
+      to = *outpos;
+    }
+    else {
+      if (out->of_append) {
+        res = VOP_STAT(out->of_vnode, &st);
+        if (!res) {
+          out->of_offset = st.st_size;
+        }
+      }
+      to = out->of_offset;
+    }
+    moved = 0;
+    if (!res) {
+      res = VOP_COPYFROM(out->of_vnode, to, in->of_vnode, from, n, &moved);
+    }
+    if (useinpos) {
+      *inpos += moved;
+    }
+    else {
+      in->of_offset += moved;
+    }
+    if (useoutpos) {
+      *outpos += moved;
+    }
+    else {
+      out->of_offset += moved;
+    }
+    if (second != NULL) {
+      lock_release(second);
+    }
+    if (first != NULL) {
+      lock_release(first);
+    }
+
+    *done += moved;
+    /* short means the end of the source */
+    if (res || moved < n) {
+      break;
+    }
+  }
+  return res;
+}
+
+/*
+ * Copy up to LEN bytes from IN to OUT through a kernel buffer, for
+ * whatever VOP_COPYFROM can't do. Positions are as for copy_direct.
+ */
+static
+int
+copy_bounce(struct openfile *in, bool useinpos, off_t *inpos,
+            struct openfile *out, bool useoutpos, off_t *outpos,
+            size_t len, size_t *done)
+{
+  off_t start;
+  size_t n, got, put, moved;
+  char *kbuf;
+  int res;
+
+  *done = 0;
+  kbuf = kmalloc(COPY_CHUNK);
+  if (kbuf == NULL) {
+    return ENOMEM;
+  }
+
+  res = 0;
+  while (*done < len) {
+    /*
+     * Size the first transfer to end on a chunk boundary of the
+     * source so the rest are block-aligned. (The unlocked peek at
+     * the offset is only a hint.)
+     */
+    start = useinpos ? *inpos : in->of_offset;
+    n = COPY_CHUNK - (size_t)(start % COPY_CHUNK);
+    if (n > len - *done) {
+      n = len - *done;
+    }
+
+    res = copy_io(in, kbuf, n, UIO_READ, useinpos, *inpos, &got);
+    if (res || got == 0) {
+      break;
+    }
+    *inpos += got;
+
+    for (put = 0; put < got; put += moved) {
+      res = copy_io(out, kbuf + put, got - put, UIO_WRITE,
+                    useoutpos, *outpos, &moved);
+      if (!res && moved == 0) {
+        res = EIO;
+      }
+      if (res) {
+        break;
+      }
+      *outpos += moved;
+    }
+    *done += put;
+    if (res) {
+      /* put back what was read but never written */
+      *inpos -= got - put;
+      if (!useinpos && in->of_offsetlock != NULL) {
+        lock_acquire(in->of_offsetlock);
+        in->of_offset -= got - put;
+        lock_release(in->of_offsetlock);
+      }
+      break;
+    }
+  }
+  kfree(kbuf);
+  return res;
+}
+
+/*
+ * handler for copy_file_range() system call: copy up to LEN bytes
+ * from INFD to OUTFD without bouncing them through user space. A
+ * null INPOS/OUTPOS means use (and advance) that file's offset, so
+ * pipes and the console work too, as with sendfile; otherwise the
+ * position is read from and written back to user memory and the
+ * file offset is left alone. Between two files on SFS the data goes
+ * from one file's cached blocks straight to the other's.
+ */
+int
+sys_copy_file_range(int infd, userptr_t uinpos, int outfd, userptr_t uoutpos,
+                    size_t len, int *retval)
+{
+  struct openfile *in, *out;
+  off_t inpos = 0, outpos = 0;
+  size_t done;
+  int res;
+
+  if (len > 0x7fffffff) {
+    len = 0x7fffffff;
+  }
+  if (uinpos != NULL) {
+    res = copyin(uinpos, &inpos, sizeof(inpos));
+    if (res) {
+      return res;
+    }
+  }
+  if (uoutpos != NULL) {
+    res = copyin(uoutpos, &outpos, sizeof(outpos));
+    if (res) {
+      return res;
+    }
+  }
+
+  res = filetable_get(curproc->p_files, infd, &in);
+  if (res) {
+    return res;
+  }
+  res = filetable_get(curproc->p_files, outfd, &out);
+  if (res) {
+    openfile_decref(in);
+    return res;
+  }
+  /* copying a file onto itself could chase its own tail */
+  if (in->of_vnode == out->of_vnode) {
+    res = EINVAL;
+    goto out;
+  }
+
+  res = copy_direct(in, uinpos != NULL, &inpos, out, uoutpos != NULL,
+                    &outpos, len, &done);
+  if (res == EXDEV) {
+    res = copy_bounce(in, uinpos != NULL, &inpos, out, uoutpos != NULL,
+                      &outpos, len, &done);
+  }
+
+  /* like write, report a partial copy rather than the error behind it */
+  if (done > 0) {
+    res = 0;
+  }
+  if (!res && uinpos != NULL) {
+    res = copyout(&inpos, uinpos, sizeof(inpos));
+  }
+  if (!res && uoutpos != NULL) {
+    res = copyout(&outpos, uoutpos, sizeof(outpos));
+  }
+  if (!res) {
+    *retval = done;
+  }
+
+ out:
+  openfile_decref(in);
+  openfile_decref(out);
+  return res;
+}
+
+/* handler for pipe() system call */
+int
+sys_pipe(userptr_t ufds, int *retval)
+{
+  struct vnode *rvn, *wvn;
+  struct openfile *rof, *wof, *dummy;
+  int fds[2];
+  int res;
+
+  res = pipe_create(&rvn, &wvn);
+  if (res) {
+    return res;
+  }
+  res = openfile_create(rvn, O_RDONLY, &rof);
+  if (res) {
+    vfs_close(rvn);
+    vfs_close(wvn);
+    return res;
+  }
+  res = openfile_create(wvn, O_WRONLY, &wof);
+  if (res) {
+    openfile_decref(rof);
+    vfs_close(wvn);
+    return res;
+  }
+
+  res = filetable_place(curproc->p_files, rof, &fds[0]);
+  if (res) {
+    openfile_decref(rof);
+    openfile_decref(wof);
+    return res;
+  }
+  res = filetable_place(curproc->p_files, wof, &fds[1]);
+  if (res) {
+    /* as below: fds[0] may already be gone, taking rof with it */
+    if (filetable_remove(curproc->p_files, fds[0], &dummy) == 0) {
+      openfile_decref(dummy);
+    }
+    openfile_decref(wof);
+    return res;
+  }
+
+  res = copyout(fds, ufds, sizeof(fds));
+  if (res) {
+    /* another thread may have closed them already; that's its lookout */
+    if (filetable_remove(curproc->p_files, fds[0], &dummy) == 0) {
+      openfile_decref(dummy);
+    }
+    if (filetable_remove(curproc->p_files, fds[1], &dummy) == 0) {
+      openfile_decref(dummy);
+    }
+    return res;
+  }
+  *retval = 0;
   return 0;
 }
+
+/*
+ * Most descriptors one poll() call may ask about. This only bounds
+ * the kernel memory a call uses; the same descriptor may appear more
+ * than once.
+ */
+#define POLL_MAXFDS 1024
+
+/*
+ * handler for poll() system call. Every object is checked once and
+ * registers the call on its wait queue; after that the call sleeps
+ * until one of them (or the timeout) wakes it and checks again, so
+ * nothing is scanned while it waits. TIMEOUT is in milliseconds, and
+ * negative means forever.
+ */
+int
+sys_poll(userptr_t ufds, unsigned nfds, int timeout, int *retval)
+{
+  struct pollfd *fds;
+  struct openfile **ofs;
+  struct pollset *ps;
+  uint64_t ticks;
+  unsigned i;
+  bool registered, timedout;
+  int n, res, rev;
+
+  if (nfds > POLL_MAXFDS) {
+    return EINVAL;
+  }
+  /* one extra so nfds == 0 (just sleep) needs no special case */
+  fds = kmalloc((nfds + 1) * sizeof(*fds));
+  if (fds == NULL) {
+    return ENOMEM;
+  }
+  ofs = kmalloc((nfds + 1) * sizeof(*ofs));
+  if (ofs == NULL) {
+    kfree(fds);
+    return ENOMEM;
+  }
+  res = copyin(ufds, fds, nfds * sizeof(*fds));
+  if (res) {
+    kfree(ofs);
+    kfree(fds);
+    return res;
+  }
+
+  /* look each descriptor up once; NULL means POLLNVAL */
+  for (i = 0; i < nfds; i++) {
+    if (fds[i].fd < 0 ||
+        filetable_get(curproc->p_files, fds[i].fd, &ofs[i])) {
+      ofs[i] = NULL;
+    }
+  }
+
+  ps = NULL;
+  if (timeout != 0) {
+    ps = pollset_create(nfds);
+    if (ps == NULL) {
+      res = ENOMEM;
+      goto out;
+    }
+    if (timeout > 0) {
+      ticks = ((uint64_t)timeout * 1000 + LT_GRANULARITY - 1) /
+        LT_GRANULARITY;
+      pollset_settimeout(ps, ticks > 0x7fffffff ? 0x7fffffff : ticks);
+    }
+  }
+
+  registered = timedout = false;
+  for (;;) {
+    n = 0;
+    for (i = 0; i < nfds; i++) {
+      fds[i].revents = 0;
+      if (fds[i].fd < 0) {
+        continue;
+      }
+      if (ofs[i] == NULL) {
+        fds[i].revents = POLLNVAL;
+        n++;
+        continue;
+      }
+      res = VOP_POLL(ofs[i]->of_vnode, fds[i].events,
+                     registered ? NULL : ps, &rev);
+      if (res) {
+        goto out;
+      }
+      fds[i].revents = rev & (fds[i].events | POLLERR | POLLHUP);
+      if (fds[i].revents != 0) {
+        n++;
+      }
+    }
+    registered = true;
+    if (n > 0 || ps == NULL || timedout) {
+      break;
+    }
+    timedout = pollset_wait(ps);
+  }
+
+  res = copyout(fds, ufds, nfds * sizeof(*fds));
+  if (!res) {
+    *retval = n;
+  }
+
+ out:
+  if (ps != NULL) {
+    pollset_destroy(ps);
+  }
+  for (i = 0; i < nfds; i++) {
+    if (ofs[i] != NULL) {
+      openfile_decref(ofs[i]);
+    }
+  }
+  kfree(ofs);
+  kfree(fds);
+  return res;
+}
@@ -0,0 +1,302 @@
+/*
+ * Open files and file descriptor tables. See filetable.h.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <kern/stat.h>
+#include <lib.h>
+#include <uio.h>
+#include <synch.h>
+#include <vnode.h>
+#include <vfs.h>
+#include <filetable.h>
+
+////////////////////////////////////////////////////////////
+// open files
+
+int
+openfile_open(char *path, int flags, mode_t mode, struct openfile **ret)
+{
+	struct vnode *vn;
+	int result;
+
+	result = vfs_open(path, flags, mode, &vn);
+	if (result) {
+		return result;
+	}
+	result = openfile_create(vn, flags, ret);
+	if (result) {
+		vfs_close(vn);
+		return result;
+	}
+	return 0;
+}
+
+int
+openfile_create(struct vnode *vn, int flags, struct openfile **ret)
+{
+	struct openfile *of;
+
+	of = kmalloc(sizeof(*of));
+	if (of == NULL) {
+		return ENOMEM;
+	}
+	of->of_vnode = vn;
+	of->of_accmode = flags & O_ACCMODE;
+	of->of_append = (flags & O_APPEND) != 0;
+	of->of_offset = 0;
+	bzero(&of->of_ra, sizeof(of->of_ra));
+
+	/* devices like the console have no offset to protect */
+	if (VOP_TRYSEEK(vn, 0) == ESPIPE) {
+		of->of_offsetlock = NULL;
+	}
+	else {
+		of->of_offsetlock = lock_create("openfile");
+		if (of->of_offsetlock == NULL) {
+			kfree(of);
+			return ENOMEM;
+		}
+	}
+
+	spinlock_init(&of->of_reflock);
+	of->of_refcount = 1;
+
+	*ret = of;
+	return 0;
+}
+
+void
+openfile_incref(struct openfile *of)
+{
+	spinlock_acquire(&of->of_reflock);
+	of->of_refcount++;
+	spinlock_release(&of->of_reflock);
+}
+
+void
+openfile_decref(struct openfile *of)
+{
+	bool last;
+
+	spinlock_acquire(&of->of_reflock);
+	KASSERT(of->of_refcount > 0);
+	of->of_refcount--;
+	last = (of->of_refcount == 0);
+	spinlock_release(&of->of_reflock);
+
+	if (!last) {
+		return;
+	}
+
+	vfs_close(of->of_vnode);
+	if (of->of_offsetlock != NULL) {
+		lock_destroy(of->of_offsetlock);
+	}
+	spinlock_cleanup(&of->of_reflock);
+	kfree(of);
+}
+
+int
+openfile_io(struct openfile *of, struct uio *uio, bool usepos, off_t pos)
+{
+	struct stat st;
+	int result;
+
+	if (uio->uio_rw == UIO_READ) {
+		if (of->of_accmode == O_WRONLY) {
+			return EBADF;
+		}
+		/* only seekable files have a position to read ahead of */
+		uio->uio_ra = of->of_offsetlock != NULL ? &of->of_ra : NULL;
+	}
+	else {
+		if (of->of_accmode == O_RDONLY) {
+			return EBADF;
+		}
+		uio->uio_ra = NULL;
+	}
+
+	if (of->of_offsetlock == NULL) {
+		if (usepos) {
+			return ESPIPE;
+		}
+		uio->uio_offset = 0;
+		goto doio;
+	}
+	if (usepos) {
+		/* leaves the shared offset alone, so no need to lock it */
+		if (pos < 0) {
+			return EINVAL;
+		}
+		uio->uio_offset = pos;
+		goto doio;
+	}
+
+	lock_acquire(of->of_offsetlock);
+	if (uio->uio_rw == UIO_WRITE && of->of_append) {
+		result = VOP_STAT(of->of_vnode, &st);
+		if (result) {
+			lock_release(of->of_offsetlock);
+			return result;
+		}
+		of->of_offset = st.st_size;
+	}
+	uio->uio_offset = of->of_offset;
+	if (uio->uio_rw == UIO_READ) {
+		result = VOP_READ(of->of_vnode, uio);
+	}
+	else {
+		result = VOP_WRITE(of->of_vnode, uio);
+	}
+	/* a partial transfer still moves the offset */
+	of->of_offset = uio->uio_offset;
+	lock_release(of->of_offsetlock);
+	return result;
+
+ doio:
+	if (uio->uio_rw == UIO_READ) {
+		return VOP_READ(of->of_vnode, uio);
+	}
+	return VOP_WRITE(of->of_vnode, uio);
+}
+
+////////////////////////////////////////////////////////////
+// file tables
+
+struct filetable *
+filetable_create(void)
+{
+	struct filetable *ft;
+	unsigned i;
+
+	ft = kmalloc(sizeof(*ft));
+	if (ft == NULL) {
+		return NULL;
+	}
+	spinlock_init(&ft->ft_lock);
+	for (i=0; i<OPEN_MAX; i++) {
+		ft->ft_files[i] = NULL;
+	}
+	return ft;
+}
+
+void
+filetable_destroy(struct filetable *ft)
+{
+	unsigned i;
+
+	/* nobody else can be using it, so no locking */
+	for (i=0; i<OPEN_MAX; i++) {
+		if (ft->ft_files[i] != NULL) {
+			openfile_decref(ft->ft_files[i]);
+			ft->ft_files[i] = NULL;
+		}
+	}
+	spinlock_cleanup(&ft->ft_lock);
+	kfree(ft);
+}
+
+void
+filetable_copy(struct filetable *src, struct filetable *dst)
+{
+	struct openfile *old[OPEN_MAX];
+	unsigned i;
+
+	/* DST is new and private to the caller; SRC may be in use */
+	spinlock_acquire(&src->ft_lock);
+	for (i=0; i<OPEN_MAX; i++) {
+		old[i] = dst->ft_files[i];
+		dst->ft_files[i] = src->ft_files[i];
+		if (dst->ft_files[i] != NULL) {
+			openfile_incref(dst->ft_files[i]);
+		}
+	}
+	spinlock_release(&src->ft_lock);
+
+	/* closing may sleep, so not under the spinlock */
+	for (i=0; i<OPEN_MAX; i++) {
+		if (old[i] != NULL) {
+			openfile_decref(old[i]);
+		}
+	}
+}
+
+int
+filetable_get(struct filetable *ft, int fd, struct openfile **ret)
+{
+	struct openfile *of;
+
+	if (fd < 0 || fd >= OPEN_MAX) {
+		return EBADF;
+	}
+
+	spinlock_acquire(&ft->ft_lock);
+	of = ft->ft_files[fd];
+	if (of != NULL) {
+		openfile_incref(of);
+	}
+	spinlock_release(&ft->ft_lock);
+
+	if (of == NULL) {
+		return EBADF;
+	}
+	*ret = of;
+	return 0;
+}
+
+int
+filetable_place(struct filetable *ft, struct openfile *of, int *fd)
+{
+	unsigned i;
+
+	spinlock_acquire(&ft->ft_lock);
+	for (i=0; i<OPEN_MAX; i++) {
+		if (ft->ft_files[i] == NULL) {
+			ft->ft_files[i] = of;
+			spinlock_release(&ft->ft_lock);
+			*fd = i;
+			return 0;
+		}
+	}
+	spinlock_release(&ft->ft_lock);
+	return EMFILE;
+}
+
+int
+filetable_setfd(struct filetable *ft, int fd, struct openfile *of,
+		struct openfile **oldret)
+{
+	if (fd < 0 || fd >= OPEN_MAX) {
+		return EBADF;
+	}
+
+	spinlock_acquire(&ft->ft_lock);
+	*oldret = ft->ft_files[fd];
+	ft->ft_files[fd] = of;
+	spinlock_release(&ft->ft_lock);
+	return 0;
+}
+
+int
+filetable_remove(struct filetable *ft, int fd, struct openfile **ret)
+{
+	struct openfile *of;
+
+	if (fd < 0 || fd >= OPEN_MAX) {
+		return EBADF;
+	}
+
+	spinlock_acquire(&ft->ft_lock);
+	of = ft->ft_files[fd];
+	ft->ft_files[fd] = NULL;
+	spinlock_release(&ft->ft_lock);
+
+	if (of == NULL) {
+		return EBADF;
+	}
+	*ret = of;
+	return 0;
+}
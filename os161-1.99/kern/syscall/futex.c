@@ -0,0 +1,237 @@
+/*
+ * futex_wait and futex_wake. See futex.h.
+ *
+ * Each hash bucket has a sleep lock, held while the user word is
+ * read so the check and the sleep are atomic with respect to
+ * futex_wake. The sleeper locks the entry's wchan before dropping
+ * the bucket lock, as the semaphore code does, so a wakeup can't
+ * slip in between.
+ *
+ * The waker does the bookkeeping: it decrements fx_nwaiters for each
+ * thread it wakes and frees the entry once nobody is left, so a woken
+ * thread never touches the entry again.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <synch.h>
+#include <wchan.h>
+#include <current.h>
+#include <proc.h>
+#include <addrspace.h>
+#include <copyinout.h>
+#include <syscall.h>
+#include <futex.h>
+#include "opt-A2.h"
+
+/* must be a power of 2 */
+#define FUTEX_HASHSIZE 64
+
+struct futex {
+	struct addrspace *fx_as;	/* key: address space... */
+	vaddr_t fx_addr;		/* ...and user address */
+	struct wchan *fx_wchan;		/* sleepers */
+	unsigned fx_nwaiters;		/* threads not yet woken */
+	struct futex *fx_next;		/* bucket chain */
+};
+
+struct futexbucket {
+	struct lock *fb_lock;
+	struct futex *fb_head;
+};
+
+static struct futexbucket futextable[FUTEX_HASHSIZE];
+
+static
+struct futexbucket *
+futex_bucket(struct addrspace *as, vaddr_t addr)
+{
+	uint32_t h;
+
+	h = (addr >> 2) ^ ((uintptr_t)as >> 4);
+	h ^= h >> 16;
+	return &futextable[h & (FUTEX_HASHSIZE - 1)];
+}
+
+/*
+ * Find the entry for (AS, ADDR) in FB, optionally creating it.
+ * Caller holds fb_lock. Returns NULL if absent (or out of memory).
+ */
+static
+struct futex *
+futex_lookup(struct futexbucket *fb, struct addrspace *as, vaddr_t addr,
+	     bool create)
+{
+	struct futex *fx;
+
+	KASSERT(lock_do_i_hold(fb->fb_lock));
+
+	for (fx = fb->fb_head; fx != NULL; fx = fx->fx_next) {
+		if (fx->fx_as == as && fx->fx_addr == addr) {
+			return fx;
+		}
+	}
+	if (!create) {
+		return NULL;
+	}
+
+	fx = kmalloc(sizeof(*fx));
+	if (fx == NULL) {
+		return NULL;
+	}
+	fx->fx_wchan = wchan_create("futex");
+	if (fx->fx_wchan == NULL) {
+		kfree(fx);
+		return NULL;
+	}
+	fx->fx_as = as;
+	fx->fx_addr = addr;
+	fx->fx_nwaiters = 0;
+	fx->fx_next = fb->fb_head;
+	fb->fb_head = fx;
+	return fx;
+}
+
+/*
+ * Wake up to N sleepers on FX, and free it if that was all of them.
+ * Caller holds fb_lock. Returns the number woken.
+ */
+static
+unsigned
+futex_wake_locked(struct futexbucket *fb, struct futex *fx, unsigned n)
+{
+	struct futex **prevp;
+	unsigned woken;
+
+	KASSERT(lock_do_i_hold(fb->fb_lock));
+
+	for (woken = 0; woken < n && fx->fx_nwaiters > 0; woken++) {
+		fx->fx_nwaiters--;
+		wchan_wakeone(fx->fx_wchan);
+	}
+
+	if (fx->fx_nwaiters == 0) {
+		for (prevp = &fb->fb_head; *prevp != fx;
+		     prevp = &(*prevp)->fx_next) {
+			KASSERT(*prevp != NULL);
+		}
+		*prevp = fx->fx_next;
+		wchan_destroy(fx->fx_wchan);
+		kfree(fx);
+	}
+	return woken;
+}
+
+void
+futex_bootstrap(void)
+{
+	unsigned i;
+
+	for (i=0; i<FUTEX_HASHSIZE; i++) {
+		futextable[i].fb_lock = lock_create("futex-bucket");
+		if (futextable[i].fb_lock == NULL) {
+			panic("futex_bootstrap: out of memory\n");
+		}
+		futextable[i].fb_head = NULL;
+	}
+}
+
+void
+futex_wakeall_as(struct addrspace *as)
+{
+	struct futexbucket *fb;
+	struct futex *fx, *next;
+	unsigned i;
+
+	for (i=0; i<FUTEX_HASHSIZE; i++) {
+		fb = &futextable[i];
+		lock_acquire(fb->fb_lock);
+		for (fx = fb->fb_head; fx != NULL; fx = next) {
+			next = fx->fx_next;
+			if (fx->fx_as == as) {
+				futex_wake_locked(fb, fx, fx->fx_nwaiters);
+			}
+		}
+		lock_release(fb->fb_lock);
+	}
+}
+
+/*
+ * futex_wait: sleep until woken by futex_wake on ADDR, provided the
+ * word at ADDR still contains VAL. Returns EAGAIN at once if it does
+ * not. Callers must expect spurious returns and recheck.
+ */
+int
+sys_futex_wait(userptr_t addr, int val)
+{
+	struct addrspace *as = curproc_getas();
+	struct futexbucket *fb;
+	struct futex *fx;
+	int cur, result;
+
+	if ((vaddr_t)addr % sizeof(int) != 0) {
+		return EINVAL;
+	}
+
+	fb = futex_bucket(as, (vaddr_t)addr);
+	lock_acquire(fb->fb_lock);
+
+	/*
+	 * futex_wakeall_as runs after p_exiting is set, so checking it
+	 * under the bucket lock means an exiting process can't leave
+	 * anyone asleep here.
+	 */
+#if OPT_A2
+	if (curproc->p_exiting) {
+		lock_release(fb->fb_lock);
+		return EINTR;
+	}
+#endif
+
+	result = copyin(addr, &cur, sizeof(int));
+	if (result) {
+		lock_release(fb->fb_lock);
+		return result;
+	}
+	if (cur != val) {
+		lock_release(fb->fb_lock);
+		return EAGAIN;
+	}
+
+	fx = futex_lookup(fb, as, (vaddr_t)addr, true);
+	if (fx == NULL) {
+		lock_release(fb->fb_lock);
+		return ENOMEM;
+	}
+	fx->fx_nwaiters++;
+
+	wchan_lock(fx->fx_wchan);
+	lock_release(fb->fb_lock);
+	wchan_sleep(fx->fx_wchan);
+	/* fx may be gone now */
+	return 0;
+}
+
+/*
+ * futex_wake: wake up to N threads sleeping on ADDR. Returns the
+ * number woken.
+ */
+int
+sys_futex_wake(userptr_t addr, int n, int *retval)
+{
+	struct addrspace *as = curproc_getas();
+	struct futexbucket *fb;
+	struct futex *fx;
+
+	if ((vaddr_t)addr % sizeof(int) != 0 || n < 0) {
+		return EINVAL;
+	}
+
+	fb = futex_bucket(as, (vaddr_t)addr);
+	lock_acquire(fb->fb_lock);
+	fx = futex_lookup(fb, as, (vaddr_t)addr, false);
+	*retval = fx ? futex_wake_locked(fb, fx, n) : 0;
+	lock_release(fb->fb_lock);
+	return 0;
+}
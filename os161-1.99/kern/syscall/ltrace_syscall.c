@@ -0,0 +1,48 @@
+/*
+ * ltrace: trace161 controls for user programs, so a benchmark can
+ * mark out and profile exactly the code it cares about.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/ltrace.h>
+#include <lib.h>
+#include <syscall.h>
+#include <lamebus/ltrace.h>
+
+int
+sys_ltrace(int op, uint32_t code)
+{
+	switch (op) {
+	    case LTR_TRACEON:
+		ltrace_on(code);
+		break;
+	    case LTR_TRACEOFF:
+		ltrace_off(code);
+		break;
+	    case LTR_DEBUG:
+		ltrace_debug(code);
+		break;
+	    case LTR_DUMP:
+		ltrace_dump(code);
+		break;
+	    case LTR_PROFON:
+		ltrace_setprof(1);
+		break;
+	    case LTR_PROFOFF:
+		ltrace_setprof(0);
+		break;
+	    case LTR_PROFCLEAR:
+		ltrace_eraseprof();
+		break;
+	    case LTR_BEGIN:
+		ltrace_region_begin(code);
+		break;
+	    case LTR_END:
+		ltrace_region_end(code);
+		break;
+	    default:
+		return EINVAL;
+	}
+	return 0;
+}
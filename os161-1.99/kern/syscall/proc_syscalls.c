@@ -16,28 +16,21 @@
 #include <vm.h>
 #include <test.h>
 #include <kern/fcntl.h>
+#include <trace.h>
+#include <filetable.h>
+#include <aring.h>
   /* this implementation of sys__exit does not do anything with the exit code */
   /* this needs to be fixed to get exit() and waitpid() working properly */
 
 void sys__exit(int exitcode) {
+  #if OPT_A2
+  DEBUG(DB_SYSCALL,"Syscall: _exit(%d)\n",exitcode);
+  /* the last thread to leave reports the exit and frees the process */
+  uthread_exitall(exitcode);
+  uthread_leave();
+  #else
   struct addrspace *as;
   struct proc *p = curproc;
-  #if OPT_A2
-  lock_acquire(waitPidLock);
-  struct procEntry *curEntry = getProcess(p->pId);
-  curEntry->exitCode = exitcode;
-  if(curEntry->parentId != P_NOID) {
-    //struct procEntry *parent = getProcess(curEntry->parentId);
-    //if(parent != NULL) {
-      curEntry->status = P_ZOMBIE;
-      cv_broadcast(ptCV, waitPidLock);
-    //}
-  }
-  curEntry->status = P_EXIT;
-  //removeProcess(curEntry->pid);
-
-  lock_release(waitPidLock);
-  #endif
   DEBUG(DB_SYSCALL,"Syscall: _exit(%d)\n",exitcode);
 
   KASSERT(curproc->p_addrspace != NULL);
@@ -61,6 +54,7 @@ void sys__exit(int exitcode) {
   proc_destroy(p);
   
   thread_exit();
+  #endif
   /* thread_exit() does not return, so we should never get here */
   panic("return from thread_exit in sys_exit\n");
 }
@@ -70,43 +64,60 @@ void sys__exit(int exitcode) {
 pid_t 
 sys_fork(struct trapframe *curTf, pid_t *retval) {
   struct proc *p = curproc;
-  kprintf("fork pid %d \n", (int)p->pId);
   // Create new process and assign process id to child
   struct proc *childProc = proc_create_runprogram(p->p_name);
-  struct procEntry *childEntry = getProcess(childProc->pId);
-  kprintf("fork childpid %d \n", (int)childProc->pId);
-  childEntry->parentId = p->pId;
   if(childProc == NULL) {
     DEBUG(DB_SYSCALL, "fork error, unable to make new process.\n");
     return ENOMEM;
   }
+  TRACE(TRC_PROC, TE_FORK, p->pId, childProc->pId);
+
+  /* the child shares the parent's open files, offsets and all */
+  filetable_copy(p->p_files, childProc->p_files);
+  proc_setParent(childProc->pId, p->pId);
 
   // Copy address space from parent (curProcess) to child
   as_copy(curproc_getas(), &(childProc->p_addrspace));
 
   if(childProc->p_addrspace == NULL) {
     DEBUG(DB_SYSCALL, "error copying address space from parent to child \n");
-    kfree(childEntry);
+    proc_discardEntry(childProc->pId);
     proc_destroy(childProc);
     return ENPROC;
   }
+
+  /*
+   * The child's only thread keeps the forking thread's id, so that it
+   * keeps running on the same user stack.
+   */
+  int tid = curthread->t_utid;
+  if (tid != 0) {
+    vaddr_t stackptr;
+
+    childProc->p_uthreads[0].ut_state = UT_FREE;
+    childProc->p_uthreads[tid].ut_state = UT_RUN;
+    /* the pages were copied already; this just marks the slot used */
+    as_define_thread_stack(childProc->p_addrspace, tid, &stackptr);
+  }
   //as_activate();
   //curproc_setas(childProc->p_addrspace);
 
   struct trapframe *newTf = kmalloc(sizeof(struct trapframe));
   if(newTf == NULL) {
     DEBUG(DB_SYSCALL, "error creating trap frame\n");
-    kfree(childEntry);
+    as_destroy(childProc->p_addrspace);
+    proc_discardEntry(childProc->pId);
     proc_destroy(childProc);
     return ENOMEM;
   }
   memcpy(newTf,curTf, sizeof(struct trapframe));
   DEBUG(DB_SYSCALL, "trap frame copied\n");
 
-  int err = thread_fork(curthread->t_name, childProc, &enter_forked_process, (void *)newTf, 0);
+  int err = thread_fork(curthread->t_name, childProc, &enter_forked_process, (void *)newTf, tid);
   if(err) {
     kfree(newTf);
-    kfree(childEntry);
+    as_destroy(childProc->p_addrspace);
+    proc_discardEntry(childProc->pId);
     proc_destroy(childProc);
     return err;
   }
@@ -139,7 +150,7 @@ sys_waitpid(pid_t pid,
   int exitstatus;
   int result;
 
-  if (options != 0) {
+  if (options != 0 && options != WNOHANG) {
     return(EINVAL);
   }
 
@@ -151,14 +162,16 @@ sys_waitpid(pid_t pid,
     return ECHILD;
   }
 
-  // if (options == WNOHANG && childProc->status != P_EXIT) {
-  //   lock_release(waitPidLock);
-  //   return ECHILD;
-  // }
+  if (options == WNOHANG && childProc->status == P_RUN) {
+    /* child still running: report "nothing yet" rather than blocking */
+    lock_release(waitPidLock);
+    *retval = 0;
+    return(0);
+  }
   DEBUG(DB_SYSCALL, "waiting for PID %d \n", pid);
   while(childProc->status == P_RUN) {
     DEBUG(DB_SYSCALL, "waiting for child %d \n", childProc->pId);
-    cv_wait(ptCV, waitPidLock);
+    cv_wait(childProc->exitCV, waitPidLock);
   }
   DEBUG(DB_SYSCALL, "free from PID %d \n", pid);
   exitstatus = childProc->exitCode;
@@ -170,6 +183,8 @@ sys_waitpid(pid_t pid,
     return(result);
   }
   *retval = pid;
+  /* status collected; the child's pid can now be reused */
+  proc_reapChild(childProc);
   lock_release(waitPidLock);
   return(0);
 }
@@ -184,12 +199,21 @@ int sys_execv(const char *program, char **args) {
   int result;
 
   int argc = 0;
+  struct proc *p = curproc;
 
   //kprintf("inside execv \n");
   if(program == NULL) {
     kprintf(" PROGRAM IS NULL ! \n");
     return EFAULT;
   }
+
+  /* the other threads' stacks would vanish with the old address space */
+  lock_acquire(p->p_tlock);
+  if (p->p_nuthreads > 1) {
+    lock_release(p->p_tlock);
+    return EBUSY;
+  }
+  lock_release(p->p_tlock);
   // Count number of arguments
   while(args[argc] != NULL) {
     argc++;
@@ -286,9 +310,18 @@ int sys_execv(const char *program, char **args) {
   //   kfree(kernelargs[i]);
   // }
   // kfree(kernelargs);
+  /* an I/O ring lives in the old address space */
+  aring_destroy(p);
   as_destroy(as);
+
+  /* we are the only thread, and now run on the main stack */
+  lock_acquire(p->p_tlock);
+  p->p_uthreads[curthread->t_utid].ut_state = UT_FREE;
+  p->p_uthreads[0].ut_state = UT_RUN;
+  curthread->t_utid = 0;
+  lock_release(p->p_tlock);
   
-  kprintf("creating new process execv \n");
+  TRACE(TRC_PROC, TE_EXEC, p->pId, argc);
 
   /* Warp to user mode. */
    enter_new_process(argc /*argc*/, (userptr_t) stackptr /*userspace addr of argv*/,
@@ -0,0 +1,266 @@
+/*
+ * User-level threads: thread_create, thread_join and thread_exit.
+ *
+ * Every user thread is a kernel thread attached to the same process,
+ * sharing its address space; each gets its own user stack slot from
+ * as_define_thread_stack. The process goes away when its last thread
+ * does, and _exit (or a fatal fault) in any thread takes the whole
+ * process down: it sets p_exiting, and each remaining thread leaves
+ * the next time it enters the kernel (see mips_trap).
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <syscall.h>
+#include <current.h>
+#include <proc.h>
+#include <thread.h>
+#include <addrspace.h>
+#include <copyinout.h>
+#include <mips/trapframe.h>
+#include <synch.h>
+#include <futex.h>
+#include <aring.h>
+#include <filetable.h>
+#include "opt-A2.h"
+
+#if OPT_A2
+
+/*
+ * Detach the current thread from its process and exit. The last
+ * thread out tears the process down, reporting p_exitcode to the
+ * parent. Does not return.
+ */
+void
+uthread_leave(void)
+{
+  struct proc *p = curproc;
+  struct addrspace *as;
+  bool last;
+
+  KASSERT(p != NULL && p != kproc);
+
+  /*
+   * Detach first: once p_nuthreads is decremented another thread may
+   * find it is the last one and destroy p under us.
+   */
+  proc_remthread(curthread);
+
+  lock_acquire(p->p_tlock);
+  KASSERT(p->p_nuthreads > 0);
+  p->p_nuthreads--;
+  last = (p->p_nuthreads == 0);
+  lock_release(p->p_tlock);
+
+  if (last) {
+    proc_signalExit(p->pId, p->p_exitcode);
+
+    /*
+     * Nobody else uses the address space now; the ring worker goes
+     * first. Our descriptors are closed before waiting for it, so a
+     * pipe it is blocked on whose other end only we hold sees EOF or
+     * EPIPE.
+     */
+    aring_stop(p);
+    if (p->p_files != NULL) {
+      filetable_destroy(p->p_files);
+      p->p_files = NULL;
+    }
+    aring_destroy(p);
+    as_deactivate();
+    as = p->p_addrspace;
+    p->p_addrspace = NULL;
+    as_destroy(as);
+
+    /* if this is the last user process in the system, proc_destroy()
+       will wake up the kernel menu thread */
+    proc_destroy(p);
+  }
+
+  thread_exit();
+  /* thread_exit() does not return, so we should never get here */
+  panic("return from thread_exit in uthread_leave\n");
+}
+
+/*
+ * Start the whole process exiting with EXITCODE. The first caller's
+ * code wins. Threads sleeping in thread_join are woken so they can
+ * leave, and those in futex_wait or aring_enter return to user mode;
+ * the others notice in mips_trap.
+ */
+void
+uthread_exitall(int exitcode)
+{
+  struct proc *p = curproc;
+
+  lock_acquire(p->p_tlock);
+  if (!p->p_exiting) {
+    p->p_exiting = true;
+    p->p_exitcode = exitcode;
+  }
+  cv_broadcast(p->p_tcv, p->p_tlock);
+  lock_release(p->p_tlock);
+
+  futex_wakeall_as(p->p_addrspace);
+  /* a thread in aring_enter could otherwise wait forever */
+  aring_stop(p);
+}
+
+/*
+ * New threads start here, on their own kernel stack. tid arrives in
+ * data2.
+ */
+static
+void
+enter_new_thread(void *data1, unsigned long data2)
+{
+  struct trapframe *tf = data1;
+  struct trapframe newtf = *tf;
+
+  /* sys___thread_create allocated this copy for us */
+  kfree(tf);
+  curthread->t_utid = (int)data2;
+
+  /* epc already points at the start routine; don't advance it */
+  mips_usermode(&newtf);
+}
+
+/*
+ * thread_create: start a new thread in the current process at START,
+ * with ARG1 and ARG2 in a0 and a1, on a fresh user stack. The new
+ * thread's id is returned.
+ */
+int
+sys___thread_create(struct trapframe *tf, userptr_t start,
+                    userptr_t arg1, userptr_t arg2, int *retval)
+{
+  struct proc *p = curproc;
+  struct trapframe *newtf;
+  vaddr_t stackptr;
+  int tid, result;
+
+  if (start == NULL) {
+    return EFAULT;
+  }
+
+  newtf = kmalloc(sizeof(struct trapframe));
+  if (newtf == NULL) {
+    return ENOMEM;
+  }
+
+  /* held across thread_fork so a failure can be undone cleanly */
+  lock_acquire(p->p_tlock);
+
+  for (tid = 1; tid < AS_MAXTHREADS; tid++) {
+    if (p->p_uthreads[tid].ut_state == UT_FREE) {
+      break;
+    }
+  }
+  if (tid == AS_MAXTHREADS) {
+    lock_release(p->p_tlock);
+    kfree(newtf);
+    return EAGAIN;
+  }
+
+  result = as_define_thread_stack(p->p_addrspace, tid, &stackptr);
+  if (result) {
+    lock_release(p->p_tlock);
+    kfree(newtf);
+    return result;
+  }
+
+  /* same gp and status as the caller; everything else is new */
+  *newtf = *tf;
+  newtf->tf_epc = (vaddr_t)start;
+  newtf->tf_a0 = (vaddr_t)arg1;
+  newtf->tf_a1 = (vaddr_t)arg2;
+  newtf->tf_sp = stackptr;
+  newtf->tf_ra = 0;
+
+  result = thread_fork(curthread->t_name, p, enter_new_thread, newtf, tid);
+  if (result) {
+    as_release_thread_stack(p->p_addrspace, tid);
+    lock_release(p->p_tlock);
+    kfree(newtf);
+    return result;
+  }
+
+  p->p_uthreads[tid].ut_state = UT_RUN;
+  p->p_uthreads[tid].ut_exitval = 0;
+  p->p_nuthreads++;
+  lock_release(p->p_tlock);
+
+  *retval = tid;
+  return 0;
+}
+
+/*
+ * thread_join: wait for thread TID to exit and collect its exit value.
+ * Each thread can be joined once; its id (and stack) are reused after.
+ */
+int
+sys_thread_join(int tid, userptr_t status)
+{
+  struct proc *p = curproc;
+  int exitval;
+
+  if (tid < 0 || tid >= AS_MAXTHREADS) {
+    return ESRCH;
+  }
+  if (tid == curthread->t_utid) {
+    return EINVAL;
+  }
+
+  lock_acquire(p->p_tlock);
+  if (p->p_uthreads[tid].ut_state == UT_FREE) {
+    lock_release(p->p_tlock);
+    return ESRCH;
+  }
+  while (p->p_uthreads[tid].ut_state == UT_RUN && !p->p_exiting) {
+    cv_wait(p->p_tcv, p->p_tlock);
+  }
+  if (p->p_exiting) {
+    lock_release(p->p_tlock);
+    uthread_leave();
+  }
+  /* someone else may have joined it while we slept */
+  if (p->p_uthreads[tid].ut_state != UT_DONE) {
+    lock_release(p->p_tlock);
+    return ESRCH;
+  }
+  exitval = p->p_uthreads[tid].ut_exitval;
+  p->p_uthreads[tid].ut_state = UT_FREE;
+  if (tid != 0) {
+    as_release_thread_stack(p->p_addrspace, tid);
+  }
+  lock_release(p->p_tlock);
+
+  if (status != NULL) {
+    return copyout(&exitval, status, sizeof(int));
+  }
+  return 0;
+}
+
+/*
+ * thread_exit: end the calling thread, leaving EXITVAL for thread_join.
+ * If it was the last thread the process exits with status 0.
+ */
+void
+sys_thread_exit(int exitval)
+{
+  struct proc *p = curproc;
+  struct uthread *ut;
+
+  lock_acquire(p->p_tlock);
+  ut = &p->p_uthreads[curthread->t_utid];
+  KASSERT(ut->ut_state == UT_RUN);
+  ut->ut_state = UT_DONE;
+  ut->ut_exitval = exitval;
+  cv_broadcast(p->p_tcv, p->p_tlock);
+  lock_release(p->p_tlock);
+
+  uthread_leave();
+}
+
+#endif /* OPT_A2 */
@@ -0,0 +1,157 @@
+/*
+ * Spinlock contention benchmark.
+ *
+ * Starts a number of threads that all hammer on one spinlock with a
+ * short critical section, and reports the throughput and how evenly
+ * the lock was shared out. Build once with and once without "options
+ * ticketlock" and compare the two runs.
+ *
+ * Usage: slb [nthreads [iterations]]
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <cpu.h>
+#include <clock.h>
+#include <spinlock.h>
+#include <synch.h>
+#include <thread.h>
+#include <current.h>
+#include <test.h>
+#include "opt-ticketlock.h"
+
+#define SLB_MAXTHREADS		32
+#define SLB_DEFTHREADS		8
+#define SLB_DEFITERATIONS	20000
+#define SLB_CSWORK		8	/* work inside the lock */
+#define SLB_OUTWORK		32	/* work between acquires */
+
+static struct spinlock slb_lock;
+static volatile unsigned long slb_counter;
+static volatile bool slb_go;
+static struct semaphore *slb_donesem;
+static unsigned slb_iterations;
+
+/* per thread results */
+static uint64_t slb_nsecs[SLB_MAXTHREADS];
+static unsigned slb_cpu[SLB_MAXTHREADS];
+
+static
+void
+slb_thread(void *junk, unsigned long num)
+{
+	time_t s1, s2, secs;
+	uint32_t ns1, ns2, nsecs;
+	volatile unsigned j;
+	unsigned i;
+
+	(void)junk;
+
+	/*
+	 * Wait, runnable, for the starting gun so that the scheduler
+	 * has a chance to spread us over the cpus.
+	 */
+	while (!slb_go) {
+		thread_yield();
+	}
+
+	slb_cpu[num] = curcpu->c_number;
+	gettime(&s1, &ns1);
+	for (i=0; i<slb_iterations; i++) {
+		spinlock_acquire(&slb_lock);
+		for (j=0; j<SLB_CSWORK; j++) {
+			slb_counter++;
+		}
+		spinlock_release(&slb_lock);
+		for (j=0; j<SLB_OUTWORK; j++) {
+			/* nothing */
+		}
+	}
+	gettime(&s2, &ns2);
+	getinterval(s1, ns1, s2, ns2, &secs, &nsecs);
+	slb_nsecs[num] = (uint64_t)secs * 1000000000 + nsecs;
+
+	V(slb_donesem);
+}
+
+int
+spinlockbench(int nargs, char **args)
+{
+	unsigned nthreads, i;
+	uint64_t min, max;
+	char name[16];
+	int result;
+
+	nthreads = SLB_DEFTHREADS;
+	slb_iterations = SLB_DEFITERATIONS;
+	if (nargs > 1) {
+		nthreads = atoi(args[1]);
+	}
+	if (nargs > 2) {
+		slb_iterations = atoi(args[2]);
+	}
+	if (nthreads < 1 || nthreads > SLB_MAXTHREADS || slb_iterations < 1) {
+		kprintf("Usage: slb [nthreads (1-%d) [iterations]]\n",
+			SLB_MAXTHREADS);
+		return EINVAL;
+	}
+
+	slb_donesem = sem_create("slb-done", 0);
+	if (slb_donesem == NULL) {
+		return ENOMEM;
+	}
+	spinlock_init(&slb_lock);
+	slb_counter = 0;
+	slb_go = false;
+
+	kprintf("Spinlock benchmark (%s locks): %u threads, "
+		"%u acquires each\n",
+		OPT_TICKETLOCK ? "ticket" : "test-and-set",
+		nthreads, slb_iterations);
+
+	for (i=0; i<nthreads; i++) {
+		snprintf(name, sizeof(name), "slb%u", i);
+		result = thread_fork(name, NULL, slb_thread, NULL, i);
+		if (result) {
+			panic("spinlockbench: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+
+	/* let migration spread the threads out, then start them */
+	clocknap(TICKS_PER_SECOND / 4);
+	slb_go = true;
+
+	for (i=0; i<nthreads; i++) {
+		P(slb_donesem);
+	}
+
+	KASSERT(slb_counter ==
+		(unsigned long)nthreads * slb_iterations * SLB_CSWORK);
+
+	min = max = slb_nsecs[0];
+	for (i=0; i<nthreads; i++) {
+		kprintf("  thread %2u on cpu%u: %lu us\n", i, slb_cpu[i],
+			(unsigned long)(slb_nsecs[i] / 1000));
+		if (slb_nsecs[i] < min) {
+			min = slb_nsecs[i];
+		}
+		if (slb_nsecs[i] > max) {
+			max = slb_nsecs[i];
+		}
+	}
+	if (min == 0) {
+		min = 1;
+	}
+	/* the slowest thread finished last, so max is the elapsed time */
+	kprintf("%lu ns per acquire/release overall; "
+		"slowest/fastest thread %lu.%02lu\n",
+		(unsigned long)(max / ((uint64_t)nthreads * slb_iterations)),
+		(unsigned long)(max / min),
+		(unsigned long)((max * 100 / min) % 100));
+
+	spinlock_cleanup(&slb_lock);
+	sem_destroy(slb_donesem);
+	return 0;
+}
@@ -0,0 +1,165 @@
+/*
+ * Callouts on a hashed timing wheel. See callout.h.
+ *
+ * The wheel has CALLOUT_WHEELSIZE slots and advances one slot per
+ * timer tick. A callout due in TICKS ticks goes in the slot TICKS
+ * ahead of the current one, with c_rounds counting how many full
+ * turns of the wheel it still has to wait. Each tick visits only the
+ * current slot, so the cost per tick depends on how many callouts
+ * hash to that slot, not on how many are pending in total.
+ *
+ * Due callouts are taken off the wheel and marked running under the
+ * lock, then called with the lock released so that they can take
+ * other spinlocks (e.g. to wake a thread) and reschedule themselves.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <callout.h>
+
+/* must be a power of 2; 256 ticks is 2.56 seconds */
+#define CALLOUT_WHEELSIZE 256
+#define CALLOUT_WHEELMASK (CALLOUT_WHEELSIZE - 1)
+
+static struct spinlock callout_lock;
+static struct callout *callout_wheel[CALLOUT_WHEELSIZE];
+static uint32_t callout_now;	/* ticks since boot; protected by callout_lock */
+
+void
+callout_init(struct callout *c, void (*func)(void *), void *arg)
+{
+	c->c_func = func;
+	c->c_arg = arg;
+	c->c_next = NULL;
+	c->c_prevp = NULL;
+	c->c_duenext = NULL;
+	c->c_rounds = 0;
+	c->c_pending = false;
+	c->c_running = false;
+}
+
+/*
+ * Unlink C from its wheel slot. Caller holds callout_lock.
+ */
+static
+void
+callout_unlink(struct callout *c)
+{
+	KASSERT(spinlock_do_i_hold(&callout_lock));
+
+	*c->c_prevp = c->c_next;
+	if (c->c_next != NULL) {
+		c->c_next->c_prevp = c->c_prevp;
+	}
+	c->c_next = NULL;
+	c->c_prevp = NULL;
+}
+
+bool
+callout_schedule(struct callout *c, unsigned ticks)
+{
+	struct callout **slot;
+
+	KASSERT(c->c_func != NULL);
+
+	if (ticks == 0) {
+		ticks = 1;
+	}
+
+	spinlock_acquire(&callout_lock);
+	if (c->c_pending) {
+		spinlock_release(&callout_lock);
+		return false;
+	}
+	/* c may be running, e.g. rescheduling itself; that's fine */
+	c->c_pending = true;
+	c->c_rounds = (ticks - 1) / CALLOUT_WHEELSIZE;
+
+	slot = &callout_wheel[(callout_now + ticks) & CALLOUT_WHEELMASK];
+	c->c_next = *slot;
+	if (c->c_next != NULL) {
+		c->c_next->c_prevp = &c->c_next;
+	}
+	c->c_prevp = slot;
+	*slot = c;
+	spinlock_release(&callout_lock);
+	return true;
+}
+
+bool
+callout_stop(struct callout *c)
+{
+	bool stopped = false;
+
+	spinlock_acquire(&callout_lock);
+	if (c->c_pending) {
+		callout_unlink(c);
+		c->c_pending = false;
+		stopped = true;
+	}
+	spinlock_release(&callout_lock);
+
+	/*
+	 * If it's running it's doing so in the timer interrupt on
+	 * another cpu, and won't take long. Wait so the caller can
+	 * safely free C.
+	 */
+	while (c->c_running) {
+		/* spin */
+	}
+	return stopped;
+}
+
+void
+callout_bootstrap(void)
+{
+	unsigned i;
+
+	spinlock_init(&callout_lock);
+	for (i=0; i<CALLOUT_WHEELSIZE; i++) {
+		callout_wheel[i] = NULL;
+	}
+	callout_now = 0;
+}
+
+/*
+ * Called once per LT_GRANULARITY usec on one cpu, from timerclock().
+ */
+void
+callout_tick(void)
+{
+	struct callout *c, *next, *due;
+
+	due = NULL;
+
+	spinlock_acquire(&callout_lock);
+	callout_now++;
+	for (c = callout_wheel[callout_now & CALLOUT_WHEELMASK];
+	     c != NULL; c = next) {
+		next = c->c_next;
+		if (c->c_rounds > 0) {
+			c->c_rounds--;
+			continue;
+		}
+		callout_unlink(c);
+		c->c_pending = false;
+		c->c_running = true;
+		c->c_duenext = due;
+		due = c;
+	}
+	spinlock_release(&callout_lock);
+
+	/* c_duenext, unlike c_next, is left alone if c is rescheduled */
+	while ((c = due) != NULL) {
+		due = c->c_duenext;
+		c->c_duenext = NULL;
+
+		c->c_func(c->c_arg);
+
+		/* after this the owner may free it */
+		spinlock_acquire(&callout_lock);
+		c->c_running = false;
+		spinlock_release(&callout_lock);
+	}
+}
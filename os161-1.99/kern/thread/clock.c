@@ -35,13 +35,16 @@
 #include <thread.h>
 #include <lamebus/ltimer.h>
 #include <current.h>
+#include <workqueue.h>
+#include <callout.h>
+#include <prof.h>
 
 /*
  * Time handling.
  *
- * This is pretty primitive. A real kernel will typically have some
- * kind of support for scheduling callbacks to happen at specific
- * points in the future, usually with more resolution that one second.
+ * Timed sleeps and other callbacks are scheduled with callouts (see
+ * callout.h), which timerclock() advances once per LT_GRANULARITY
+ * usec.
  *
  * A real kernel also has to maintain the time of day; in OS/161 we
  * skimp on that because we have a known-good hardware clock.
@@ -55,23 +58,10 @@
 #define MIGRATE_HARDCLOCKS	16	/* Migrate every 16 hardclocks. */
 
 /*
- * Once a second, everything waiting on lbolt is awakened by CPU 0.
+ * Threads in clocksleep/clocknap sleep here. Each has its own
+ * callout, which wakes just that thread when its time is up.
  */
-static struct wchan *lbolt;
-/*
- * Once every LT_GRANULARITY usec, everything on minibolt is awakenened by CPU 0
- */
-static struct wchan *minibolt;
-
-/* 
- * number of minibolts per second
- */
-#define MINI_PER_SECOND (1000000/LT_GRANULARITY);
-
-/*
- * minibolt countdown
- */
-static int minicount;
+static struct wchan *napchan;
 
 /*
  * Setup.
@@ -79,17 +69,13 @@ static int minicount;
 void
 hardclock_bootstrap(void)
 {
-	lbolt = wchan_create("lbolt");
-	if (lbolt == NULL) {
-		panic("Couldn't create lbolt\n");
-	}
-	minibolt = wchan_create("minibolt");
-	if (minibolt == NULL) {
-		panic("Couldn't create minibolt\n");
+	callout_bootstrap();
+	napchan = wchan_create("clocknap");
+	if (napchan == NULL) {
+		panic("Couldn't create napchan\n");
 	}
-	minicount = MINI_PER_SECOND;
-	/* we assume MINI_PER_SECOND > 0 */
-	KASSERT(minicount > 0);
+	/* we assume TICKS_PER_SECOND > 0 */
+	KASSERT(TICKS_PER_SECOND > 0);
 }
 
 /*
@@ -99,13 +85,8 @@ hardclock_bootstrap(void)
 void
 timerclock(void)
 {
-	/* Broadcast on minibolt */
-	wchan_wakeall(minibolt);
-	/* Broadcast on lbolt if a second has elapsed */
-	if (--minicount <= 0) {
-	  minicount = MINI_PER_SECOND;
-	  wchan_wakeall(lbolt);
-	}
+	/* Run callouts (timed sleeps, delayed work) that have come due */
+	callout_tick();
 }
 
 /*
@@ -118,6 +99,7 @@ hardclock(void)
 	/*
 	 * Collect statistics here as desired.
 	 */
+	prof_sample(curcpu->c_intrtf);
 
 	curcpu->c_hardclocks++;
 	if ((curcpu->c_hardclocks % SCHEDULE_HARDCLOCKS) == 0) {
@@ -135,10 +117,8 @@ hardclock(void)
 void
 clocksleep(int num_secs)
 {
-  while (num_secs > 0) {
-    wchan_lock(lbolt);
-    wchan_sleep(lbolt);
-    num_secs--;
+  if (num_secs > 0) {
+    clocknap(num_secs * TICKS_PER_SECOND);
   }
 }
 
@@ -149,9 +129,13 @@ clocksleep(int num_secs)
 void
 clocknap(int num_ticks)
 {
-  while (num_ticks > 0) {
-    wchan_lock(minibolt);
-    wchan_sleep(minibolt);
-    num_ticks--;
+  bool expired;
+
+  if (num_ticks <= 0) {
+    return;
   }
+  /* nobody else wakes threads on napchan, so this sleeps once */
+  wchan_lock(napchan);
+  expired = wchan_sleep_timeout(napchan, num_ticks);
+  KASSERT(expired);
 }
@@ -0,0 +1,245 @@
+/*
+ * Sampling kernel profiler. See prof.h for the interface.
+ *
+ * Each cpu has a small open-addressed hash table of (pc, mode, pid)
+ * buckets, written only by that cpu from its own hardclock with
+ * interrupts off, so sampling needs no locks. prof_dump merges the
+ * tables into a temporary one and picks out the top entries.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <cpu.h>
+#include <current.h>
+#include <proc.h>
+#include <prof.h>
+#include <mips/specialreg.h>
+#include <mips/trapframe.h>
+#include <platform/maxcpus.h>
+
+#define PROF_NBUCKETS	512	/* per cpu; must be a power of two */
+#define PROF_MAXPROBE	8	/* bucket probes per sample, at most */
+
+struct profbucket {
+	vaddr_t pb_pc;			/* interrupted pc */
+	int pb_pid;			/* process, or -1 if none */
+	bool pb_user;			/* pc was in user mode */
+	uint32_t pb_count;		/* samples; 0 if the bucket is free */
+};
+
+struct profbuf {
+	struct profbucket pf_buckets[PROF_NBUCKETS];
+	uint32_t pf_samples;		/* all samples taken */
+	uint32_t pf_usersamples;	/* ...of which in user mode */
+	uint32_t pf_dropped;		/* ...of which found no bucket */
+};
+
+/* One table per cpu, indexed by c_number. Set once, never freed. */
+static struct profbuf *profbufs[MAXCPUS];
+
+/* Whether hardclock should take samples. */
+static volatile bool prof_on;
+
+static
+unsigned
+prof_hash(vaddr_t pc, int pid, bool user)
+{
+	uint32_t h;
+
+	/* instructions are word aligned */
+	h = (pc >> 2) ^ ((uint32_t)pid << 7) ^ (user ? 0x5bd1e995 : 0);
+	h ^= h >> 13;
+	h *= 0x9e3779b1;
+	return h >> 16;
+}
+
+/*
+ * Find or claim the bucket for (PC, PID, USER) in TABLE, which has
+ * SIZE (a power of two) slots. Gives up after MAXPROBE probes; pass
+ * SIZE to probe until found.
+ */
+static
+struct profbucket *
+prof_lookup(struct profbucket *table, unsigned size, unsigned maxprobe,
+	    vaddr_t pc, int pid, bool user)
+{
+	struct profbucket *pb;
+	unsigned i, slot;
+
+	slot = prof_hash(pc, pid, user);
+	for (i=0; i<maxprobe; i++) {
+		pb = &table[(slot + i) & (size - 1)];
+		if (pb->pb_count == 0) {
+			pb->pb_pc = pc;
+			pb->pb_pid = pid;
+			pb->pb_user = user;
+			return pb;
+		}
+		if (pb->pb_pc == pc && pb->pb_pid == pid &&
+		    pb->pb_user == user) {
+			return pb;
+		}
+	}
+	return NULL;
+}
+
+void
+prof_cpu_start(void)
+{
+	struct profbuf *pf;
+	unsigned num;
+
+	num = curcpu->c_number;
+	KASSERT(num < MAXCPUS);
+	KASSERT(profbufs[num] == NULL);
+
+	pf = kmalloc(sizeof(*pf));
+	if (pf == NULL) {
+		panic("prof: out of memory\n");
+	}
+	bzero(pf, sizeof(*pf));
+	profbufs[num] = pf;
+}
+
+void
+prof_sample(const struct trapframe *tf)
+{
+	struct profbuf *pf;
+	struct profbucket *pb;
+	struct proc *p;
+	bool user;
+	int pid;
+
+	if (!prof_on || tf == NULL) {
+		return;
+	}
+	pf = profbufs[curcpu->c_number];
+	if (pf == NULL) {
+		/* this cpu hasn't got that far in starting up */
+		return;
+	}
+
+	user = (tf->tf_status & CST_KUp) != 0;
+	p = curthread->t_proc;
+	pid = (p == NULL || p == kproc) ? -1 : p->pId;
+
+	pf->pf_samples++;
+	if (user) {
+		pf->pf_usersamples++;
+	}
+	pb = prof_lookup(pf->pf_buckets, PROF_NBUCKETS, PROF_MAXPROBE,
+			 tf->tf_epc, pid, user);
+	if (pb == NULL) {
+		pf->pf_dropped++;
+		return;
+	}
+	pb->pb_count++;
+}
+
+void
+prof_start(void)
+{
+	unsigned i;
+
+	/*
+	 * A cpu that checked prof_on just before it was cleared may
+	 * still add a sample to the old tables; that's one sample, and
+	 * not worth a lock on the sampling path.
+	 */
+	prof_on = false;
+	for (i=0; i<MAXCPUS; i++) {
+		if (profbufs[i] != NULL) {
+			bzero(profbufs[i], sizeof(struct profbuf));
+		}
+	}
+	prof_on = true;
+}
+
+void
+prof_stop(void)
+{
+	prof_on = false;
+}
+
+void
+prof_dump(unsigned ntop)
+{
+	struct profbucket *merged, *pb, *src, *best;
+	unsigned ncpus, size, i, j, n;
+	uint32_t samples, usersamples, dropped;
+
+	ncpus = 0;
+	samples = usersamples = dropped = 0;
+	for (i=0; i<MAXCPUS; i++) {
+		if (profbufs[i] != NULL) {
+			ncpus++;
+			samples += profbufs[i]->pf_samples;
+			usersamples += profbufs[i]->pf_usersamples;
+			dropped += profbufs[i]->pf_dropped;
+		}
+	}
+
+	kprintf("Profile (%s): %u samples, %u kernel, %u user, "
+		"%u dropped\n", prof_on ? "running" : "stopped",
+		samples, samples - usersamples, usersamples, dropped);
+	if (samples == 0) {
+		return;
+	}
+
+	/* keep the merged table at most half full */
+	size = PROF_NBUCKETS;
+	while (size < 2 * ncpus * PROF_NBUCKETS) {
+		size *= 2;
+	}
+	merged = kmalloc(size * sizeof(*merged));
+	if (merged == NULL) {
+		kprintf("prof: out of memory\n");
+		return;
+	}
+	bzero(merged, size * sizeof(*merged));
+
+	for (i=0; i<MAXCPUS; i++) {
+		if (profbufs[i] == NULL) {
+			continue;
+		}
+		for (j=0; j<PROF_NBUCKETS; j++) {
+			src = &profbufs[i]->pf_buckets[j];
+			if (src->pb_count == 0) {
+				continue;
+			}
+			pb = prof_lookup(merged, size, size, src->pb_pc,
+					 src->pb_pid, src->pb_user);
+			KASSERT(pb != NULL);
+			pb->pb_count += src->pb_count;
+		}
+	}
+
+	kprintf("   samples      %%  pc          mode    pid\n");
+	for (n=0; n<ntop; n++) {
+		/* selection: ntop is small, and this isn't a hot path */
+		best = NULL;
+		for (i=0; i<size; i++) {
+			if (merged[i].pb_count > 0 &&
+			    (best == NULL ||
+			     merged[i].pb_count > best->pb_count)) {
+				best = &merged[i];
+			}
+		}
+		if (best == NULL) {
+			break;
+		}
+		kprintf("%10u %3u.%u%%  0x%08x  %-6s  ", best->pb_count,
+			best->pb_count * 100 / samples,
+			(best->pb_count * 1000 / samples) % 10,
+			best->pb_pc, best->pb_user ? "user" : "kernel");
+		if (best->pb_pid < 0) {
+			kprintf("-\n");
+		}
+		else {
+			kprintf("%d\n", best->pb_pid);
+		}
+		best->pb_count = 0;
+	}
+
+	kfree(merged);
+}
@@ -41,6 +41,14 @@
  * Spinlocks.
  */
 
+#if OPT_TICKETLOCK
+/*
+ * While waiting, spin this many times per CPU ahead of us in line
+ * between looks at the lock, to keep traffic on the lock word down.
+ */
+#define TICKET_BACKOFF 16
+#endif
+
 
 /*
  * Initialize spinlock.
@@ -48,7 +56,12 @@
 void
 spinlock_init(struct spinlock *lk)
 {
+#if OPT_TICKETLOCK
+	spinlock_data_set(&lk->lk_next, 0);
+	spinlock_data_set(&lk->lk_owner, 0);
+#else
 	spinlock_data_set(&lk->lk_lock, 0);
+#endif
 	lk->lk_holder = NULL;
 }
 
@@ -59,7 +72,12 @@ void
 spinlock_cleanup(struct spinlock *lk)
 {
 	KASSERT(lk->lk_holder == NULL);
+#if OPT_TICKETLOCK
+	KASSERT(spinlock_data_get(&lk->lk_next) ==
+		spinlock_data_get(&lk->lk_owner));
+#else
 	KASSERT(spinlock_data_get(&lk->lk_lock) == 0);
+#endif
 }
 
 /*
@@ -73,6 +91,10 @@ void
 spinlock_acquire(struct spinlock *lk)
 {
 	struct cpu *mycpu;
+#if OPT_TICKETLOCK
+	spinlock_data_t ticket, owner;
+	volatile unsigned i;
+#endif
 
 	splraise(IPL_NONE, IPL_HIGH);
 
@@ -87,6 +109,18 @@ spinlock_acquire(struct spinlock *lk)
 		mycpu = NULL;
 	}
 
+#if OPT_TICKETLOCK
+	/*
+	 * Take a ticket and wait for our turn. Only the holder writes
+	 * lk_owner, so the waiters just read it.
+	 */
+	ticket = spinlock_data_fetchinc(&lk->lk_next);
+	while ((owner = spinlock_data_get(&lk->lk_owner)) != ticket) {
+		for (i = (ticket - owner) * TICKET_BACKOFF; i > 0; i--) {
+			/* back off */
+		}
+	}
+#else
 	while (1) {
 		/*
 		 * Do test-test-and-set, that is, read first before
@@ -106,6 +140,7 @@ spinlock_acquire(struct spinlock *lk)
 		}
 		break;
 	}
+#endif
 
 	lk->lk_holder = mycpu;
 }
@@ -122,7 +157,13 @@ spinlock_release(struct spinlock *lk)
 	}
 
 	lk->lk_holder = NULL;
+#if OPT_TICKETLOCK
+	/* next in line */
+	spinlock_data_set(&lk->lk_owner,
+			  spinlock_data_get(&lk->lk_owner) + 1);
+#else
 	spinlock_data_set(&lk->lk_lock, 0);
+#endif
 	spllower(IPL_HIGH, IPL_NONE);
 }
 
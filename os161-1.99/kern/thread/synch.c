@@ -33,12 +33,14 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
 #include <spinlock.h>
 #include <wchan.h>
 #include <thread.h>
 #include <current.h>
 #include <synch.h>
+#include <trace.h>
 
 ////////////////////////////////////////////////////////////
 //
@@ -196,11 +198,15 @@ lock_acquire(struct lock *lock)
     KASSERT(curthread->t_in_interrupt == false);
 
     spinlock_acquire(&lock->sl);
-    while(lock->holder != NULL) {
-        wchan_lock(lock->wc);
-        spinlock_release(&lock->sl);
-        wchan_sleep(lock->wc);
-        spinlock_acquire(&lock->sl);
+    if (lock->holder != NULL) {
+        TRACE(TRC_LOCK, TE_LOCKWAIT, lock, 0);
+        while(lock->holder != NULL) {
+            wchan_lock(lock->wc);
+            spinlock_release(&lock->sl);
+            wchan_sleep(lock->wc);
+            spinlock_acquire(&lock->sl);
+        }
+        TRACE(TRC_LOCK, TE_LOCKGOT, lock, 0);
     }
     lock->holder = curthread;
     spinlock_release(&lock->sl);
@@ -273,6 +279,20 @@ cv_wait(struct cv *cv, struct lock *lock)
         lock_acquire(lock);
 }
 
+int
+cv_timedwait(struct cv *cv, struct lock *lock, unsigned ticks)
+{
+        bool expired;
+
+        KASSERT(cv != NULL);
+        KASSERT(lock != NULL);
+        wchan_lock(cv->wc);
+        lock_release(lock);
+        expired = wchan_sleep_timeout(cv->wc, ticks);
+        lock_acquire(lock);
+        return expired ? ETIMEDOUT : 0;
+}
+
 void
 cv_signal(struct cv *cv, struct lock *lock)
 {
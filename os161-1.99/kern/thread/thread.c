@@ -50,6 +50,11 @@
 #include <addrspace.h>
 #include <mainbus.h>
 #include <vnode.h>
+#include <workqueue.h>
+#include <prof.h>
+#include <trace.h>
+#include <syscall.h>
+#include <callout.h>
 
 #include "opt-synchprobs.h"
 
@@ -57,6 +62,9 @@
 /* Magic number used as a guard value on kernel thread stacks. */
 #define THREAD_STACK_MAGIC 0xbaadf00d
 
+/* Max number of exited threads (struct + stack) each cpu keeps for reuse. */
+#define THREAD_CACHE_MAX 8
+
 /* Wait channel. */
 struct wchan {
 	const char *wc_name;		/* name for this channel */
@@ -111,6 +119,37 @@ thread_checkstack(struct thread *thread)
 	}
 }
 
+/*
+ * (Re)initialize the fields of a thread that thread_fork and the
+ * thread subsystem expect to find in a fresh thread. Shared by
+ * thread_create and the thread cache; does not touch t_name or
+ * t_stack.
+ */
+static
+void
+thread_reset(struct thread *thread)
+{
+	thread->t_wchan_name = "NEW";
+	thread->t_wchan = NULL;
+	thread->t_state = S_READY;
+
+	/* Thread subsystem fields */
+	thread_machdep_init(&thread->t_machdep);
+	threadlistnode_init(&thread->t_listnode, thread);
+	thread->t_context = NULL;
+	thread->t_cpu = NULL;
+	thread->t_proc = NULL;
+	thread->t_pinned = false;
+	thread->t_utid = 0;
+
+	/* Interrupt state fields */
+	thread->t_in_interrupt = false;
+	thread->t_curspl = IPL_HIGH;
+	thread->t_iplhigh_count = 1; /* corresponding to t_curspl */
+
+	/* If you add to struct thread, be sure to initialize here */
+}
+
 /*
  * Create a thread. This is used both to create a first thread
  * for each CPU and to create subsequent forked threads.
@@ -133,23 +172,8 @@ thread_create(const char *name)
 		kfree(thread);
 		return NULL;
 	}
-	thread->t_wchan_name = "NEW";
-	thread->t_state = S_READY;
-
-	/* Thread subsystem fields */
-	thread_machdep_init(&thread->t_machdep);
-	threadlistnode_init(&thread->t_listnode, thread);
 	thread->t_stack = NULL;
-	thread->t_context = NULL;
-	thread->t_cpu = NULL;
-	thread->t_proc = NULL;
-
-	/* Interrupt state fields */
-	thread->t_in_interrupt = false;
-	thread->t_curspl = IPL_HIGH;
-	thread->t_iplhigh_count = 1; /* corresponding to t_curspl */
-
-	/* If you add to struct thread, be sure to initialize here */
+	thread_reset(thread);
 
 	return thread;
 }
@@ -179,7 +203,9 @@ cpu_create(unsigned hardware_number)
 
 	c->c_curthread = NULL;
 	threadlist_init(&c->c_zombies);
+	threadlist_init(&c->c_threadcache);
 	c->c_hardclocks = 0;
+	c->c_intrtf = NULL;
 
 	c->c_isidle = false;
 	threadlist_init(&c->c_runqueue);
@@ -262,9 +288,90 @@ thread_destroy(struct thread *thread)
 	kfree(thread);
 }
 
+/*
+ * Thread cache.
+ *
+ * Rather than freeing the struct thread and kernel stack of every
+ * exited thread and allocating new ones in the next thread_fork,
+ * each cpu keeps up to THREAD_CACHE_MAX exited threads around. Their
+ * stacks still carry the guard band from thread_checkstack_init
+ * (checked on the way in), so thread_fork only has to reset the
+ * fields and copy in a name.
+ *
+ * The cache is per-cpu and only touched by its own cpu with
+ * interrupts off, so it needs no lock.
+ */
+
+/*
+ * Put an exited thread in the current cpu's cache. Returns false if
+ * it can't be cached and should be destroyed instead.
+ */
+static
+bool
+thread_cache_put(struct thread *thread)
+{
+	KASSERT(curthread->t_curspl > 0);
+	KASSERT(thread->t_proc == NULL);
+
+	if (thread->t_stack == NULL ||
+	    curcpu->c_threadcache.tl_count >= THREAD_CACHE_MAX) {
+		return false;
+	}
+
+	/* Don't recycle a stack that has been overrun. */
+	thread_checkstack(thread);
+
+	thread_machdep_cleanup(&thread->t_machdep);
+	kfree(thread->t_name);
+	thread->t_name = NULL;
+	thread->t_wchan_name = "CACHED";
+	threadlist_addtail(&curcpu->c_threadcache, thread);
+	return true;
+}
+
+/*
+ * Take a ready-made thread out of the current cpu's cache, or return
+ * NULL if there isn't one.
+ */
+static
+struct thread *
+thread_cache_get(const char *name)
+{
+	struct thread *thread;
+	char *namecopy;
+	int spl;
+
+	spl = splhigh();
+	if (threadlist_isempty(&curcpu->c_threadcache)) {
+		splx(spl);
+		return NULL;
+	}
+	splx(spl);
+
+	namecopy = kstrdup(name);
+	if (namecopy == NULL) {
+		return NULL;
+	}
+
+	/* we may have been preempted or migrated: look again */
+	spl = splhigh();
+	thread = threadlist_remhead(&curcpu->c_threadcache);
+	splx(spl);
+
+	if (thread == NULL) {
+		kfree(namecopy);
+		return NULL;
+	}
+
+	thread->t_name = namecopy;
+	thread_reset(thread);
+	return thread;
+}
+
 /*
  * Clean up zombies. (Zombies are threads that have exited but still
- * need to have thread_destroy called on them.)
+ * need to have thread_destroy called on them.) Up to
+ * THREAD_CACHE_MAX of them are kept in the thread cache instead.
  *
  * The list of zombies is per-cpu.
  */
@@ -277,7 +384,9 @@ exorcise(void)
 	while ((z = threadlist_remhead(&curcpu->c_zombies)) != NULL) {
 		KASSERT(z != curthread);
 		KASSERT(z->t_state == S_ZOMBIE);
-		thread_destroy(z);
+		if (!thread_cache_put(z)) {
+			thread_destroy(z);
+		}
 	}
 }
 
@@ -402,6 +511,11 @@ cpu_hatch(unsigned software_number)
 
 	kprintf("cpu%u: %s\n", software_number, cpu_identify());
 
+	workqueue_cpu_start();
+	prof_cpu_start();
+	trace_cpu_start();
+	syscall_stats_cpu_start();
+
 	V(cpu_startup_sem);
 	thread_exit();
 }
@@ -487,18 +601,22 @@ thread_fork(const char *name,
 	DEBUG(DB_THREADS,"Forking thread: %s\n",name);
 #endif // UW
 
-	newthread = thread_create(name);
+	/* Reuse an exited thread and its stack if this cpu has one */
+	newthread = thread_cache_get(name);
 	if (newthread == NULL) {
-		return ENOMEM;
-	}
+		newthread = thread_create(name);
+		if (newthread == NULL) {
+			return ENOMEM;
+		}
 
-	/* Allocate a stack */
-	newthread->t_stack = kmalloc(STACK_SIZE);
-	if (newthread->t_stack == NULL) {
-		thread_destroy(newthread);
-		return ENOMEM;
+		/* Allocate a stack */
+		newthread->t_stack = kmalloc(STACK_SIZE);
+		if (newthread->t_stack == NULL) {
+			thread_destroy(newthread);
+			return ENOMEM;
+		}
+		thread_checkstack_init(newthread);
 	}
-	thread_checkstack_init(newthread);
 
 	/*
 	 * Now we clone various fields from the parent thread.
@@ -603,6 +721,7 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 		 * without racing. Exercise: what's the other?)
 		 */
 		threadlist_addtail(&wc->wc_threads, cur);
+		cur->t_wchan = wc;
 		wchan_unlock(wc);
 		break;
 	    case S_ZOMBIE:
@@ -641,6 +760,8 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 	} while (next == NULL);
 	curcpu->c_isidle = false;
 
+	TRACE(TRC_SCHED, TE_SWITCH, cur, next);
+
 	/*
 	 * Note that curcpu->c_curthread may be the same variable as
 	 * curthread and it may not be, depending on how curthread and
@@ -922,6 +1043,12 @@ thread_consider_migration(void)
 				to_send--;
 				continue;
 			}
+			/* Likewise, leave per-cpu worker threads alone. */
+			if (t->t_pinned) {
+				threadlist_addtail(&victims, t);
+				to_send--;
+				continue;
+			}
 
 			t->t_cpu = c;
 			threadlist_addtail(&c->c_runqueue, t);
@@ -1039,6 +1166,9 @@ wchan_wakeone(struct wchan *wc)
 	/* Lock the channel and grab a thread from it */
 	spinlock_acquire(&wc->wc_lock);
 	target = threadlist_remhead(&wc->wc_threads);
+	if (target != NULL) {
+		target->t_wchan = NULL;
+	}
 	/*
 	 * Nobody else can wake up this thread now, so we don't need
 	 * to hang onto the lock.
@@ -1050,6 +1180,7 @@ wchan_wakeone(struct wchan *wc)
 		return;
 	}
 
+	TRACE(TRC_WAKEUP, TE_WAKEUP, wc, target);
 	thread_make_runnable(target, false);
 }
 
@@ -1070,6 +1201,7 @@ wchan_wakeall(struct wchan *wc)
 	 */
 	spinlock_acquire(&wc->wc_lock);
 	while ((target = threadlist_remhead(&wc->wc_threads)) != NULL) {
+		target->t_wchan = NULL;
 		threadlist_addtail(&list, target);
 	}
 	/*
@@ -1084,12 +1216,83 @@ wchan_wakeall(struct wchan *wc)
 	 * make each thread runnable.
 	 */
 	while ((target = threadlist_remhead(&list)) != NULL) {
+		TRACE(TRC_WAKEUP, TE_WAKEUP, wc, target);
 		thread_make_runnable(target, false);
 	}
 
 	threadlist_cleanup(&list);
 }
 
+/*
+ * Wake up thread T if it is sleeping on WC. Returns true if it was.
+ * t_wchan is only changed with the channel locked, so checking it
+ * under the lock tells us whether T is on our list.
+ */
+bool
+wchan_wakethread(struct wchan *wc, struct thread *t)
+{
+	spinlock_acquire(&wc->wc_lock);
+	if (t->t_wchan != wc) {
+		spinlock_release(&wc->wc_lock);
+		return false;
+	}
+	threadlist_remove(&wc->wc_threads, t);
+	t->t_wchan = NULL;
+	spinlock_release(&wc->wc_lock);
+
+	TRACE(TRC_WAKEUP, TE_WAKEUP, wc, t);
+	thread_make_runnable(t, false);
+	return true;
+}
+
+/*
+ * State shared between wchan_sleep_timeout and its callout.
+ */
+struct sleeptimeout {
+	struct wchan *st_wchan;
+	struct thread *st_thread;
+	bool st_expired;
+};
+
+static
+void
+wchan_timeout(void *arg)
+{
+	struct sleeptimeout *st = arg;
+
+	st->st_expired = wchan_wakethread(st->st_wchan, st->st_thread);
+}
+
+/*
+ * Like wchan_sleep, but give up after TICKS timer ticks. Returns true
+ * if the time ran out, false if woken by someone else. The callout
+ * wakes only this thread, and only once, when the deadline passes.
+ */
+bool
+wchan_sleep_timeout(struct wchan *wc, unsigned ticks)
+{
+	struct sleeptimeout st;
+	struct callout c;
+
+	KASSERT(!curthread->t_in_interrupt);
+
+	st.st_wchan = wc;
+	st.st_thread = curthread;
+	st.st_expired = false;
+	callout_init(&c, wchan_timeout, &st);
+
+	/*
+	 * We hold the channel lock, so if the callout fires before we
+	 * are on the list, wchan_wakethread waits for us.
+	 */
+	callout_schedule(&c, ticks);
+	thread_switch(S_SLEEP, wc);
+
+	/* make sure the callout is done with st before returning */
+	callout_stop(&c);
+	return st.st_expired;
+}
+
 /*
  * Return nonzero if there are no threads sleeping on the channel.
  * This is meant to be used only for diagnostic purposes.
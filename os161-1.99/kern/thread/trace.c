@@ -0,0 +1,294 @@
+/*
+ * Kernel event tracing. See trace.h for the interface.
+ *
+ * Each cpu records into its own ring at splhigh, so recording needs
+ * no locks and events from interrupt handlers don't tear events from
+ * the code they interrupted. Dumping merges the rings by timestamp.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spl.h>
+#include <clock.h>
+#include <current.h>
+#include <proc.h>
+#include <uio.h>
+#include <vfs.h>
+#include <vnode.h>
+#include <trace.h>
+#include <platform/maxcpus.h>
+
+#define TRACE_NEVENTS	1024	/* per cpu; must be a power of two */
+
+struct tracering {
+	struct trace_event tr_events[TRACE_NEVENTS];
+	uint32_t tr_head;	/* events ever recorded; next is head % N */
+};
+
+/* One ring per cpu, indexed by c_number. Set once, never freed. */
+static struct tracering *tracerings[MAXCPUS];
+
+/* Enabled categories. */
+uint32_t trace_mask = 0;
+
+static const struct {
+	const char *name;
+	uint32_t mask;
+} trace_categories[] = {
+	{ "sched",	TRC_SCHED },
+	{ "syscall",	TRC_SYSCALL },
+	{ "fault",	TRC_FAULT },
+	{ "disk",	TRC_DISK },
+	{ "wakeup",	TRC_WAKEUP },
+	{ "lock",	TRC_LOCK },
+	{ "proc",	TRC_PROC },
+	{ "all",	TRC_ALL },
+	{ NULL, 0 }
+};
+
+static const char *const trace_names[] = {
+	"?",
+	"switch",
+	"sysenter",
+	"sysexit",
+	"fault",
+	"diskstart",
+	"diskdone",
+	"wakeup",
+	"lockwait",
+	"lockgot",
+	"proccreate",
+	"fork",
+	"exec",
+};
+
+void
+trace_record(unsigned type, uint32_t arg0, uint32_t arg1)
+{
+	struct tracering *tr;
+	struct trace_event *te;
+	struct proc *p;
+	time_t secs;
+	uint32_t nsecs;
+	int spl;
+
+	spl = splhigh();
+	tr = tracerings[curcpu->c_number];
+	if (tr == NULL) {
+		/* this cpu hasn't got that far in starting up */
+		splx(spl);
+		return;
+	}
+
+	gettime(&secs, &nsecs);
+	p = curthread->t_proc;
+
+	te = &tr->tr_events[tr->tr_head & (TRACE_NEVENTS - 1)];
+	te->te_secs = secs;
+	te->te_nsecs = nsecs;
+	te->te_type = type;
+	te->te_cpu = curcpu->c_number;
+	te->te_pid = (p == NULL || p == kproc) ? -1 : p->pId;
+	te->te_arg[0] = arg0;
+	te->te_arg[1] = arg1;
+	tr->tr_head++;
+
+	splx(spl);
+}
+
+void
+trace_cpu_start(void)
+{
+	struct tracering *tr;
+	unsigned num;
+
+	num = curcpu->c_number;
+	KASSERT(num < MAXCPUS);
+	KASSERT(tracerings[num] == NULL);
+
+	tr = kmalloc(sizeof(*tr));
+	if (tr == NULL) {
+		panic("trace: out of memory\n");
+	}
+	bzero(tr, sizeof(*tr));
+	tracerings[num] = tr;
+}
+
+/*
+ * Look up a category by name, for the menu. Returns 0 if unknown.
+ */
+uint32_t
+trace_category(const char *name)
+{
+	unsigned i;
+
+	for (i=0; trace_categories[i].name != NULL; i++) {
+		if (!strcmp(name, trace_categories[i].name)) {
+			return trace_categories[i].mask;
+		}
+	}
+	return 0;
+}
+
+static
+bool
+trace_before(const struct trace_event *a, const struct trace_event *b)
+{
+	return a->te_secs < b->te_secs ||
+		(a->te_secs == b->te_secs && a->te_nsecs < b->te_nsecs);
+}
+
+/*
+ * Merge all rings, oldest event first, into a new array. Tracing is
+ * paused meanwhile so the rings hold still; an event another cpu was
+ * already in the middle of recording may still land, in which case
+ * it's either copied or not.
+ */
+static
+struct trace_event *
+trace_collect(unsigned *countret)
+{
+	unsigned pos[MAXCPUS], end[MAXCPUS];
+	struct trace_event *all, *te, *next;
+	unsigned i, n, total, nextcpu;
+	uint32_t savedmask;
+
+	savedmask = trace_mask;
+	trace_mask = 0;
+
+	total = 0;
+	for (i=0; i<MAXCPUS; i++) {
+		pos[i] = end[i] = 0;
+		if (tracerings[i] == NULL) {
+			continue;
+		}
+		end[i] = tracerings[i]->tr_head;
+		pos[i] = end[i] > TRACE_NEVENTS ? end[i] - TRACE_NEVENTS : 0;
+		total += end[i] - pos[i];
+	}
+
+	all = kmalloc((total ? total : 1) * sizeof(*all));
+	if (all == NULL) {
+		trace_mask = savedmask;
+		return NULL;
+	}
+
+	for (n=0; n<total; n++) {
+		next = NULL;
+		nextcpu = 0;
+		for (i=0; i<MAXCPUS; i++) {
+			if (pos[i] == end[i]) {
+				continue;
+			}
+			te = &tracerings[i]->tr_events[pos[i] &
+						      (TRACE_NEVENTS - 1)];
+			if (next == NULL || trace_before(te, next)) {
+				next = te;
+				nextcpu = i;
+			}
+		}
+		KASSERT(next != NULL);
+		all[n] = *next;
+		pos[nextcpu]++;
+	}
+
+	trace_mask = savedmask;
+	*countret = total;
+	return all;
+}
+
+void
+trace_dump(unsigned max)
+{
+	struct trace_event *all, *te;
+	unsigned count, i;
+	const char *name;
+
+	all = trace_collect(&count);
+	if (all == NULL) {
+		kprintf("trace: out of memory\n");
+		return;
+	}
+
+	kprintf("Trace: %u events recorded, mask 0x%x\n", count, trace_mask);
+	for (i = (count > max) ? count - max : 0; i < count; i++) {
+		te = &all[i];
+		name = te->te_type < sizeof(trace_names)/sizeof(trace_names[0])
+			? trace_names[te->te_type] : "?";
+		kprintf("%6u.%09u cpu%u pid %3d %-10s 0x%08x 0x%08x\n",
+			te->te_secs, te->te_nsecs, te->te_cpu, te->te_pid,
+			name, te->te_arg[0], te->te_arg[1]);
+	}
+
+	kfree(all);
+}
+
+int
+trace_save(const char *path)
+{
+	struct trace_filehdr hdr;
+	struct trace_event *all;
+	struct vnode *vn;
+	struct iovec iov;
+	struct uio ku;
+	char *pathcopy;
+	unsigned count;
+	int result;
+
+	all = trace_collect(&count);
+	if (all == NULL) {
+		return ENOMEM;
+	}
+
+	/* vfs_open destroys the string it's passed */
+	pathcopy = kstrdup(path);
+	if (pathcopy == NULL) {
+		kfree(all);
+		return ENOMEM;
+	}
+	result = vfs_open(pathcopy, O_WRONLY|O_CREAT|O_TRUNC, 0664, &vn);
+	kfree(pathcopy);
+	if (result) {
+		kfree(all);
+		return result;
+	}
+
+	hdr.th_magic = TRACE_MAGIC;
+	hdr.th_eventsize = sizeof(struct trace_event);
+	hdr.th_nevents = count;
+	hdr.th_mask = trace_mask;
+
+	uio_kinit(&iov, &ku, &hdr, sizeof(hdr), 0, UIO_WRITE);
+	result = VOP_WRITE(vn, &ku);
+	if (result == 0 && count > 0) {
+		uio_kinit(&iov, &ku, all, count * sizeof(*all),
+			  sizeof(hdr), UIO_WRITE);
+		result = VOP_WRITE(vn, &ku);
+	}
+	if (result == 0 && ku.uio_resid != 0) {
+		result = ENOSPC;
+	}
+
+	vfs_close(vn);
+	kfree(all);
+	return result;
+}
+
+void
+trace_clear(void)
+{
+	uint32_t savedmask;
+	unsigned i;
+
+	savedmask = trace_mask;
+	trace_mask = 0;
+	for (i=0; i<MAXCPUS; i++) {
+		if (tracerings[i] != NULL) {
+			tracerings[i]->tr_head = 0;
+		}
+	}
+	trace_mask = savedmask;
+}
@@ -0,0 +1,311 @@
+/*
+ * Deferred work queues. See workqueue.h for the interface.
+ *
+ * Each cpu gets a queue and a worker thread in workqueue_cpu_start.
+ * Work is queued on the queue of the cpu that calls work_enqueue, so
+ * an interrupt handler's follow-up work runs on the cpu that took the
+ * interrupt. The worker marks itself pinned so the scheduler does not
+ * migrate it away from its queue.
+ *
+ * Delayed work waits on its callout, then moves to the queue it was
+ * originally queued from.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <thread.h>
+#include <current.h>
+#include <clock.h>
+#include <workqueue.h>
+#include <platform/maxcpus.h>
+
+struct workqueue {
+	unsigned wq_cpunum;		/* cpu this queue belongs to */
+	struct spinlock wq_lock;	/* protects everything below */
+	struct wchan *wq_wchan;		/* worker sleeps here when idle */
+	struct work *wq_head;		/* FIFO of pending work */
+	struct work *wq_tail;
+
+	/* statistics */
+	unsigned wq_depth;		/* items currently queued */
+	unsigned wq_maxdepth;		/* high-water mark of wq_depth */
+	uint32_t wq_queued;		/* total items queued */
+	uint32_t wq_run;		/* total items run */
+	uint64_t wq_totallat;		/* sum of queue-to-run latency (ns) */
+	uint32_t wq_maxlat;		/* worst queue-to-run latency (ns) */
+};
+
+/* One queue per cpu, indexed by c_number. Set once, never freed. */
+static struct workqueue *workqueues[MAXCPUS];
+
+/* Guards w_pending; also counts delayed work not yet due. */
+static struct spinlock delayed_lock;
+static unsigned delayed_count;
+
+/*
+ * Pick the queue for the current cpu. Early in boot, before a cpu has
+ * started its worker, fall back to the boot cpu's queue.
+ */
+static
+struct workqueue *
+workqueue_mine(void)
+{
+	struct workqueue *wq;
+
+	wq = workqueues[curcpu->c_number];
+	if (wq == NULL) {
+		wq = workqueues[0];
+	}
+	KASSERT(wq != NULL);
+	return wq;
+}
+
+/*
+ * Append W to WQ and wake the worker. W must already be marked pending.
+ */
+static
+void
+workqueue_add(struct workqueue *wq, struct work *w)
+{
+	gettime(&w->w_secs, &w->w_nsecs);
+	w->w_next = NULL;
+
+	spinlock_acquire(&wq->wq_lock);
+	if (wq->wq_tail == NULL) {
+		wq->wq_head = w;
+	}
+	else {
+		wq->wq_tail->w_next = w;
+	}
+	wq->wq_tail = w;
+	wq->wq_depth++;
+	if (wq->wq_depth > wq->wq_maxdepth) {
+		wq->wq_maxdepth = wq->wq_depth;
+	}
+	wq->wq_queued++;
+	spinlock_release(&wq->wq_lock);
+
+	wchan_wakeone(wq->wq_wchan);
+}
+
+/*
+ * Callout for delayed work: the delay is up, so queue it for real.
+ * Runs in the timer interrupt.
+ */
+static
+void
+work_delay_expired(void *arg)
+{
+	struct work *w = arg;
+
+	spinlock_acquire(&delayed_lock);
+	KASSERT(delayed_count > 0);
+	delayed_count--;
+	spinlock_release(&delayed_lock);
+
+	workqueue_add(w->w_queue, w);
+}
+
+void
+work_init(struct work *w, void (*func)(void *), void *arg)
+{
+	w->w_func = func;
+	w->w_arg = arg;
+	w->w_next = NULL;
+	w->w_queue = NULL;
+	callout_init(&w->w_callout, work_delay_expired, w);
+	w->w_pending = false;
+	w->w_secs = 0;
+	w->w_nsecs = 0;
+}
+
+/*
+ * Atomically claim W for queueing. Uses delayed_lock, which every
+ * transition into the pending state goes through.
+ */
+static
+bool
+work_claim(struct work *w)
+{
+	bool ok;
+
+	spinlock_acquire(&delayed_lock);
+	ok = !w->w_pending;
+	w->w_pending = true;
+	spinlock_release(&delayed_lock);
+	return ok;
+}
+
+bool
+work_enqueue(struct work *w)
+{
+	KASSERT(w->w_func != NULL);
+
+	if (!work_claim(w)) {
+		return false;
+	}
+	workqueue_add(workqueue_mine(), w);
+	return true;
+}
+
+bool
+work_enqueue_delayed(struct work *w, unsigned ticks)
+{
+	KASSERT(w->w_func != NULL);
+
+	if (ticks == 0) {
+		return work_enqueue(w);
+	}
+
+	spinlock_acquire(&delayed_lock);
+	if (w->w_pending) {
+		spinlock_release(&delayed_lock);
+		return false;
+	}
+	w->w_pending = true;
+	w->w_queue = workqueue_mine();
+	delayed_count++;
+	spinlock_release(&delayed_lock);
+
+	callout_schedule(&w->w_callout, ticks);
+	return true;
+}
+
+/*
+ * Worker thread: run queued work forever.
+ */
+static
+void
+workqueue_worker(void *data1, unsigned long data2)
+{
+	struct workqueue *wq = data1;
+	struct work *w;
+	time_t nowsecs, secs;
+	uint32_t nownsecs, nsecs, lat;
+
+	(void)data2;
+
+	/* stay with our queue */
+	curthread->t_pinned = true;
+
+	while (1) {
+		spinlock_acquire(&wq->wq_lock);
+		while (wq->wq_head == NULL) {
+			wchan_lock(wq->wq_wchan);
+			spinlock_release(&wq->wq_lock);
+			wchan_sleep(wq->wq_wchan);
+			spinlock_acquire(&wq->wq_lock);
+		}
+		w = wq->wq_head;
+		wq->wq_head = w->w_next;
+		if (wq->wq_head == NULL) {
+			wq->wq_tail = NULL;
+		}
+		wq->wq_depth--;
+		spinlock_release(&wq->wq_lock);
+
+		gettime(&nowsecs, &nownsecs);
+		getinterval(w->w_secs, w->w_nsecs, nowsecs, nownsecs,
+			    &secs, &nsecs);
+		lat = (secs >= 4) ? 0xffffffff : secs * 1000000000 + nsecs;
+
+		/* once this is cleared the item may be requeued or freed */
+		spinlock_acquire(&delayed_lock);
+		w->w_next = NULL;
+		w->w_pending = false;
+		spinlock_release(&delayed_lock);
+
+		w->w_func(w->w_arg);
+
+		spinlock_acquire(&wq->wq_lock);
+		wq->wq_run++;
+		wq->wq_totallat += lat;
+		if (lat > wq->wq_maxlat) {
+			wq->wq_maxlat = lat;
+		}
+		spinlock_release(&wq->wq_lock);
+	}
+}
+
+void
+workqueue_bootstrap(void)
+{
+	spinlock_init(&delayed_lock);
+	delayed_count = 0;
+}
+
+void
+workqueue_cpu_start(void)
+{
+	struct workqueue *wq;
+	unsigned num;
+	char name[16];
+	int result;
+
+	num = curcpu->c_number;
+	KASSERT(num < MAXCPUS);
+	KASSERT(workqueues[num] == NULL);
+
+	wq = kmalloc(sizeof(*wq));
+	if (wq == NULL) {
+		panic("workqueue: out of memory\n");
+	}
+	wq->wq_cpunum = num;
+	spinlock_init(&wq->wq_lock);
+	wq->wq_wchan = wchan_create("workqueue");
+	if (wq->wq_wchan == NULL) {
+		panic("workqueue: wchan_create failed\n");
+	}
+	wq->wq_head = wq->wq_tail = NULL;
+	wq->wq_depth = wq->wq_maxdepth = 0;
+	wq->wq_queued = wq->wq_run = 0;
+	wq->wq_totallat = 0;
+	wq->wq_maxlat = 0;
+
+	snprintf(name, sizeof(name), "worker/%u", num);
+	result = thread_fork(name, NULL, workqueue_worker, wq, 0);
+	if (result) {
+		panic("workqueue: thread_fork failed: %s\n", strerror(result));
+	}
+
+	workqueues[num] = wq;
+}
+
+void
+workqueue_printstats(void)
+{
+	struct workqueue *wq;
+	unsigned i, depth, maxdepth, delayed;
+	uint32_t queued, run, maxlat;
+	uint64_t totallat;
+
+	spinlock_acquire(&delayed_lock);
+	delayed = delayed_count;
+	spinlock_release(&delayed_lock);
+
+	kprintf("Work queues (%u delayed items pending):\n", delayed);
+	for (i=0; i<MAXCPUS; i++) {
+		wq = workqueues[i];
+		if (wq == NULL) {
+			continue;
+		}
+		/* copy out so we don't kprintf with a spinlock held */
+		spinlock_acquire(&wq->wq_lock);
+		depth = wq->wq_depth;
+		maxdepth = wq->wq_maxdepth;
+		queued = wq->wq_queued;
+		run = wq->wq_run;
+		totallat = wq->wq_totallat;
+		maxlat = wq->wq_maxlat;
+		spinlock_release(&wq->wq_lock);
+
+		kprintf("  cpu%u: depth %u (max %u), queued %u, run %u, "
+			"latency avg %lu us max %lu us\n",
+			i, depth, maxdepth, queued, run,
+			run ? (unsigned long)(totallat / run / 1000) : 0UL,
+			(unsigned long)(maxlat / 1000));
+	}
+}
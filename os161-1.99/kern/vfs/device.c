@@ -36,6 +36,7 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <kern/fcntl.h>
+#include <kern/poll.h>
 #include <stat.h>
 #include <lib.h>
 #include <uio.h>
@@ -123,6 +124,24 @@ dev_write(struct vnode *v, struct uio *uio)
 	return d->d_io(d, uio);
 }
 
+/*
+ * Called for copy_file_range(). Devices have no way to copy from
+ * another object, so the caller reads and writes.
+ */
+static
+int
+dev_copyfrom(struct vnode *v, off_t pos, struct vnode *src, off_t srcpos,
+	     size_t len, size_t *copied)
+{
+	(void)v;
+	(void)pos;
+	(void)src;
+	(void)srcpos;
+	(void)len;
+	*copied = 0;
+	return EXDEV;
+}
+
 /*
  * Called for ioctl(). Just pass through.
  */
@@ -134,6 +153,23 @@ dev_ioctl(struct vnode *v, int op, userptr_t data)
 	return d->d_ioctl(d, op, data);
 }
 
+/*
+ * Called for poll(). Pass through; devices without a poll function
+ * never block.
+ */
+static
+int
+dev_poll(struct vnode *v, int events, struct pollset *ps, int *revents)
+{
+	struct device *d = v->vn_data;
+
+	if (d->d_poll == NULL) {
+		*revents = events & (POLLIN | POLLOUT);
+		return 0;
+	}
+	return d->d_poll(d, events, ps, revents);
+}
+
 /*
  * Called for stat().
  * Set the type and the size (block devices only).
@@ -422,7 +458,9 @@ static const struct vnode_ops dev_vnode_ops = {
 	null_io,      /* readlink */
 	null_io,      /* getdirentry */
 	dev_write,
+	dev_copyfrom,
 	dev_ioctl,
+	dev_poll,
 	dev_stat,
 	dev_gettype,
 	dev_tryseek,
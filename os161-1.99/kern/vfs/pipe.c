@@ -0,0 +1,712 @@
+/*
+ * Pipes.
+ *
+ * The data lives in a power-of-two ring buffer indexed by free-running
+ * head and tail counters, so the amount buffered is just head - tail
+ * and wrapping is a mask. Readers and writers sleep on their own
+ * condition variables and are woken by the other side.
+ *
+ * Writes of up to PIPE_BUF bytes wait until there is room for all of
+ * them and then go in in one piece, so they are never interleaved
+ * with other writers' data. Longer writes go in as space appears.
+ *
+ * Large page-aligned writes skip the ring: the writer loans its pages
+ * to the pipe (see vm_translate) and sleeps while readers copy out of
+ * them directly through kseg0, so the data is copied once instead of
+ * twice. The writer's pages can't go away while it sleeps here, since
+ * its address space lives as long as it is in the kernel. Anything
+ * already in the ring is read before the loan, and ring writers wait
+ * for a loan to finish, so the byte order is preserved.
+ *
+ * poll()ers of either end wait on the one pollq, which is woken
+ * along with the condition variables.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <kern/poll.h>
+#include <kern/stat.h>
+#include <kern/stattypes.h>
+#include <limits.h>
+#include <lib.h>
+#include <uio.h>
+#include <synch.h>
+#include <addrspace.h>
+#include <vm.h>
+#include <vnode.h>
+#include <pollq.h>
+#include <pipe.h>
+
+#define PIPE_SIZE	(4 * PAGE_SIZE)		/* ring size; power of two */
+#define PIPE_MASK	(PIPE_SIZE - 1)
+#define PIPE_LOANMAX	16			/* pages loaned at once */
+
+/* Writes at least this long, and page-aligned, use page loaning. */
+#define PIPE_LOANMIN	(2 * PAGE_SIZE)
+
+struct pipe {
+	struct vnode pp_rvn;		/* read end */
+	struct vnode pp_wvn;		/* write end */
+
+	struct lock *pp_lock;		/* protects everything below */
+	struct cv *pp_rcv;		/* readers wait here */
+	struct cv *pp_wcv;		/* writers wait here */
+	struct pollq pp_pollq;		/* poll()ers of either end wait here */
+
+	char *pp_buf;			/* the ring */
+	unsigned pp_head;		/* total bytes written to the ring */
+	unsigned pp_tail;		/* total bytes read from the ring */
+
+	bool pp_rclosed;		/* no more readers */
+	bool pp_wclosed;		/* no more writers */
+	unsigned pp_nreclaimed;		/* ends whose vnodes are gone */
+
+	/* the current loan, if pp_loanlen > 0 */
+	paddr_t pp_loan[PIPE_LOANMAX];
+	size_t pp_loanlen;		/* bytes loaned */
+	size_t pp_loandone;		/* bytes read from the loan */
+};
+
+static
+void
+pipe_destroy(struct pipe *pp)
+{
+	kfree(pp->pp_buf);
+	pollq_cleanup(&pp->pp_pollq);
+	cv_destroy(pp->pp_wcv);
+	cv_destroy(pp->pp_rcv);
+	lock_destroy(pp->pp_lock);
+	kfree(pp);
+}
+
+/*
+ * Wake readers, or writers, including any poll()ing. Caller holds
+ * the lock.
+ */
+static
+void
+pipe_wakereaders(struct pipe *pp)
+{
+	cv_broadcast(pp->pp_rcv, pp->pp_lock);
+	pollq_wakeup(&pp->pp_pollq);
+}
+
+static
+void
+pipe_wakewriters(struct pipe *pp)
+{
+	cv_broadcast(pp->pp_wcv, pp->pp_lock);
+	pollq_wakeup(&pp->pp_pollq);
+}
+
+////////////////////////////////////////////////////////////
+// reading
+
+/*
+ * Copy out of the ring. Caller holds the lock; there's data.
+ */
+static
+int
+pipe_readring(struct pipe *pp, struct uio *uio)
+{
+	unsigned avail, start, len;
+	int result;
+
+	avail = pp->pp_head - pp->pp_tail;
+	while (avail > 0 && uio->uio_resid > 0) {
+		/* up to the end of the ring at most */
+		start = pp->pp_tail & PIPE_MASK;
+		len = PIPE_SIZE - start;
+		if (len > avail) {
+			len = avail;
+		}
+		if (len > uio->uio_resid) {
+			len = uio->uio_resid;
+		}
+		result = uiomove(pp->pp_buf + start, len, uio);
+		if (result) {
+			return result;
+		}
+		pp->pp_tail += len;
+		avail -= len;
+	}
+	return 0;
+}
+
+/*
+ * Copy out of the loaned pages. Caller holds the lock; there's a loan.
+ */
+static
+int
+pipe_readloan(struct pipe *pp, struct uio *uio)
+{
+	unsigned page, off;
+	size_t len;
+	int result;
+
+	while (pp->pp_loandone < pp->pp_loanlen && uio->uio_resid > 0) {
+		page = pp->pp_loandone / PAGE_SIZE;
+		off = pp->pp_loandone % PAGE_SIZE;
+		len = PAGE_SIZE - off;
+		if (len > uio->uio_resid) {
+			len = uio->uio_resid;
+		}
+		result = uiomove((char *)PADDR_TO_KVADDR(pp->pp_loan[page])
+				 + off, len, uio);
+		if (result) {
+			return result;
+		}
+		pp->pp_loandone += len;
+	}
+	return 0;
+}
+
+static
+int
+pipe_read(struct vnode *v, struct uio *uio)
+{
+	struct pipe *pp = v->vn_data;
+	int result;
+
+	KASSERT(uio->uio_rw == UIO_READ);
+	if (v != &pp->pp_rvn) {
+		return EBADF;
+	}
+
+	lock_acquire(pp->pp_lock);
+	while (pp->pp_head == pp->pp_tail && pp->pp_loanlen == 0 &&
+	       !pp->pp_wclosed) {
+		cv_wait(pp->pp_rcv, pp->pp_lock);
+	}
+
+	/* the ring first: it was written before any loan */
+	if (pp->pp_head != pp->pp_tail) {
+		result = pipe_readring(pp, uio);
+	}
+	else if (pp->pp_loanlen > 0) {
+		result = pipe_readloan(pp, uio);
+	}
+	else {
+		/* EOF */
+		result = 0;
+	}
+	pipe_wakewriters(pp);
+	lock_release(pp->pp_lock);
+	return result;
+}
+
+////////////////////////////////////////////////////////////
+// writing
+
+/*
+ * Loan the writer's pages to readers, a batch at a time, for as many
+ * whole pages as the uio has. Caller holds the lock.
+ */
+static
+int
+pipe_writeloan(struct pipe *pp, struct uio *uio)
+{
+	struct iovec *iov = uio->uio_iov;
+	vaddr_t base;
+	size_t len;
+	unsigned i, npages;
+	int result;
+
+	while (uio->uio_resid >= PAGE_SIZE) {
+		while (pp->pp_loanlen > 0 && !pp->pp_rclosed) {
+			/* another writer's loan */
+			cv_wait(pp->pp_wcv, pp->pp_lock);
+		}
+		if (pp->pp_rclosed) {
+			return EPIPE;
+		}
+
+		base = (vaddr_t)iov->iov_ubase;
+		npages = uio->uio_resid / PAGE_SIZE;
+		if (npages > PIPE_LOANMAX) {
+			npages = PIPE_LOANMAX;
+		}
+		for (i=0; i<npages; i++) {
+			result = vm_translate(uio->uio_space,
+					      base + i * PAGE_SIZE, false,
+					      &pp->pp_loan[i]);
+			if (result) {
+				return result;
+			}
+		}
+		pp->pp_loanlen = npages * PAGE_SIZE;
+		pp->pp_loandone = 0;
+		pipe_wakereaders(pp);
+
+		while (pp->pp_loandone < pp->pp_loanlen && !pp->pp_rclosed) {
+			cv_wait(pp->pp_wcv, pp->pp_lock);
+		}
+
+		/* account for what was taken, as uiomove would have */
+		len = pp->pp_loandone;
+		pp->pp_loanlen = 0;
+		pp->pp_loandone = 0;
+		iov->iov_ubase = (userptr_t)((vaddr_t)iov->iov_ubase + len);
+		iov->iov_len -= len;
+		uio->uio_resid -= len;
+		uio->uio_offset += len;
+
+		/* let the next writer in */
+		pipe_wakewriters(pp);
+	}
+	return 0;
+}
+
+/*
+ * Copy into the ring. Caller holds the lock.
+ */
+static
+int
+pipe_writering(struct pipe *pp, struct uio *uio)
+{
+	unsigned space, need, start, len;
+	int result;
+
+	/* short writes are atomic: wait for room for all of it */
+	need = uio->uio_resid <= PIPE_BUF ? uio->uio_resid : 1;
+
+	while (uio->uio_resid > 0) {
+		while (!pp->pp_rclosed &&
+		       (pp->pp_loanlen > 0 ||
+			PIPE_SIZE - (pp->pp_head - pp->pp_tail) < need)) {
+			cv_wait(pp->pp_wcv, pp->pp_lock);
+		}
+		if (pp->pp_rclosed) {
+			return EPIPE;
+		}
+
+		space = PIPE_SIZE - (pp->pp_head - pp->pp_tail);
+		while (space > 0 && uio->uio_resid > 0) {
+			start = pp->pp_head & PIPE_MASK;
+			len = PIPE_SIZE - start;
+			if (len > space) {
+				len = space;
+			}
+			if (len > uio->uio_resid) {
+				len = uio->uio_resid;
+			}
+			result = uiomove(pp->pp_buf + start, len, uio);
+			if (result) {
+				return result;
+			}
+			pp->pp_head += len;
+			space -= len;
+		}
+		pipe_wakereaders(pp);
+	}
+	return 0;
+}
+
+static
+int
+pipe_write(struct vnode *v, struct uio *uio)
+{
+	struct pipe *pp = v->vn_data;
+	size_t start;
+	int result;
+
+	KASSERT(uio->uio_rw == UIO_WRITE);
+	if (v != &pp->pp_wvn) {
+		return EBADF;
+	}
+
+	start = uio->uio_resid;
+	lock_acquire(pp->pp_lock);
+	if (uio->uio_segflg == UIO_USERSPACE && uio->uio_iovcnt == 1 &&
+	    uio->uio_resid >= PIPE_LOANMIN &&
+	    ((vaddr_t)uio->uio_iov->iov_ubase & ~PAGE_FRAME) == 0) {
+		result = pipe_writeloan(pp, uio);
+		/* a bad page just means doing it the slow way */
+		if (result == EFAULT) {
+			result = 0;
+		}
+	}
+	else {
+		result = 0;
+	}
+	if (result == 0) {
+		/* the rest, or all of it */
+		result = pipe_writering(pp, uio);
+	}
+	lock_release(pp->pp_lock);
+
+	/* a short write is not an error, unless nothing was written */
+	if (result == EPIPE && uio->uio_resid < start) {
+		result = 0;
+	}
+	return result;
+}
+
+////////////////////////////////////////////////////////////
+// vnode ops
+
+static
+int
+pipe_open(struct vnode *v, int flags)
+{
+	/* pipes can't be opened by name */
+	(void)v;
+	(void)flags;
+	return EINVAL;
+}
+
+/*
+ * Last close of one end. Wake up the other side so it sees EOF or
+ * EPIPE.
+ */
+static
+int
+pipe_close(struct vnode *v)
+{
+	struct pipe *pp = v->vn_data;
+
+	lock_acquire(pp->pp_lock);
+	if (v == &pp->pp_rvn) {
+		pp->pp_rclosed = true;
+		pipe_wakewriters(pp);
+	}
+	else {
+		pp->pp_wclosed = true;
+		pipe_wakereaders(pp);
+	}
+	lock_release(pp->pp_lock);
+	return 0;
+}
+
+/*
+ * One end's vnode is gone. The pipe goes with the second.
+ */
+static
+int
+pipe_reclaim(struct vnode *v)
+{
+	struct pipe *pp = v->vn_data;
+	bool last;
+
+	VOP_CLEANUP(v);
+
+	lock_acquire(pp->pp_lock);
+	pp->pp_nreclaimed++;
+	last = (pp->pp_nreclaimed == 2);
+	lock_release(pp->pp_lock);
+
+	if (last) {
+		pipe_destroy(pp);
+	}
+	return 0;
+}
+
+/*
+ * The read end is readable when there's data (or a loan) to read, and
+ * hung up once there are no writers; the write end is writable when
+ * a PIPE_BUF-sized write would go straight in, and in error once
+ * there are no readers.
+ */
+static
+int
+pipe_poll(struct vnode *v, int events, struct pollset *ps, int *revents)
+{
+	struct pipe *pp = v->vn_data;
+	int ready = 0;
+
+	lock_acquire(pp->pp_lock);
+	pollq_register(&pp->pp_pollq, ps);
+	if (v == &pp->pp_rvn) {
+		if (pp->pp_head != pp->pp_tail || pp->pp_loanlen > 0) {
+			ready |= events & POLLIN;
+		}
+		if (pp->pp_wclosed) {
+			ready |= POLLHUP;
+		}
+	}
+	else {
+		if (pp->pp_loanlen == 0 &&
+		    PIPE_SIZE - (pp->pp_head - pp->pp_tail) >= PIPE_BUF) {
+			ready |= events & POLLOUT;
+		}
+		if (pp->pp_rclosed) {
+			ready |= POLLERR;
+		}
+	}
+	lock_release(pp->pp_lock);
+
+	*revents = ready;
+	return 0;
+}
+
+static
+int
+pipe_stat(struct vnode *v, struct stat *st)
+{
+	struct pipe *pp = v->vn_data;
+
+	bzero(st, sizeof(*st));
+	st->st_mode = _S_IFIFO;
+	st->st_nlink = 1;
+	lock_acquire(pp->pp_lock);
+	st->st_size = pp->pp_head - pp->pp_tail;
+	lock_release(pp->pp_lock);
+	return 0;
+}
+
+static
+int
+pipe_gettype(struct vnode *v, mode_t *ret)
+{
+	(void)v;
+	*ret = _S_IFIFO;
+	return 0;
+}
+
+static
+int
+pipe_tryseek(struct vnode *v, off_t pos)
+{
+	(void)v;
+	(void)pos;
+	return ESPIPE;
+}
+
+static
+int
+pipe_fsync(struct vnode *v)
+{
+	(void)v;
+	return 0;
+}
+
+/* there's nothing better than reading and writing */
+static
+int
+pipe_copyfrom(struct vnode *v, off_t pos, struct vnode *src, off_t srcpos,
+	      size_t len, size_t *copied)
+{
+	(void)v;
+	(void)pos;
+	(void)src;
+	(void)srcpos;
+	(void)len;
+	*copied = 0;
+	return EXDEV;
+}
+
+static
+int
+pipe_badio(struct vnode *v, struct uio *uio)
+{
+	(void)v;
+	(void)uio;
+	return EINVAL;
+}
+
+static
+int
+pipe_ioctl(struct vnode *v, int op, userptr_t data)
+{
+	(void)v;
+	(void)op;
+	(void)data;
+	return EIOCTL;
+}
+
+static
+int
+pipe_mmap(struct vnode *v)
+{
+	(void)v;
+	return EUNIMP;
+}
+
+static
+int
+pipe_truncate(struct vnode *v, off_t len)
+{
+	(void)v;
+	(void)len;
+	return EINVAL;
+}
+
+/*
+ * Directory operations, none of which apply.
+ */
+
+static
+int
+pipe_creat(struct vnode *v, const char *name, bool excl, mode_t mode,
+	   struct vnode **result)
+{
+	(void)v;
+	(void)name;
+	(void)excl;
+	(void)mode;
+	(void)result;
+	return ENOTDIR;
+}
+
+static
+int
+pipe_symlink(struct vnode *v, const char *contents, const char *name)
+{
+	(void)v;
+	(void)contents;
+	(void)name;
+	return ENOTDIR;
+}
+
+static
+int
+pipe_mkdir(struct vnode *v, const char *name, mode_t mode)
+{
+	(void)v;
+	(void)name;
+	(void)mode;
+	return ENOTDIR;
+}
+
+static
+int
+pipe_link(struct vnode *v, const char *name, struct vnode *file)
+{
+	(void)v;
+	(void)name;
+	(void)file;
+	return ENOTDIR;
+}
+
+static
+int
+pipe_nameop(struct vnode *v, const char *name)
+{
+	(void)v;
+	(void)name;
+	return ENOTDIR;
+}
+
+static
+int
+pipe_rename(struct vnode *v, const char *n1, struct vnode *v2, const char *n2)
+{
+	(void)v;
+	(void)n1;
+	(void)v2;
+	(void)n2;
+	return ENOTDIR;
+}
+
+static
+int
+pipe_lookup(struct vnode *v, char *pathname, struct vnode **result)
+{
+	(void)v;
+	(void)pathname;
+	(void)result;
+	return ENOTDIR;
+}
+
+static
+int
+pipe_lookparent(struct vnode *v, char *pathname, struct vnode **result,
+		char *namebuf, size_t buflen)
+{
+	(void)v;
+	(void)pathname;
+	(void)result;
+	(void)namebuf;
+	(void)buflen;
+	return ENOTDIR;
+}
+
+static const struct vnode_ops pipe_vnode_ops = {
+	VOP_MAGIC,
+
+	pipe_open,
+	pipe_close,
+	pipe_reclaim,
+	pipe_read,
+	pipe_badio,	/* readlink */
+	pipe_badio,	/* getdirentry */
+	pipe_write,
+	pipe_copyfrom,
+	pipe_ioctl,
+	pipe_poll,
+	pipe_stat,
+	pipe_gettype,
+	pipe_tryseek,
+	pipe_fsync,
+	pipe_mmap,
+	pipe_truncate,
+	pipe_badio,	/* namefile */
+	pipe_creat,
+	pipe_symlink,
+	pipe_mkdir,
+	pipe_link,
+	pipe_nameop,	/* remove */
+	pipe_nameop,	/* rmdir */
+	pipe_rename,
+	pipe_lookup,
+	pipe_lookparent,
+};
+
+////////////////////////////////////////////////////////////
+// creation
+
+int
+pipe_create(struct vnode **readret, struct vnode **writeret)
+{
+	struct pipe *pp;
+
+	pp = kmalloc(sizeof(*pp));
+	if (pp == NULL) {
+		return ENOMEM;
+	}
+	pp->pp_buf = kmalloc(PIPE_SIZE);
+	if (pp->pp_buf == NULL) {
+		kfree(pp);
+		return ENOMEM;
+	}
+	pp->pp_lock = lock_create("pipe");
+	if (pp->pp_lock == NULL) {
+		kfree(pp->pp_buf);
+		kfree(pp);
+		return ENOMEM;
+	}
+	pp->pp_rcv = cv_create("pipe-read");
+	if (pp->pp_rcv == NULL) {
+		lock_destroy(pp->pp_lock);
+		kfree(pp->pp_buf);
+		kfree(pp);
+		return ENOMEM;
+	}
+	pp->pp_wcv = cv_create("pipe-write");
+	if (pp->pp_wcv == NULL) {
+		cv_destroy(pp->pp_rcv);
+		lock_destroy(pp->pp_lock);
+		kfree(pp->pp_buf);
+		kfree(pp);
+		return ENOMEM;
+	}
+
+	pp->pp_head = pp->pp_tail = 0;
+	pp->pp_rclosed = pp->pp_wclosed = false;
+	pp->pp_nreclaimed = 0;
+	pp->pp_loanlen = 0;
+	pp->pp_loandone = 0;
+	pollq_init(&pp->pp_pollq);
+
+	VOP_INIT(&pp->pp_rvn, &pipe_vnode_ops, NULL, pp);
+	VOP_INIT(&pp->pp_wvn, &pipe_vnode_ops, NULL, pp);
+
+	/* hand them back open, for vfs_close */
+	VOP_INCOPEN(&pp->pp_rvn);
+	VOP_INCOPEN(&pp->pp_wvn);
+
+	*readret = &pp->pp_rvn;
+	*writeret = &pp->pp_wvn;
+	return 0;
+}
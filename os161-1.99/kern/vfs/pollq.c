@@ -0,0 +1,183 @@
+/*
+ * Poll wait queues. See pollq.h.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <callout.h>
+#include <pollq.h>
+
+/* One pollset's registration on one queue. */
+struct pollent {
+	struct pollset *pe_set;
+	struct pollq *pe_q;
+	struct pollent *pe_next;
+	struct pollent **pe_prevp;	/* pointer to us, for removal */
+};
+
+struct pollset {
+	struct spinlock ps_lock;	/* protects ps_woken, ps_timedout */
+	struct wchan *ps_wchan;		/* the poller sleeps here */
+	bool ps_woken;			/* a queue was woken since the last wait */
+	bool ps_timedout;		/* the timeout ran out */
+	struct callout ps_callout;	/* the timeout */
+	bool ps_hastimeout;
+	unsigned ps_nents, ps_maxents;
+	struct pollent ps_ents[];
+};
+
+////////////////////////////////////////////////////////////
+// queues
+
+void
+pollq_init(struct pollq *pq)
+{
+	spinlock_init(&pq->pq_lock);
+	pq->pq_head = NULL;
+}
+
+void
+pollq_cleanup(struct pollq *pq)
+{
+	KASSERT(pq->pq_head == NULL);
+	spinlock_cleanup(&pq->pq_lock);
+}
+
+void
+pollq_register(struct pollq *pq, struct pollset *ps)
+{
+	struct pollent *pe;
+
+	if (ps == NULL) {
+		return;
+	}
+	KASSERT(ps->ps_nents < ps->ps_maxents);
+	pe = &ps->ps_ents[ps->ps_nents++];
+	pe->pe_set = ps;
+	pe->pe_q = pq;
+
+	spinlock_acquire(&pq->pq_lock);
+	pe->pe_next = pq->pq_head;
+	if (pe->pe_next != NULL) {
+		pe->pe_next->pe_prevp = &pe->pe_next;
+	}
+	pe->pe_prevp = &pq->pq_head;
+	pq->pq_head = pe;
+	spinlock_release(&pq->pq_lock);
+}
+
+/*
+ * Mark PS woken and wake its poller.
+ */
+static
+void
+pollset_wake(struct pollset *ps, bool timeout)
+{
+	spinlock_acquire(&ps->ps_lock);
+	ps->ps_woken = true;
+	if (timeout) {
+		ps->ps_timedout = true;
+	}
+	spinlock_release(&ps->ps_lock);
+	wchan_wakeall(ps->ps_wchan);
+}
+
+void
+pollq_wakeup(struct pollq *pq)
+{
+	struct pollent *pe;
+
+	spinlock_acquire(&pq->pq_lock);
+	for (pe = pq->pq_head; pe != NULL; pe = pe->pe_next) {
+		pollset_wake(pe->pe_set, false);
+	}
+	spinlock_release(&pq->pq_lock);
+}
+
+////////////////////////////////////////////////////////////
+// pollsets
+
+static
+void
+pollset_timeout(void *arg)
+{
+	pollset_wake(arg, true);
+}
+
+struct pollset *
+pollset_create(unsigned maxents)
+{
+	struct pollset *ps;
+
+	ps = kmalloc(sizeof(*ps) + maxents * sizeof(struct pollent));
+	if (ps == NULL) {
+		return NULL;
+	}
+	ps->ps_wchan = wchan_create("poll");
+	if (ps->ps_wchan == NULL) {
+		kfree(ps);
+		return NULL;
+	}
+	spinlock_init(&ps->ps_lock);
+	ps->ps_woken = false;
+	ps->ps_timedout = false;
+	callout_init(&ps->ps_callout, pollset_timeout, ps);
+	ps->ps_hastimeout = false;
+	ps->ps_nents = 0;
+	ps->ps_maxents = maxents;
+	return ps;
+}
+
+void
+pollset_settimeout(struct pollset *ps, unsigned ticks)
+{
+	KASSERT(!ps->ps_hastimeout);
+	ps->ps_hastimeout = true;
+	callout_schedule(&ps->ps_callout, ticks > 0 ? ticks : 1);
+}
+
+bool
+pollset_wait(struct pollset *ps)
+{
+	bool timedout;
+
+	spinlock_acquire(&ps->ps_lock);
+	if (!ps->ps_woken) {
+		/* holding the wchan lock, a wakeup can't get in before we sleep */
+		wchan_lock(ps->ps_wchan);
+		spinlock_release(&ps->ps_lock);
+		wchan_sleep(ps->ps_wchan);
+		spinlock_acquire(&ps->ps_lock);
+	}
+	ps->ps_woken = false;
+	timedout = ps->ps_timedout;
+	spinlock_release(&ps->ps_lock);
+	return timedout;
+}
+
+void
+pollset_destroy(struct pollset *ps)
+{
+	struct pollent *pe;
+	struct pollq *pq;
+	unsigned i;
+
+	if (ps->ps_hastimeout) {
+		callout_stop(&ps->ps_callout);
+	}
+	for (i=0; i<ps->ps_nents; i++) {
+		pe = &ps->ps_ents[i];
+		pq = pe->pe_q;
+		spinlock_acquire(&pq->pq_lock);
+		*pe->pe_prevp = pe->pe_next;
+		if (pe->pe_next != NULL) {
+			pe->pe_next->pe_prevp = pe->pe_prevp;
+		}
+		spinlock_release(&pq->pq_lock);
+	}
+	wchan_destroy(ps->ps_wchan);
+	spinlock_cleanup(&ps->ps_lock);
+	kfree(ps);
+}
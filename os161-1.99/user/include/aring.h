@@ -0,0 +1,14 @@
+#ifndef _ARING_H_
+#define _ARING_H_
+
+/*
+ * Asynchronous I/O rings. Get struct aring and friends from the
+ * kernel; see kern/aring.h for how the ring is used.
+ */
+#include <sys/types.h>
+#include <kern/aring.h>
+
+int aring_setup(struct aring *ring);
+int aring_enter(unsigned min_complete);
+
+#endif /* _ARING_H_ */
@@ -0,0 +1,17 @@
+#ifndef _POLL_H_
+#define _POLL_H_
+
+/*
+ * Waiting for any of several descriptors to become ready. Get struct
+ * pollfd and the POLL* event bits from the kernel.
+ *
+ * TIMEOUT is in milliseconds; 0 means don't wait and negative means
+ * wait forever. Returns the number of descriptors with nonzero
+ * revents, 0 on timeout, or -1 on error.
+ */
+#include <sys/types.h>
+#include <kern/poll.h>
+
+int poll(struct pollfd *fds, unsigned nfds, int timeout);
+
+#endif /* _POLL_H_ */
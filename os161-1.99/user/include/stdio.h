@@ -37,10 +37,64 @@
 #include <kern/types.h>
 #include <types/size_t.h>
 #include <sys/null.h>
+#include <umutex.h>
 
 /* Constant returned by a bunch of stdio functions on error */
 #define EOF (-1)
 
+/* Buffering modes for setvbuf */
+#define _IOFBF 0		/* fully buffered */
+#define _IOLBF 1		/* line buffered */
+#define _IONBF 2		/* unbuffered */
+
+/* Default buffer size */
+#define BUFSIZ 1024
+
+/*
+ * Streams. The buffer holds either pending output (_pos bytes not
+ * yet written) or input (_len bytes read, of which _pos have been
+ * consumed), according to the __SRD/__SWR state in _flags; the
+ * fields are for libc internal use only.
+ */
+typedef struct __file {
+	int _fd;			/* underlying file descriptor */
+	int _flags;			/* __S* flags below */
+	int _mode;			/* _IOFBF, _IOLBF, or _IONBF */
+	unsigned char *_buf;		/* the buffer */
+	size_t _bufsize;		/* its size */
+	size_t _pos;			/* current position in the buffer */
+	size_t _len;			/* bytes of valid input in the buffer */
+	unsigned char _nbuf;		/* one-byte buffer for _IONBF */
+	struct umutex _lock;		/* protects all of the above */
+	struct __file *_next;		/* list of all open streams */
+} FILE;
+
+#define __SRD		0x001	/* buffer holds input */
+#define __SWR		0x002	/* buffer holds output */
+#define __SCANRD	0x004	/* opened for reading */
+#define __SCANWR	0x008	/* opened for writing */
+#define __SEOF		0x010	/* saw end of file */
+#define __SERR		0x020	/* saw an error */
+#define __SMYBUF	0x040	/* buffer was malloc'd by stdio */
+#define __SMYFILE	0x080	/* FILE was malloc'd by fopen */
+
+extern FILE *stdin;
+extern FILE *stdout;
+extern FILE *stderr;
+
+/*
+ * Stream internals. __sflush, __srefill, and __swrite expect the
+ * stream's _lock to be held; __stdio_flushall (called by exit) takes
+ * the locks itself.
+ * (for libc internal use only)
+ */
+extern FILE *__sfiles;			/* protected by __sfileslock */
+extern struct umutex __sfileslock;
+int __sflush(FILE *f);
+int __srefill(FILE *f);
+size_t __swrite(FILE *f, const void *data, size_t len);
+void __stdio_flushall(void);
+
 /*
  * The actual guts of printf
  * (for libc internal use only)
@@ -69,4 +123,23 @@ int putchar(int);
 /* Reads one character (0-255) or returns EOF on error. */
 int getchar(void);
 
+/* Streams */
+FILE *fopen(const char *path, const char *mode);
+int fclose(FILE *f);
+size_t fread(void *buf, size_t size, size_t nmemb, FILE *f);
+size_t fwrite(const void *buf, size_t size, size_t nmemb, FILE *f);
+int fflush(FILE *f);		/* NULL flushes every stream */
+int setvbuf(FILE *f, char *buf, int mode, size_t size);
+int fgetc(FILE *f);
+int getc(FILE *f);
+int fputc(int ch, FILE *f);
+int putc(int ch, FILE *f);
+int fputs(const char *s, FILE *f);
+int fprintf(FILE *f, const char *fmt, ...);
+int vfprintf(FILE *f, const char *fmt, __va_list ap);
+int feof(FILE *f);
+int ferror(FILE *f);
+void clearerr(FILE *f);
+int fileno(FILE *f);
+
 #endif /* _STDIO_H_ */
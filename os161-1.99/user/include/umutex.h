@@ -0,0 +1,24 @@
+#ifndef _UMUTEX_H_
+#define _UMUTEX_H_
+
+/*
+ * Mutexes for threads (or processes sharing memory).
+ *
+ * Locking and unlocking an uncontended mutex is a single atomic
+ * operation in user space; the kernel is only entered, via
+ * futex_wait/futex_wake, when a thread actually has to sleep or
+ * there is a sleeper to wake.
+ */
+
+struct umutex {
+	volatile int um_state;	/* 0 free, 1 held, 2 held with waiters */
+};
+
+#define UMUTEX_INITIALIZER { 0 }
+
+void umutex_init(struct umutex *m);
+void umutex_lock(struct umutex *m);
+int umutex_trylock(struct umutex *m);	/* 0 if acquired, -1 if not */
+void umutex_unlock(struct umutex *m);
+
+#endif /* _UMUTEX_H_ */
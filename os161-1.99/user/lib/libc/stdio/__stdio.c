@@ -0,0 +1,194 @@
+/*
+ * Stream buffering. See stdio.h.
+ *
+ * stdout is line buffered so interactive output shows up a line at a
+ * time, stderr is unbuffered so diagnostics are never held back, and
+ * streams from fopen are fully buffered.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+
+static unsigned char __stdinbuf[BUFSIZ];
+static unsigned char __stdoutbuf[BUFSIZ];
+
+static FILE __stderr = {
+	STDERR_FILENO, __SCANWR, _IONBF,
+	&__stderr._nbuf, 1, 0, 0, 0, UMUTEX_INITIALIZER, NULL
+};
+static FILE __stdout = {
+	STDOUT_FILENO, __SCANWR, _IOLBF,
+	__stdoutbuf, BUFSIZ, 0, 0, 0, UMUTEX_INITIALIZER, &__stderr
+};
+static FILE __stdin = {
+	STDIN_FILENO, __SCANRD, _IOLBF,
+	__stdinbuf, BUFSIZ, 0, 0, 0, UMUTEX_INITIALIZER, &__stdout
+};
+
+FILE *stdin = &__stdin;
+FILE *stdout = &__stdout;
+FILE *stderr = &__stderr;
+
+FILE *__sfiles = &__stdin;
+struct umutex __sfileslock = UMUTEX_INITIALIZER;
+
+/*
+ * Write LEN bytes straight to the file, retrying short writes.
+ */
+static
+int
+__swriteall(FILE *f, const unsigned char *data, size_t len)
+{
+	int r;
+
+	while (len > 0) {
+		r = write(f->_fd, data, len);
+		if (r <= 0) {
+			f->_flags |= __SERR;
+			return EOF;
+		}
+		data += r;
+		len -= r;
+	}
+	return 0;
+}
+
+/*
+ * Push out pending output, or throw away unread input (backing the
+ * file offset up over it, if the file can seek, so the next read or
+ * write happens where the caller thinks it will).
+ */
+int
+__sflush(FILE *f)
+{
+	int result = 0;
+
+	if (f->_flags & __SWR) {
+		result = __swriteall(f, f->_buf, f->_pos);
+	}
+	else if ((f->_flags & __SRD) && f->_pos < f->_len) {
+		lseek(f->_fd, -(off_t)(f->_len - f->_pos), SEEK_CUR);
+	}
+	f->_flags &= ~(__SRD | __SWR);
+	f->_pos = f->_len = 0;
+	return result;
+}
+
+/*
+ * Refill the buffer with one read. Returns EOF at end of file or on
+ * error.
+ */
+int
+__srefill(FILE *f)
+{
+	int r;
+
+	if (!(f->_flags & __SCANRD)) {
+		f->_flags |= __SERR;
+		errno = EBADF;
+		return EOF;
+	}
+	if (f->_flags & __SWR) {
+		if (__sflush(f)) {
+			return EOF;
+		}
+	}
+
+	/* show any prompt before waiting for the answer */
+	if (f->_mode != _IOFBF && f != stdout) {
+		umutex_lock(&stdout->_lock);
+		__sflush(stdout);
+		umutex_unlock(&stdout->_lock);
+	}
+
+	r = read(f->_fd, f->_buf, f->_bufsize);
+	if (r < 0) {
+		f->_flags |= __SERR;
+		return EOF;
+	}
+	if (r == 0) {
+		f->_flags |= __SEOF;
+		return EOF;
+	}
+	f->_flags |= __SRD;
+	f->_pos = 0;
+	f->_len = r;
+	return 0;
+}
+
+/*
+ * Buffer LEN bytes of output, writing the buffer out each time it
+ * fills. Writes at least a buffer long skip the copy and go straight
+ * to the file. Returns the number of bytes accepted.
+ */
+size_t
+__swrite(FILE *f, const void *data, size_t len)
+{
+	const unsigned char *p = data;
+	size_t done, n, i;
+	int newline = 0;
+
+	if (!(f->_flags & __SCANWR)) {
+		f->_flags |= __SERR;
+		errno = EBADF;
+		return 0;
+	}
+	if (f->_flags & __SRD) {
+		__sflush(f);
+	}
+
+	if (f->_mode == _IONBF) {
+		return __swriteall(f, p, len) ? 0 : len;
+	}
+
+	f->_flags |= __SWR;
+	done = 0;
+	while (done < len) {
+		if (f->_pos == 0 && len - done >= f->_bufsize) {
+			if (__swriteall(f, p + done, len - done)) {
+				return done;
+			}
+			return len;
+		}
+		n = f->_bufsize - f->_pos;
+		if (n > len - done) {
+			n = len - done;
+		}
+		for (i=0; i<n; i++) {
+			f->_buf[f->_pos++] = p[done + i];
+			if (p[done + i] == '\n') {
+				newline = 1;
+			}
+		}
+		done += n;
+		if (f->_pos == f->_bufsize) {
+			if (__sflush(f)) {
+				return done;
+			}
+			f->_flags |= __SWR;
+		}
+	}
+
+	if (f->_mode == _IOLBF && newline) {
+		__sflush(f);
+	}
+	return len;
+}
+
+/*
+ * Flush every open stream. Called by exit().
+ */
+void
+__stdio_flushall(void)
+{
+	FILE *f;
+
+	umutex_lock(&__sfileslock);
+	for (f = __sfiles; f != NULL; f = f->_next) {
+		umutex_lock(&f->_lock);
+		__sflush(f);
+		umutex_unlock(&f->_lock);
+	}
+	umutex_unlock(&__sfileslock);
+}
@@ -0,0 +1,31 @@
+/*
+ * feof, ferror, clearerr, and fileno.
+ */
+
+#include <stdio.h>
+
+int
+feof(FILE *f)
+{
+	return (f->_flags & __SEOF) != 0;
+}
+
+int
+ferror(FILE *f)
+{
+	return (f->_flags & __SERR) != 0;
+}
+
+void
+clearerr(FILE *f)
+{
+	umutex_lock(&f->_lock);
+	f->_flags &= ~(__SEOF | __SERR);
+	umutex_unlock(&f->_lock);
+}
+
+int
+fileno(FILE *f)
+{
+	return f->_fd;
+}
@@ -0,0 +1,25 @@
+/*
+ * fflush.
+ */
+
+#include <stdio.h>
+
+/*
+ * C standard I/O function - write out a stream's pending output, or
+ * with NULL, every stream's.
+ */
+int
+fflush(FILE *f)
+{
+	int result;
+
+	if (f == NULL) {
+		__stdio_flushall();
+		return 0;
+	}
+
+	umutex_lock(&f->_lock);
+	result = __sflush(f);
+	umutex_unlock(&f->_lock);
+	return result;
+}
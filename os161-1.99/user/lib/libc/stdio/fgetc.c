@@ -0,0 +1,32 @@
+/*
+ * fgetc and getc.
+ */
+
+#include <stdio.h>
+
+/*
+ * C standard I/O function - read one character (0-255) from a
+ * stream, or return EOF at end of file or on error.
+ */
+int
+fgetc(FILE *f)
+{
+	int ch;
+
+	umutex_lock(&f->_lock);
+	if (!(f->_flags & __SRD) || f->_pos >= f->_len) {
+		if (__srefill(f)) {
+			umutex_unlock(&f->_lock);
+			return EOF;
+		}
+	}
+	ch = f->_buf[f->_pos++];
+	umutex_unlock(&f->_lock);
+	return ch;
+}
+
+int
+getc(FILE *f)
+{
+	return fgetc(f);
+}
@@ -0,0 +1,107 @@
+/*
+ * fopen and fclose.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+/*
+ * C standard I/O function - open a fully buffered stream on a file.
+ * MODE is "r", "w", or "a", optionally followed by "+" and/or "b".
+ */
+FILE *
+fopen(const char *path, const char *mode)
+{
+	FILE *f;
+	int oflags, sflags, fd;
+	const char *m;
+
+	switch (mode[0]) {
+	    case 'r': oflags = O_RDONLY; sflags = __SCANRD; break;
+	    case 'w': oflags = O_WRONLY|O_CREAT|O_TRUNC; sflags = __SCANWR; break;
+	    case 'a': oflags = O_WRONLY|O_CREAT|O_APPEND; sflags = __SCANWR; break;
+	    default:
+		errno = EINVAL;
+		return NULL;
+	}
+	for (m = mode+1; *m; m++) {
+		if (*m == '+') {
+			oflags = (oflags & ~O_ACCMODE) | O_RDWR;
+			sflags = __SCANRD | __SCANWR;
+		}
+		else if (*m != 'b') {
+			errno = EINVAL;
+			return NULL;
+		}
+	}
+
+	f = malloc(sizeof(FILE));
+	if (f == NULL) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	f->_buf = malloc(BUFSIZ);
+	if (f->_buf == NULL) {
+		free(f);
+		errno = ENOMEM;
+		return NULL;
+	}
+	fd = open(path, oflags, 0664);
+	if (fd < 0) {
+		free(f->_buf);
+		free(f);
+		return NULL;
+	}
+
+	f->_fd = fd;
+	f->_flags = sflags | __SMYBUF | __SMYFILE;
+	f->_mode = _IOFBF;
+	f->_bufsize = BUFSIZ;
+	f->_pos = f->_len = 0;
+	umutex_init(&f->_lock);
+
+	umutex_lock(&__sfileslock);
+	f->_next = __sfiles;
+	__sfiles = f;
+	umutex_unlock(&__sfileslock);
+
+	return f;
+}
+
+/*
+ * C standard I/O function - flush and close a stream. Returns 0, or
+ * EOF if the final flush or the close failed.
+ */
+int
+fclose(FILE *f)
+{
+	FILE **pp;
+	int result;
+
+	umutex_lock(&__sfileslock);
+	for (pp = &__sfiles; *pp != NULL; pp = &(*pp)->_next) {
+		if (*pp == f) {
+			*pp = f->_next;
+			break;
+		}
+	}
+	umutex_unlock(&__sfileslock);
+
+	umutex_lock(&f->_lock);
+	result = __sflush(f);
+	if (close(f->_fd) < 0) {
+		result = EOF;
+	}
+	umutex_unlock(&f->_lock);
+
+	if (f->_flags & __SMYBUF) {
+		free(f->_buf);
+	}
+	if (f->_flags & __SMYFILE) {
+		free(f);
+	}
+	return result;
+}
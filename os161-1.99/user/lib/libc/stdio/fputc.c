@@ -0,0 +1,30 @@
+/*
+ * fputc and putc.
+ */
+
+#include <stdio.h>
+
+/*
+ * C standard I/O function - write one character to a stream.
+ * Returns it, or EOF on error.
+ */
+int
+fputc(int ch, FILE *f)
+{
+	unsigned char c = ch;
+	size_t len;
+
+	umutex_lock(&f->_lock);
+	len = __swrite(f, &c, 1);
+	umutex_unlock(&f->_lock);
+	if (len != 1) {
+		return EOF;
+	}
+	return c;
+}
+
+int
+putc(int ch, FILE *f)
+{
+	return fputc(ch, f);
+}
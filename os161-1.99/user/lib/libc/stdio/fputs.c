@@ -0,0 +1,25 @@
+/*
+ * fputs.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * C standard I/O function - write a string (without a newline) to a
+ * stream. Returns the number of characters written, or EOF on error.
+ */
+int
+fputs(const char *s, FILE *f)
+{
+	size_t len, done;
+
+	len = strlen(s);
+	umutex_lock(&f->_lock);
+	done = __swrite(f, s, len);
+	umutex_unlock(&f->_lock);
+	if (done != len) {
+		return EOF;
+	}
+	return len;
+}
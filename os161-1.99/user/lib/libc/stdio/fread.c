@@ -0,0 +1,63 @@
+/*
+ * fread.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * C standard I/O function - read NMEMB objects of SIZE bytes each.
+ * Returns the number of whole objects read; fewer than asked for
+ * means end of file or an error (see feof and ferror).
+ *
+ * Whatever is already buffered is used first; after that, requests
+ * at least a buffer long are read straight into the caller's buffer
+ * rather than copied through ours.
+ */
+size_t
+fread(void *buf, size_t size, size_t nmemb, FILE *f)
+{
+	unsigned char *p = buf;
+	size_t len, done, n;
+	int r;
+
+	if (size == 0 || nmemb == 0) {
+		return 0;
+	}
+	len = size * nmemb;
+	done = 0;
+
+	umutex_lock(&f->_lock);
+	while (done < len) {
+		if ((f->_flags & __SRD) && f->_pos < f->_len) {
+			n = f->_len - f->_pos;
+			if (n > len - done) {
+				n = len - done;
+			}
+			memcpy(p + done, f->_buf + f->_pos, n);
+			f->_pos += n;
+			done += n;
+			continue;
+		}
+		if (len - done >= f->_bufsize && (f->_flags & __SCANRD)) {
+			__sflush(f);
+			r = read(f->_fd, p + done, len - done);
+			if (r < 0) {
+				f->_flags |= __SERR;
+				break;
+			}
+			if (r == 0) {
+				f->_flags |= __SEOF;
+				break;
+			}
+			done += r;
+			continue;
+		}
+		if (__srefill(f)) {
+			break;
+		}
+	}
+	umutex_unlock(&f->_lock);
+	return done / size;
+}
@@ -0,0 +1,24 @@
+/*
+ * fwrite.
+ */
+
+#include <stdio.h>
+
+/*
+ * C standard I/O function - write NMEMB objects of SIZE bytes each.
+ * Returns the number of whole objects written.
+ */
+size_t
+fwrite(const void *buf, size_t size, size_t nmemb, FILE *f)
+{
+	size_t len;
+
+	if (size == 0 || nmemb == 0) {
+		return 0;
+	}
+
+	umutex_lock(&f->_lock);
+	len = __swrite(f, buf, size * nmemb);
+	umutex_unlock(&f->_lock);
+	return len / size;
+}
@@ -31,23 +31,19 @@
 #include <stdarg.h>
 
 /*
- * printf - C standard I/O function.
+ * printf and fprintf - C standard I/O functions.
  */
 
 
 /*
- * Function passed to __vprintf to do the actual output.
+ * Function passed to __vprintf to do the actual output. MYDATA is
+ * the stream, already locked by vfprintf.
  */
 static
 void
 __printf_send(void *mydata, const char *data, size_t len)
 {
-	unsigned i;
-	(void)mydata;  /* not needed */
-
-	for (i=0; i<len; i++) {
-		putchar(data[i]);
-	}
+	__swrite(mydata, data, len);
 }
 
 /* printf: hand off to vprintf */
@@ -62,9 +58,36 @@ printf(const char *fmt, ...)
 	return chars;
 }
 
-/* vprintf: call __vprintf to do the work. */
+/* vprintf: print to stdout. */
 int
 vprintf(const char *fmt, va_list ap)
 {
-	return __vprintf(__printf_send, NULL, fmt, ap);
+	return vfprintf(stdout, fmt, ap);
+}
+
+/* fprintf: hand off to vfprintf */
+int
+fprintf(FILE *f, const char *fmt, ...)
+{
+	int chars;
+	va_list ap;
+	va_start(ap, fmt);
+	chars = vfprintf(f, fmt, ap);
+	va_end(ap);
+	return chars;
+}
+
+/*
+ * vfprintf: call __vprintf to do the work, holding the stream locked
+ * so the output from one call isn't interleaved with another thread's.
+ */
+int
+vfprintf(FILE *f, const char *fmt, va_list ap)
+{
+	int chars;
+
+	umutex_lock(&f->_lock);
+	chars = __vprintf(__printf_send, f, fmt, ap);
+	umutex_unlock(&f->_lock);
+	return chars;
 }
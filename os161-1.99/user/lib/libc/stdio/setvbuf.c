@@ -0,0 +1,63 @@
+/*
+ * setvbuf.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+
+/*
+ * C standard I/O function - choose a stream's buffering MODE, and
+ * optionally supply the buffer (BUF, of SIZE bytes) for it. If BUF is
+ * NULL one of SIZE bytes (or BUFSIZ, if SIZE is 0) is allocated.
+ * Anything already buffered is flushed first.
+ */
+int
+setvbuf(FILE *f, char *buf, int mode, size_t size)
+{
+	unsigned char *newbuf;
+	int myflag;
+
+	if (mode != _IOFBF && mode != _IOLBF && mode != _IONBF) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (mode == _IONBF) {
+		newbuf = NULL;
+		myflag = 0;
+	}
+	else if (buf != NULL && size > 0) {
+		newbuf = (unsigned char *)buf;
+		myflag = 0;
+	}
+	else {
+		if (size == 0) {
+			size = BUFSIZ;
+		}
+		newbuf = malloc(size);
+		if (newbuf == NULL) {
+			errno = ENOMEM;
+			return -1;
+		}
+		myflag = __SMYBUF;
+	}
+
+	umutex_lock(&f->_lock);
+	__sflush(f);
+	if (f->_flags & __SMYBUF) {
+		free(f->_buf);
+	}
+	f->_flags = (f->_flags & ~__SMYBUF) | myflag;
+	f->_mode = mode;
+	if (newbuf == NULL) {
+		f->_buf = &f->_nbuf;
+		f->_bufsize = 1;
+	}
+	else {
+		f->_buf = newbuf;
+		f->_bufsize = size;
+	}
+	umutex_unlock(&f->_lock);
+	return 0;
+}
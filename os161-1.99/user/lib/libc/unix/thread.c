@@ -0,0 +1,29 @@
+/*
+ * User-level threads. The kernel does the real work; see
+ * kern/syscall/thread_syscalls.c.
+ *
+ * Note that errno is shared by all threads of a process.
+ */
+
+#include <unistd.h>
+
+/*
+ * Every new thread starts here, on its own stack, and exits with
+ * whatever its function returns.
+ */
+static
+void
+__thread_start(int (*func)(void *), void *arg)
+{
+	thread_exit(func(arg));
+}
+
+/*
+ * Run FUNC(ARG) in a new thread of this process. Returns the thread
+ * id, for thread_join, or -1 with errno set.
+ */
+int
+thread_create(int (*func)(void *), void *arg)
+{
+	return __thread_create(__thread_start, func, arg);
+}
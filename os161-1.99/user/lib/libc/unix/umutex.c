@@ -0,0 +1,86 @@
+/*
+ * Futex-based mutexes. See umutex.h.
+ *
+ * This is the usual three-state futex mutex: a thread that finds the
+ * mutex held marks it contended (2) before sleeping, so unlock only
+ * calls futex_wake when someone may actually be asleep.
+ */
+
+#include <unistd.h>
+#include <umutex.h>
+
+/*
+ * Atomically: old = *p; if (old == expect) *p = new; return old.
+ */
+static
+int
+umutex_cas(volatile int *p, int expect, int new)
+{
+	int old, tmp;
+
+	/* retry the LL/SC if the store-conditional fails */
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 instructions */
+		".set noreorder;"	/* we fill the delay slots */
+		"1: ll %0, 0(%2);"	/*   old = *p */
+		"bne %0, %3, 2f;"	/*   if (old != expect) done */
+		" move %1, %4;"		/*   tmp = new */
+		"sc %1, 0(%2);"		/*   *p = tmp; tmp = success? */
+		"beqz %1, 1b;"		/*   if it failed, start over */
+		" nop;"
+		"2:;"
+		".set pop"		/* restore assembler mode */
+		: "=&r" (old), "=&r" (tmp)
+		: "r" (p), "r" (expect), "r" (new)
+		: "memory");
+	return old;
+}
+
+/*
+ * Atomically: old = *p; *p = new; return old.
+ */
+static
+int
+umutex_swap(volatile int *p, int new)
+{
+	int old;
+
+	do {
+		old = *p;
+	} while (umutex_cas(p, old, new) != old);
+	return old;
+}
+
+void
+umutex_init(struct umutex *m)
+{
+	m->um_state = 0;
+}
+
+int
+umutex_trylock(struct umutex *m)
+{
+	return umutex_cas(&m->um_state, 0, 1) == 0 ? 0 : -1;
+}
+
+void
+umutex_lock(struct umutex *m)
+{
+	/* fast path: free -> held */
+	if (umutex_cas(&m->um_state, 0, 1) == 0) {
+		return;
+	}
+	/* slow path: mark contended and sleep until we get it */
+	while (umutex_swap(&m->um_state, 2) != 0) {
+		futex_wait(&m->um_state, 2);
+	}
+}
+
+void
+umutex_unlock(struct umutex *m)
+{
+	if (umutex_swap(&m->um_state, 0) == 2) {
+		futex_wake(&m->um_state, 1);
+	}
+}
@@ -0,0 +1,149 @@
+/*
+ * aringexit - leave with I/O still queued on an aring.
+ *
+ * Each test forks a child that sets up a ring, queues a read that
+ * can't complete, waits until the kernel's worker has taken it, and
+ * then goes away without collecting it: by exiting, with the read on
+ * a pipe whose write end only the child holds; by exiting, with the
+ * read on the console; and by execing /bin/true with the pipe read
+ * pending, which keeps the descriptors open. The kernel has to stop
+ * the worker before it can free the address space, so if it waits
+ * for the read to finish instead of cancelling it, the test hangs.
+ *
+ * Nothing needs typing at the console; anything typed during the
+ * console test may be eaten.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+#include <aring.h>
+
+#define PAGE 4096
+
+/* the ring has to be page-aligned */
+static char ringspace[2 * PAGE];
+static char buf[512];
+
+static
+struct aring *
+alignedring(void)
+{
+	return (struct aring *)
+		(((unsigned long)ringspace + PAGE - 1) & ~(PAGE - 1UL));
+}
+
+/*
+ * Queue a read of FD and wait until the worker has taken it off the
+ * submission queue, so it is in progress, not just pending.
+ */
+static
+void
+queueread(int fd)
+{
+	struct aring *ring = alignedring();
+	struct aring_sqe *sqe;
+
+	if (aring_setup(ring) < 0) {
+		err(1, "aring_setup");
+	}
+	sqe = &ring->sqes[ring->sq_tail % ARING_ENTRIES];
+	sqe->sqe_op = ARING_OP_READ;
+	sqe->sqe_fd = fd;
+	sqe->sqe_offset = -1;
+	sqe->sqe_buf = buf;
+	sqe->sqe_len = sizeof(buf);
+	sqe->sqe_data = 1;
+	sqe->sqe_reserved = 0;
+	ring->sq_tail++;
+
+	/* wakes the worker; with min_complete 0 it doesn't wait */
+	if (aring_enter(0) < 0) {
+		err(1, "aring_enter");
+	}
+	while (ring->sq_head != ring->sq_tail) {
+		/* spin; the worker takes it as soon as it runs */
+	}
+	if (ring->cq_tail != ring->cq_head) {
+		errx(1, "read completed (result %d) before we left",
+		     (int)ring->cqes[ring->cq_head % ARING_ENTRIES].cqe_res);
+	}
+}
+
+static
+void
+pipeexit(void)
+{
+	int fds[2];
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+	queueread(fds[0]);
+	exit(0);
+}
+
+static
+void
+consoleexit(void)
+{
+	queueread(STDIN_FILENO);
+	exit(0);
+}
+
+static
+void
+pipeexec(void)
+{
+	char *args[2];
+	int fds[2];
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+	queueread(fds[0]);
+	args[0] = (char *)"true";
+	args[1] = NULL;
+	execv("/bin/true", args);
+	err(1, "/bin/true");
+}
+
+static
+void
+runtest(const char *name, void (*func)(void))
+{
+	pid_t pid;
+	int status;
+
+	printf("%s... ", name);
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		func();
+		_exit(1);
+	}
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		errx(1, "%s: child failed (status 0x%x)", name, status);
+	}
+	printf("ok\n");
+}
+
+int
+main(void)
+{
+	runtest("exit with a pipe read queued", pipeexit);
+	runtest("exit with a console read queued", consoleexit);
+	runtest("exec with a pipe read queued", pipeexec);
+	printf("aringexit: passed\n");
+	return 0;
+}
@@ -0,0 +1,291 @@
+/*
+ * aringtest - check that an aring does the I/O it is given.
+ *
+ * Sets up a ring and pushes submissions through it against a file on
+ * the current filesystem (normally SFS):
+ *
+ *   - a NOP, and submissions the kernel must refuse (a bad opcode,
+ *     nonzero sqe_reserved, a bad descriptor);
+ *   - a WRITE at the file offset (sqe_offset -1), a positional WRITE
+ *     past it, and an FSYNC; the file offset must move for the first
+ *     and not for the second;
+ *   - positional READs of both, and READs at the file offset, with the
+ *     data checked;
+ *   - back-pressure: with the completion queue full the worker must
+ *     leave further submissions alone until some completions are
+ *     consumed.
+ *
+ * Every completion's cqe_data and cqe_res is checked; operations
+ * complete in submission order.
+ *
+ * Usage: aringtest [filename]
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <err.h>
+#include <aring.h>
+
+#define PAGE 4096
+#define LEN1 1000		/* the file-offset write */
+#define POS2 5000		/* the positional write, in the next block */
+#define LEN2 700
+#define EXTRA 8			/* submissions past a full completion queue */
+
+/* the ring has to be page-aligned */
+static char ringspace[2 * PAGE];
+static struct aring *ring;
+
+static char wbuf1[LEN1], wbuf2[LEN2];
+static char rbuf1[LEN1], rbuf2[LEN2];
+
+static unsigned nextdata = 100;
+
+static
+void
+fill(char *buf, size_t len, unsigned seed)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		buf[i] = (char)(seed + i * 7);
+	}
+}
+
+/*
+ * Queue one submission and return its sqe_data.
+ */
+static
+unsigned
+submit(int op, int fd, off_t offset, void *buf, size_t len)
+{
+	struct aring_sqe *sqe;
+
+	if (ring->sq_tail - ring->sq_head >= ARING_ENTRIES) {
+		errx(1, "submission queue full");
+	}
+	sqe = &ring->sqes[ring->sq_tail % ARING_ENTRIES];
+	sqe->sqe_op = op;
+	sqe->sqe_fd = fd;
+	sqe->sqe_offset = offset;
+	sqe->sqe_buf = buf;
+	sqe->sqe_len = len;
+	sqe->sqe_data = nextdata;
+	sqe->sqe_reserved = 0;
+	ring->sq_tail++;
+	return nextdata++;
+}
+
+/*
+ * Take the next completion, which must be for DATA with result RES.
+ */
+static
+void
+expect(const char *what, unsigned data, int res)
+{
+	struct aring_cqe *cqe;
+
+	if (ring->cq_head == ring->cq_tail) {
+		if (aring_enter(1) < 0) {
+			err(1, "aring_enter");
+		}
+		if (ring->cq_head == ring->cq_tail) {
+			errx(1, "%s: no completion", what);
+		}
+	}
+	cqe = &ring->cqes[ring->cq_head % ARING_ENTRIES];
+	if (cqe->cqe_data != data) {
+		errx(1, "%s: completion for %u, expected %u", what,
+		     cqe->cqe_data, data);
+	}
+	if (cqe->cqe_res != res) {
+		errx(1, "%s: result %d, expected %d", what,
+		     (int)cqe->cqe_res, res);
+	}
+	ring->cq_head++;
+}
+
+static
+void
+checkoffset(int fd, off_t want)
+{
+	off_t pos;
+
+	pos = lseek(fd, 0, SEEK_CUR);
+	if (pos != want) {
+		errx(1, "file offset %ld, expected %ld", (long)pos, (long)want);
+	}
+}
+
+static
+void
+checkdata(const char *what, const char *got, const char *want, size_t len)
+{
+	if (memcmp(got, want, len) != 0) {
+		errx(1, "%s: wrong data read back", what);
+	}
+}
+
+static
+void
+testbad(void)
+{
+	struct aring_sqe *sqe;
+	unsigned d;
+
+	printf("nop and bad submissions... ");
+
+	d = submit(ARING_OP_NOP, -1, -1, NULL, 0);
+	expect("nop", d, 0);
+
+	d = submit(99, -1, -1, NULL, 0);
+	expect("bad op", d, -EINVAL);
+
+	d = submit(ARING_OP_NOP, -1, -1, NULL, 0);
+	sqe = &ring->sqes[(ring->sq_tail - 1) % ARING_ENTRIES];
+	sqe->sqe_reserved = 1;
+	expect("reserved", d, -EINVAL);
+
+	d = submit(ARING_OP_READ, 1000, -1, rbuf1, LEN1);
+	expect("bad fd", d, -EBADF);
+
+	printf("ok\n");
+}
+
+static
+void
+testio(int fd)
+{
+	unsigned d1, d2, d3;
+
+	printf("write and fsync... ");
+	fill(wbuf1, LEN1, 1);
+	fill(wbuf2, LEN2, 2);
+	d1 = submit(ARING_OP_WRITE, fd, -1, wbuf1, LEN1);
+	d2 = submit(ARING_OP_WRITE, fd, POS2, wbuf2, LEN2);
+	d3 = submit(ARING_OP_FSYNC, fd, -1, NULL, 0);
+	expect("write at file offset", d1, LEN1);
+	expect("positional write", d2, LEN2);
+	expect("fsync", d3, 0);
+	/* the positional write leaves the offset alone */
+	checkoffset(fd, LEN1);
+	printf("ok\n");
+
+	printf("positional read... ");
+	d1 = submit(ARING_OP_READ, fd, 0, rbuf1, LEN1);
+	d2 = submit(ARING_OP_READ, fd, POS2, rbuf2, LEN2);
+	expect("positional read", d1, LEN1);
+	expect("positional read", d2, LEN2);
+	checkdata("positional read", rbuf1, wbuf1, LEN1);
+	checkdata("positional read", rbuf2, wbuf2, LEN2);
+	checkoffset(fd, LEN1);
+	printf("ok\n");
+
+	printf("read at file offset... ");
+	if (lseek(fd, 0, SEEK_SET) != 0) {
+		err(1, "lseek");
+	}
+	memset(rbuf1, 0, LEN1);
+	/* two halves, so the second has to start where the first ended */
+	d1 = submit(ARING_OP_READ, fd, -1, rbuf1, LEN1 / 2);
+	d2 = submit(ARING_OP_READ, fd, -1, rbuf1 + LEN1 / 2, LEN1 - LEN1 / 2);
+	expect("read at file offset", d1, LEN1 / 2);
+	expect("read at file offset", d2, LEN1 - LEN1 / 2);
+	checkdata("read at file offset", rbuf1, wbuf1, LEN1);
+	checkoffset(fd, LEN1);
+
+	/* short read at end of file */
+	d1 = submit(ARING_OP_READ, fd, POS2 + LEN2 - 10, rbuf2, LEN2);
+	expect("read at end of file", d1, 10);
+	checkdata("read at end of file", rbuf2, wbuf2 + LEN2 - 10, 10);
+	printf("ok\n");
+}
+
+static
+void
+testfull(void)
+{
+	unsigned first, i;
+	int n;
+
+	printf("full completion queue... ");
+
+	first = nextdata;
+	for (i = 0; i < ARING_ENTRIES; i++) {
+		submit(ARING_OP_NOP, -1, -1, NULL, 0);
+	}
+	n = aring_enter(ARING_ENTRIES);
+	if (n != ARING_ENTRIES) {
+		errx(1, "%d completions ready, expected %d", n, ARING_ENTRIES);
+	}
+
+	/* nowhere to put these, so the worker must not take them */
+	for (i = 0; i < EXTRA; i++) {
+		submit(ARING_OP_NOP, -1, -1, NULL, 0);
+	}
+	n = aring_enter(0);
+	if (n != ARING_ENTRIES) {
+		errx(1, "%d completions ready, expected %d", n, ARING_ENTRIES);
+	}
+	if (ring->sq_tail - ring->sq_head != EXTRA) {
+		errx(1, "worker took %u submissions with the queue full",
+		     EXTRA - (ring->sq_tail - ring->sq_head));
+	}
+
+	/* make room, and the rest go through */
+	for (i = 0; i < EXTRA; i++) {
+		expect("full queue", first + i, 0);
+	}
+	n = aring_enter(ARING_ENTRIES);
+	if (n != ARING_ENTRIES) {
+		errx(1, "%d completions ready, expected %d", n, ARING_ENTRIES);
+	}
+	if (ring->sq_tail != ring->sq_head) {
+		errx(1, "submissions left after making room");
+	}
+	for (i = EXTRA; i < ARING_ENTRIES + EXTRA; i++) {
+		expect("full queue", first + i, 0);
+	}
+	printf("ok\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+	const char *filename = "aringtest.dat";
+	int fd;
+
+	if (argc > 2) {
+		errx(1, "Usage: aringtest [filename]");
+	}
+	if (argc == 2) {
+		filename = argv[1];
+	}
+
+	ring = (struct aring *)
+		(((unsigned long)ringspace + PAGE - 1) & ~(PAGE - 1UL));
+	if (aring_setup(ring) < 0) {
+		err(1, "aring_setup");
+	}
+
+	fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s", filename);
+	}
+
+	testbad();
+	testio(fd);
+	testfull();
+
+	close(fd);
+	if (remove(filename) < 0) {
+		err(1, "remove %s", filename);
+	}
+	printf("aringtest: passed\n");
+	return 0;
+}
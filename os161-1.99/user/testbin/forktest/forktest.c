@@ -56,6 +56,8 @@ int
 dofork(void)
 {
 	int pid;
+	/* don't let the child inherit a copy of stdout's pending digits */
+	fflush(stdout);
 	pid = fork();
 	if (pid < 0) {
 		warn("fork");
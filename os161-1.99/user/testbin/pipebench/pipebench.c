@@ -0,0 +1,163 @@
+/*
+ * pipebench - measure pipe throughput.
+ *
+ * Forks a reader and pushes the given number of megabytes through a
+ * pipe to it, once for each write size below, and prints the rate.
+ * Byte N of the stream is N mod 256 (all the write sizes are multiples
+ * of 256, so one buffer does for every write); the reader spot-checks
+ * each read against that and counts the bytes.
+ *
+ * Writes of two pages or more from a page-aligned buffer are eligible
+ * for the kernel's page-loaning path (see PIPE_LOANMIN in pipe.c), so
+ * the 4K run goes through the ring buffer and the 8K run is the
+ * smallest that loans. The "unaligned" run uses the 64K size at an
+ * odd address, which forces it through the ring buffer, for
+ * comparison.
+ *
+ * Each run is also marked with ltrace(LTR_BEGIN/LTR_END), so under
+ * trace161 it can be profiled on its own.
+ *
+ * Usage: pipebench [megabytes]
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+
+#define PAGE 4096
+#define MAXWRITE (64 * 1024)
+
+static struct {
+	const char *name;
+	size_t size;
+	size_t misalign;
+} runs[] = {
+	{ "512", 512, 0 },
+	{ "4K", 4096, 0 },
+	{ "8K", 2 * PAGE, 0 },
+	{ "64K", MAXWRITE, 0 },
+	{ "64K unaligned", MAXWRITE, 1 },
+};
+#define NRUNS (sizeof(runs) / sizeof(runs[0]))
+
+static char bufspace[MAXWRITE + 2 * PAGE];
+
+static
+char *
+alignedbuf(void)
+{
+	return (char *)(((unsigned long)bufspace + PAGE - 1) & ~(PAGE - 1UL));
+}
+
+static
+void
+fill(char *buf, size_t len)
+{
+	size_t i;
+
+	for (i=0; i<len; i++) {
+		buf[i] = (char)i;
+	}
+}
+
+static
+void
+reader(int fd, unsigned long total)
+{
+	char *buf = alignedbuf();
+	unsigned long pos = 0;
+	ssize_t r;
+
+	while (1) {
+		r = read(fd, buf, MAXWRITE);
+		if (r < 0) {
+			err(1, "read");
+		}
+		if (r == 0) {
+			break;
+		}
+		if (buf[0] != (char)pos || buf[r-1] != (char)(pos + r - 1)) {
+			errx(1, "wrong data near byte %lu", pos);
+		}
+		pos += r;
+	}
+	if (pos != total) {
+		errx(1, "got %lu bytes, expected %lu", pos, total);
+	}
+	_exit(0);
+}
+
+static
+void
+run(unsigned num, unsigned long total)
+{
+	char *buf = alignedbuf() + runs[num].misalign;
+	size_t size = runs[num].size;
+	time_t s0, s1;
+	unsigned long ns0, ns1, ms, pos;
+	int fds[2], status;
+	ssize_t w;
+	pid_t pid;
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		close(fds[1]);
+		reader(fds[0], total);
+	}
+	close(fds[0]);
+	fill(buf, size);
+
+	ltrace(LTR_BEGIN, num);
+	__time(&s0, &ns0);
+	for (pos = 0; pos < total; pos += w) {
+		w = write(fds[1], buf, size);
+		if (w <= 0) {
+			err(1, "write");
+		}
+	}
+	close(fds[1]);
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	__time(&s1, &ns1);
+	ltrace(LTR_END, num);
+
+	if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
+		errx(1, "reader failed");
+	}
+
+	ms = (s1 - s0) * 1000 + ns1 / 1000000 - ns0 / 1000000;
+	if (ms == 0) {
+		ms = 1;
+	}
+	printf("pipebench: %-14s writes: %lu KB in %lu ms, %lu KB/s\n",
+	       runs[num].name, total / 1024, ms, total / ms * 1000 / 1024);
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned long total;
+	unsigned i;
+
+	total = 4;
+	if (argc > 1) {
+		total = atoi(argv[1]);
+	}
+	total *= 1024 * 1024;
+
+	for (i=0; i<NRUNS; i++) {
+		run(i, total);
+	}
+	return 0;
+}